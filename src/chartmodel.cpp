@@ -1,6 +1,7 @@
 ﻿#include <QDir>
 #include <QSettings>
 #include <QStandardPaths>
+#include <QtConcurrent>
 
 #include <algorithm>
 #include <chrono>
@@ -47,10 +48,39 @@ ChartModel::ChartModel(std::shared_ptr<TileFactory> tileFactory)
     setWaitingForServerFalse();
 #endif
 
+    connect(&m_headersWatcher, &QFutureWatcher<std::vector<Catalog::ChartHeader>>::finished, this, [this]() {
+        // A scan cancelled by a directory switch has nothing to add
+        if (m_loadingCharts) {
+            addSources(m_headersWatcher.result());
+        }
+    });
+
     QSettings settings(orgName, appName);
     setDir(settings.value(chartDirKey).toString());
 }
 
+ChartModel::~ChartModel()
+{
+    cancelHeaders();
+}
+
+void ChartModel::cancelHeaders()
+{
+    // Progress still queued from the cancelled scan is ignored
+    m_scanGeneration++;
+
+    if (m_loadingCharts) {
+        m_loadingCharts = false;
+        m_loadingProgress = 1;
+        emit loadingProgressChanged();
+    }
+
+    if (m_catalog) {
+        m_catalog->cancelChartHeaders();
+    }
+    m_headersWatcher.waitForFinished();
+}
+
 void ChartModel::setWaitingForServerFalse()
 {
     m_waitingForServer = false;
@@ -112,70 +142,37 @@ void ChartModel::setUrl(const QUrl &url)
     setDir(url.toLocalFile());
 }
 
-void ChartModel::addSource(const std::shared_ptr<OesencTileSource> &tileSource, bool enabled)
-{
-    TileFactory::Source source;
-    source.name = m_currentChartBeeingLoaded.toStdString();
-    source.enabled = enabled;
-    source.tileSource = tileSource;
-
-    for (auto it = m_sourceCache.begin(); it < m_sourceCache.end(); it++) {
-        if (it->name > source.name) {
-            int i = std::distance(m_sourceCache.begin(), it);
-            beginInsertRows(QModelIndex(), i, i);
-            m_sourceCache.insert(it, source);
-            endInsertRows();
-            return;
-        }
-    }
-
-    int index = static_cast<int>(m_sourceCache.size());
-    beginInsertRows(QModelIndex(), index, index);
-    m_sourceCache.push_back(source);
-    endInsertRows();
-}
-
-bool ChartModel::loadNextFromQueue()
+void ChartModel::addSources(const std::vector<Catalog::ChartHeader> &headers)
 {
-    if (m_chartsToLoad.isEmpty()) {
-        m_loadingCharts = false;
-        m_loadingProgress = 1;
-        emit loadingProgressChanged();
-        m_tileFactory->setSources(m_sourceCache);
-
-        std::optional<GeoRect> totalExtent = m_tileFactory->totalExtent();
-
-        if (totalExtent.has_value()) {
-            auto extent = totalExtent.value();
-            emit catalogExtentCalculated(extent.top(), extent.bottom(),
-                                         extent.left(), extent.right());
-        }
-        return true;
-    }
+    beginResetModel();
+    m_sourceCache.clear();
 
-    if (m_initalQueueSize > 0) {
-        m_loadingProgress = static_cast<float>(m_initalQueueSize - m_chartsToLoad.size()) / m_initalQueueSize;
-        emit loadingProgressChanged();
+    // The headers are sorted by file name, which is the order of the model
+    for (const Catalog::ChartHeader &header : headers) {
+        TileFactory::Source source;
+        source.name = header.fileName;
+        source.enabled = true;
+        source.tileSource = std::make_shared<OesencTileSource>(m_catalog.get(),
+                                                               header,
+                                                               m_tileDir.toStdString());
+        m_sourceCache.push_back(source);
     }
 
-    m_loadingCharts = true;
-    m_currentChartBeeingLoaded = m_chartsToLoad.dequeue();
-
-    const QFileInfo fileInfo(m_currentChartBeeingLoaded);
-
-    std::unique_ptr<std::istream> stream;
-    std::string filePath = QDir(m_dir).filePath(m_currentChartBeeingLoaded).toStdString();
+    endResetModel();
 
-    static std::mutex sourceMutex;
+    m_loadingCharts = false;
+    m_loadingProgress = 1;
+    emit loadingProgressChanged();
+    updateAllEnabled();
+    m_tileFactory->setSources(m_sourceCache);
 
-    auto oesencTileCreator = std::make_shared<OesencTileSource>(m_catalog.get(),
-                                                                m_currentChartBeeingLoaded.toStdString(),
-                                                                m_tileDir.toStdString());
+    std::optional<GeoRect> totalExtent = m_tileFactory->totalExtent();
 
-    addSource(oesencTileCreator, true);
-    updateAllEnabled();
-    QMetaObject::invokeMethod(this, &ChartModel::loadNextFromQueue, Qt::QueuedConnection);
-    return true;
+    if (totalExtent.has_value()) {
+        auto extent = totalExtent.value();
+        emit catalogExtentCalculated(extent.top(), extent.bottom(),
+                                     extent.left(), extent.right());
+    }
 }
 
 void ChartModel::populateModel(const QString &dir)
@@ -184,13 +181,19 @@ void ChartModel::populateModel(const QString &dir)
         return;
     }
 
+    // The catalog is replaced below and must not be in use by a scan. The
+    // scan stops after the charts it is reading, so this does not block the
+    // GUI thread for long.
+    cancelHeaders();
+
     beginResetModel();
     m_sourceCache.clear();
     endResetModel();
 
     m_tileFactory->clear();
-    m_chartsToLoad.clear();
 
+    // A single server gives a single decryption session, so encrypted charts
+    // are decoded one at a time
     m_catalog = std::make_unique<Catalog>(m_oesencServerControl.get(), dir.toStdString());
     emit catalogTypeChanged();
 
@@ -198,20 +201,30 @@ void ChartModel::populateModel(const QString &dir)
         return;
     }
 
-    std::vector<std::string> chartFileNames = m_catalog->chartFileNames();
-    m_chartsToLoad.resize(chartFileNames.size());
-
-    std::transform(chartFileNames.cbegin(), chartFileNames.cend(), m_chartsToLoad.begin(), [](const std::string &path) {
-        return QString::fromStdString(path);
-    });
-
+    m_loadingCharts = true;
     m_loadingProgress = 0;
     emit loadingProgressChanged();
-    m_initalQueueSize = m_chartsToLoad.size();
-
-    if (loadNextFromQueue()) {
-        m_dirBeeingLoaded = dir;
-    }
+    m_dirBeeingLoaded = dir;
+
+    // Headers are read off the GUI thread. On warm starts they come from the
+    // catalog index without opening any chart.
+    Catalog *catalog = m_catalog.get();
+    const std::string indexDir = m_tileDir.toStdString();
+    const uint64_t generation = m_scanGeneration;
+
+    m_headersWatcher.setFuture(QtConcurrent::run([this, catalog, indexDir, generation]() {
+        return catalog->chartHeaders(indexDir, [this, generation](size_t done, size_t total) {
+            QMetaObject::invokeMethod(
+                this,
+                [this, generation, done, total]() {
+                    if (generation == m_scanGeneration && m_loadingCharts && total > 0) {
+                        m_loadingProgress = static_cast<float>(done) / total;
+                        emit loadingProgressChanged();
+                    }
+                },
+                Qt::QueuedConnection);
+        });
+    }));
 }
 
 void ChartModel::setDir(const QString &dir)
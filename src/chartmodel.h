@@ -4,8 +4,8 @@
 #include <memory>
 
 #include <QAbstractListModel>
+#include <QFutureWatcher>
 #include <QHash>
-#include <QQueue>
 #include <QTimer>
 #include <QUrl>
 
@@ -46,6 +46,7 @@ public:
     };
 
     ChartModel(std::shared_ptr<TileFactory> tileFactory);
+    ~ChartModel();
     QHash<int, QByteArray> roleNames() const;
     bool allEnabled() const;
     int rowCount(const QModelIndex &parent = QModelIndex()) const;
@@ -81,24 +82,23 @@ private:
     void setDir(const QString &dir);
     void enableOesencServerControl();
     void setWaitingForServerFalse();
+    void cancelHeaders();
     QHash<QString, bool> readVisibleCharts();
-    void addSource(const std::shared_ptr<OesencTileSource> &tileSource, bool enabled);
     void updateAllEnabled();
-    bool loadNextFromQueue();
-    QQueue<QString> m_chartsToLoad;
+    void addSources(const std::vector<Catalog::ChartHeader> &headers);
+    QFutureWatcher<std::vector<Catalog::ChartHeader>> m_headersWatcher;
     std::unique_ptr<oesenc::ServerControl> m_oesencServerControl;
     std::shared_ptr<TileFactory> m_tileFactory;
     QHash<int, QByteArray> m_roleNames;
     std::vector<TileFactory::Source> m_sourceCache;
     QString m_tileDir;
     QString m_dirBeeingLoaded;
-    QString m_currentChartBeeingLoaded;
     QString m_dir;
     QByteArray m_key;
     QTimer m_serverPollTimer;
     std::unique_ptr<Catalog> m_catalog;
     std::chrono::milliseconds m_serverPollDuration { 0 };
-    int m_initalQueueSize = 0;
+    uint64_t m_scanGeneration = 0;
     float m_loadingProgress = 1;
     bool m_loadingCharts = false;
     bool m_allEnabled = false;
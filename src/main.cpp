@@ -58,6 +58,11 @@ int main(int argc, char *argv[])
     application.setWindowIcon(QIcon(iconPath));
 
     std::shared_ptr<TileFactory> tileFactory = std::make_shared<TileFactory>();
+
+    // Tiles denser than this are split so that no single tile takes long to
+    // generate and tessellate
+    constexpr size_t tileVertexBudget = 200000;
+    tileFactory->setTileVertexBudget(tileVertexBudget);
     MapTileModel mapTileModel(tileFactory);
 
 #if defined(USE_OEXSERVERD) && defined(Q_OS_WIN)
@@ -7,6 +7,7 @@
 
 #include "maptile.h"
 #include "scene/tilefactorywrapper.h"
+#include "tilefactory/coordinates.h"
 #include "tilefactory/mercator.h"
 
 static const QColor builtUpAreaColor(228, 228, 177);
@@ -332,15 +333,15 @@ void MapTile::paint(QPainter *painter)
     }
 }
 
-QPolygonF MapTile::fromCapnpToPolygon(const capnp::List<ChartData::Position>::Reader src,
+QPolygonF MapTile::fromCapnpToPolygon(const ChartData::Path::Reader src,
                                       const RenderConfig &renderConfig)
 {
     QVector<QPointF> points;
-    for (const auto &position : src) {
+    for (const Pos &position : Coordinates::Path(src)) {
         const QPointF pos = toMercator(renderConfig.topLeft,
                                        renderConfig.pixelsPerLongitude,
-                                       position.getLatitude(),
-                                       position.getLongitude())
+                                       position.lat(),
+                                       position.lon())
             + renderConfig.offset;
         points.append(pos);
     }
@@ -384,7 +385,7 @@ void MapTile::clipAroundCoverage(const ::capnp::List<ChartData::CoverageArea>::R
 
             // Holes in coverage are uncommon, but reversing the holes (which
             // then will be clipped out) should in theory work.
-            for (const capnp::List<ChartData::Position>::Reader &hole : polygon.getHoles()) {
+            for (const ChartData::Path::Reader &hole : polygon.getHoles()) {
                 painterPath.addPolygon(reversePolygon(fromCapnpToPolygon(hole, renderConfig)));
                 painterPath.closeSubpath();
             }
@@ -438,7 +439,7 @@ void MapTile::paintLandArea(const ::capnp::List<ChartData::LandArea>::Reader &ar
             painterPath.addPolygon(fromCapnpToPolygon(polygon.getMain(), renderConfig));
             painterPath.closeSubpath();
 
-            for (const capnp::List<ChartData::Position>::Reader &hole : polygon.getHoles()) {
+            for (const ChartData::Path::Reader &hole : polygon.getHoles()) {
                 painterPath.addPolygon(fromCapnpToPolygon(hole, renderConfig));
                 painterPath.closeSubpath();
             }
@@ -474,7 +475,7 @@ void MapTile::paintDepthAreas(const ::capnp::List<ChartData::DepthArea>::Reader
             painterPath.addPolygon(fromCapnpToPolygon(polygon.getMain(), renderConfig));
             painterPath.closeSubpath();
 
-            for (const capnp::List<ChartData::Position>::Reader &hole : polygon.getHoles()) {
+            for (const ChartData::Path::Reader &hole : polygon.getHoles()) {
                 painterPath.addPolygon(fromCapnpToPolygon(hole, renderConfig));
                 painterPath.closeSubpath();
             }
@@ -508,11 +509,11 @@ void MapTile::paintRoads(const capnp::List<ChartData::Road>::Reader &roads,
         for (const auto &line : road.getLines()) {
 
             QVector<QPointF> points;
-            for (const auto &pos : line.getPositions()) {
+            for (const Pos &pos : Coordinates::Path(line.getPositions())) {
                 QPointF point = toMercator(renderConfig.topLeft,
                                            renderConfig.pixelsPerLongitude,
-                                           pos.getLatitude(),
-                                           pos.getLongitude())
+                                           pos.lat(),
+                                           pos.lon())
                     + renderConfig.offset;
                 points.append(point);
             }
@@ -560,7 +561,7 @@ void MapTile::paintBuiltUpArea(const ::capnp::List<ChartData::BuiltUpArea>::Read
             painterPath.addPolygon(fromCapnpToPolygon(polygon.getMain(), renderConfig));
             painterPath.closeSubpath();
 
-            for (const capnp::List<ChartData::Position>::Reader &hole : polygon.getHoles()) {
+            for (const ChartData::Path::Reader &hole : polygon.getHoles()) {
                 painterPath.addPolygon(fromCapnpToPolygon(hole, renderConfig));
                 painterPath.closeSubpath();
             }
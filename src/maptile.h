@@ -110,7 +110,7 @@ private:
                            const RenderConfig &renderConfig,
                            QPainter *painter);
 
-    static QPolygonF fromCapnpToPolygon(const capnp::List<ChartData::Position>::Reader src,
+    static QPolygonF fromCapnpToPolygon(const ChartData::Path::Reader src,
                                         const RenderConfig &renderConfig);
 
     static QPolygonF reversePolygon(const QPolygonF &input);
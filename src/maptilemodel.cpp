@@ -1,6 +1,8 @@
 #include <algorithm>
+#include <map>
 
 #include <QDebug>
+#include <QThreadPool>
 // #include <xlocale>
 
 #include "maptile.h"
@@ -88,6 +90,7 @@ void MapTileModel::update()
     }
 
     if (!correct.isEmpty()) {
+        prefetch(correct.values());
         beginInsertRows(QModelIndex(), m_tiles.size(), m_tiles.size() + correct.size() - 1);
         QList<std::string> keys = correct.keys();
         for (const std::string &key : keys) {
@@ -99,6 +102,28 @@ void MapTileModel::update()
     emit countChanged(count());
 }
 
+void MapTileModel::prefetch(const QList<TileFactory::Tile> &tiles)
+{
+    // Tiles of the same resolution are generated in one batch, which lets
+    // each chart produce all its tiles from a single pass. Tiles split for
+    // their density have a higher resolution than the rest of the viewport
+    // and form batches of their own. The per tile requests from the views
+    // will then find the tiles on disk.
+    std::map<int, std::vector<GeoRect>> rectsByResolution;
+
+    for (const TileFactory::Tile &tile : tiles) {
+        rectsByResolution[tile.maxPixelsPerLon].push_back(tile.boundingBox);
+    }
+
+    std::shared_ptr<TileFactory> tileFactory = m_tileFactory;
+
+    for (const auto &[pixelsPerLon, rects] : rectsByResolution) {
+        QThreadPool::globalInstance()->start([tileFactory, rects, pixelsPerLon]() {
+            tileFactory->tileData(rects, pixelsPerLon);
+        });
+    }
+}
+
 int MapTileModel::count() const
 {
     return m_tiles.size();
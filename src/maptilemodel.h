@@ -43,6 +43,7 @@ signals:
     void countChanged(int count);
 
 private:
+    void prefetch(const QList<TileFactory::Tile> &tiles);
     static QVariantMap createTileRef(const QString &tileId,
                                      const GeoRect &boundingBox,
                                      int maxPixelsPerLon);
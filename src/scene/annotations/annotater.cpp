@@ -6,6 +6,7 @@
 #include "annotater.h"
 #include "scene/annotations/fontimage.h"
 #include "symbolimage.h"
+#include "tilefactory/coordinates.h"
 #include "tilefactory/mercator.h"
 
 using namespace std;
@@ -43,10 +44,11 @@ Annotater::Annotater(shared_ptr<const FontImage> &fontImage,
 {
 }
 
-QPointF Annotater::posToMercator(const ChartData::Position::Reader &pos) const
+QPointF Annotater::posToMercator(const ChartData::Position::Reader &src) const
 {
-    return { Mercator::mercatorWidth(0, pos.getLongitude(), m_pixelsPerLon),
-             Mercator::mercatorHeight(0, pos.getLatitude(), m_pixelsPerLon) };
+    const Pos pos = Coordinates::toPos(src);
+    return { Mercator::mercatorWidth(0, pos.lon(), m_pixelsPerLon),
+             Mercator::mercatorHeight(0, pos.lat(), m_pixelsPerLon) };
 }
 
 QString Annotater::getDepthString(float depth) const
@@ -6,6 +6,7 @@
 #include "annotations/zoomsweeper.h"
 #include "cutlines/cutlines.h"
 #include "tessellator.h"
+#include "tilefactory/coordinates.h"
 #include "tilefactory/mercator.h"
 #include "tilefactory/triangulator.h"
 
@@ -32,12 +33,6 @@ const int s_pixelsPerLon = 1000;
 using namespace std;
 
 namespace {
-QPointF posToMercator(const ChartData::Position::Reader &pos)
-{
-    return { Mercator::mercatorWidth(0, pos.getLongitude(), s_pixelsPerLon),
-             Mercator::mercatorHeight(0, pos.getLatitude(), s_pixelsPerLon) };
-}
-
 QPointF posToMercator(double lat, double lon)
 {
     return { Mercator::mercatorWidth(0, lon, s_pixelsPerLon),
@@ -69,8 +64,7 @@ QList<PolygonNode::Vertex> drawPolygons(const typename capnp::List<T>::Reader &a
             std::vector<std::vector<Triangulator::Point>> polylines;
             std::vector<Triangulator::Point> polyline;
 
-            capnp::List<ChartData::Position>::Reader main = polygon.getMain();
-            for (ChartData::Position::Reader pos : main) {
+            for (const Pos &pos : Coordinates::Path(polygon.getMain())) {
                 QPointF p = posToMercator(pos);
                 polyline.push_back({ p.x(), p.y() });
             }
@@ -79,7 +73,7 @@ QList<PolygonNode::Vertex> drawPolygons(const typename capnp::List<T>::Reader &a
             for (const auto &hole : polygon.getHoles()) {
                 std::vector<Triangulator::Point> polyline;
 
-                for (const auto &pos : hole) {
+                for (const Pos &pos : Coordinates::Path(hole)) {
                     QPointF p = posToMercator(pos);
                     polyline.push_back({ p.x(), p.y() });
                 }
@@ -203,15 +197,17 @@ QList<LineNode::Vertex> drawLines(const typename capnp::List<T>::Reader &areas,
         }
 
         for (const ChartData::Line::Reader &line : area.getLines()) {
-            if (line.getPositions().size() < 2) {
+            const Coordinates::Path positions(line.getPositions());
+
+            if (positions.size() < 2) {
                 continue;
             }
 
             QList<QPointF> points;
-            points.reserve(line.getPositions().size());
+            points.reserve(positions.size());
 
-            for (const ChartData::Position::Reader &position : line.getPositions()) {
-                points.append(posToMercator(position.getLatitude(), position.getLongitude()));
+            for (const Pos &position : positions) {
+                points.append(posToMercator(position));
             }
 
             vertices.append(tessellateLine(points, color));
@@ -262,9 +258,9 @@ QList<LineNode::Vertex> strokePolygons(const typename capnp::List<T>::Reader &ar
         }
 
         for (const ChartData::Polygon::Reader &polygonHole : area.getPolygons()) {
-            std::vector<capnp::List<ChartData::Position>::Reader> pathsToStroke;
+            std::vector<ChartData::Path::Reader> pathsToStroke;
             pathsToStroke.push_back(polygonHole.getMain());
-            for (capnp::List<ChartData::Position>::Reader holes : polygonHole.getHoles()) {
+            for (ChartData::Path::Reader holes : polygonHole.getHoles()) {
                 pathsToStroke.push_back(holes);
             }
 
@@ -275,16 +271,16 @@ QList<LineNode::Vertex> strokePolygons(const typename capnp::List<T>::Reader &ar
 
             std::vector<cutlines::Line> clippedLines;
 
-            for (capnp::List<ChartData::Position>::Reader &srcLine : pathsToStroke) {
+            for (const ChartData::Path::Reader &srcPath : pathsToStroke) {
+                const Coordinates::Path srcLine(srcPath);
                 Q_ASSERT(srcLine.size() > 0);
 
                 cutlines::Line line;
 
-                for (int i = 0; i < srcLine.size(); i++) {
-                    line.push_back({ srcLine[i].getLongitude(), srcLine[i].getLatitude() });
+                for (const Pos &pos : srcLine) {
+                    line.push_back({ pos.lon(), pos.lat() });
                 }
-                line.push_back({ srcLine[0].getLongitude(),
-                                 srcLine[0].getLatitude() });
+                line.push_back(line.front());
 
                 std::vector<cutlines::Line> lines = cutlines::clip(line, rect);
                 clippedLines.insert(clippedLines.begin(), lines.begin(), lines.end());
@@ -0,0 +1,114 @@
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <oesenc/chartfile.h>
+
+#include "tilefactory/catalog.h"
+
+/*
+    Decodes every chart of an unencrypted catalog through a local stand-in
+    for oexserverd with an increasing number of decryption sessions.
+
+    Each stand-in session reads the file and spends CPU time comparable to
+    decryption before it serves the stream, one stream at a time like the
+    real server.
+
+    Usage: catalog_benchmark <unencrypted catalog dir> [max sessions]
+*/
+
+namespace {
+constexpr int decryptionRounds = 8;
+
+Catalog::Session standInSession()
+{
+    return [](const std::filesystem::path &file) -> std::shared_ptr<std::istream> {
+        std::ifstream input(file, std::ios::binary);
+        if (!input) {
+            return nullptr;
+        }
+
+        std::string data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+        // Encrypt and decrypt with a key stream an even number of times,
+        // which leaves the data unchanged
+        for (int round = 0; round < decryptionRounds; round++) {
+            uint32_t state = 0x9e3779b9;
+            for (char &c : data) {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                c ^= static_cast<char>(state);
+            }
+        }
+
+        return std::make_shared<std::istringstream>(std::move(data));
+    };
+}
+
+void run(Catalog &catalog, const std::vector<std::string> &fileNames, size_t sessionCount)
+{
+    catalog.setSessions(std::vector<Catalog::Session>(sessionCount, standInSession()));
+
+    std::atomic<size_t> next = 0;
+    std::atomic<size_t> decoded = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < sessionCount; i++) {
+        workers.emplace_back([&]() {
+            for (size_t j = next++; j < fileNames.size(); j = next++) {
+                std::shared_ptr<std::istream> stream = catalog.openChart(fileNames[j]);
+                if (!stream) {
+                    continue;
+                }
+
+                oesenc::ChartFile chart(*stream);
+                if (chart.read()) {
+                    decoded++;
+                }
+            }
+        });
+    }
+
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << sessionCount << " sessions: "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms, "
+              << decoded << " charts decoded" << std::endl;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <unencrypted catalog dir> [max sessions]" << std::endl;
+        return 1;
+    }
+
+    Catalog catalog(nullptr, argv[1]);
+
+    if (catalog.type() != Catalog::Type::Unencrypted) {
+        std::cerr << "Not an unencrypted catalog: " << argv[1] << std::endl;
+        return 1;
+    }
+
+    const size_t maxSessions = argc > 2 ? std::stoul(argv[2]) : std::max(std::thread::hardware_concurrency(), 1u);
+    const std::vector<std::string> fileNames = catalog.chartFileNames();
+
+    for (size_t sessions = 1; sessions <= maxSessions; sessions *= 2) {
+        run(catalog, fileNames, sessions);
+    }
+
+    return 0;
+}
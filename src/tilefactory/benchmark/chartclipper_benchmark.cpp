@@ -0,0 +1,104 @@
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "tilefactory/chart.h"
+#include "tilefactory/chartclipper.h"
+
+/*
+    Compares the rectangle clipping path of ChartClipper with the general
+    boolean operations path on the depth areas of an internal chart.
+
+    Usage: chartclipper_benchmark <chart file> [tiles per side]
+*/
+
+namespace {
+constexpr int tileSize = 1024;
+
+using ClipFunction = std::function<std::vector<ChartClipper::Polygon>(const ChartData::Polygon::Reader &,
+                                                                      ChartClipper::Config)>;
+
+std::vector<ChartClipper::Config> tileConfigs(const GeoRect &extent, int tilesPerSide)
+{
+    std::vector<ChartClipper::Config> configs;
+    const double width = extent.width() / tilesPerSide;
+    const double height = extent.height() / tilesPerSide;
+
+    for (int row = 0; row < tilesPerSide; row++) {
+        for (int column = 0; column < tilesPerSide; column++) {
+            ChartClipper::Config config;
+            config.box = GeoRect(extent.top() - row * height,
+                                 extent.top() - (row + 1) * height,
+                                 extent.left() + column * width,
+                                 extent.left() + (column + 1) * width);
+            config.chartBoundingBox = extent;
+            config.longitudeResolution = width / tileSize;
+            config.latitudeResolution = height / tileSize;
+            config.longitudeMargin = 6 * config.longitudeResolution;
+            config.latitudeMargin = 6 * config.latitudeResolution;
+            configs.push_back(config);
+        }
+    }
+
+    return configs;
+}
+
+void run(const std::string &label,
+         const Chart &chart,
+         const std::vector<ChartClipper::Config> &configs,
+         const ClipFunction &clip)
+{
+    size_t polygons = 0;
+    size_t holes = 0;
+    size_t vertices = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    for (const ChartClipper::Config &config : configs) {
+        for (const ChartData::DepthArea::Reader &depthArea : chart.depthAreas()) {
+            for (const ChartData::Polygon::Reader &polygon : depthArea.getPolygons()) {
+                for (const ChartClipper::Polygon &clipped : clip(polygon, config)) {
+                    polygons++;
+                    holes += clipped.holes.size();
+                    vertices += clipped.main.size();
+                }
+            }
+        }
+    }
+
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    const auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed);
+
+    std::cout << label << ": " << milliseconds.count() << " ms, "
+              << polygons << " polygons, "
+              << holes << " holes, "
+              << vertices << " vertices" << std::endl;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <chart file> [tiles per side]" << std::endl;
+        return 1;
+    }
+
+    std::shared_ptr<Chart> chart = Chart::open(argv[1]);
+
+    if (!chart) {
+        return 1;
+    }
+
+    const int tilesPerSide = argc > 2 ? std::stoi(argv[2]) : 8;
+    const std::vector<ChartClipper::Config> configs = tileConfigs(chart->boundingBox(), tilesPerSide);
+
+    std::cout << chart->depthAreas().size() << " depth areas clipped to "
+              << configs.size() << " tiles" << std::endl;
+
+    run("General", *chart, configs, ChartClipper::clipPolygonGeneral);
+    run("Rectangle", *chart, configs, ChartClipper::clipPolygon);
+
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <string>
+
+#include <capnp/serialize-packed.h>
+#include <capnp/serialize.h>
+#include <kj/io.h>
+
+#include "chartformat.capnp.h"
+#include "tilefactory/chart.h"
+#include "tilefactory/coordinates.h"
+
+/*
+    Compares the quantized, delta encoded coordinates of internal charts with
+    the Float64 positions charts were stored with before.
+
+    Decodes one chart and writes all its polygon rings and lines in both
+    encodings. Reports the size of each, unpacked and packed, and how fast
+    positions are read from the unpacked and the packed message. Reading
+    sums the coordinates without copying them anywhere.
+
+    Usage: chartformat_benchmark <chart file> [passes]
+*/
+
+namespace {
+using Paths = std::vector<std::vector<Pos>>;
+
+template <typename T>
+void addPolygons(Paths &paths, const typename capnp::List<T>::Reader &items)
+{
+    for (const typename T::Reader &item : items) {
+        for (const ChartData::Polygon::Reader &polygon : item.getPolygons()) {
+            paths.push_back(Coordinates::toPositions(polygon.getMain()));
+            for (const ChartData::Path::Reader &hole : polygon.getHoles()) {
+                paths.push_back(Coordinates::toPositions(hole));
+            }
+        }
+    }
+}
+
+template <typename T>
+void addLines(Paths &paths, const typename capnp::List<T>::Reader &items)
+{
+    for (const typename T::Reader &item : items) {
+        for (const ChartData::Line::Reader &line : item.getLines()) {
+            paths.push_back(Coordinates::toPositions(line.getPositions()));
+        }
+    }
+}
+
+Paths readPaths(const Chart &chart)
+{
+    Paths paths;
+    addPolygons<ChartData::CoverageArea>(paths, chart.coverage());
+    addPolygons<ChartData::LandArea>(paths, chart.landAreas());
+    addPolygons<ChartData::BuiltUpArea>(paths, chart.builtUpAreas());
+    addPolygons<ChartData::DepthArea>(paths, chart.depthAreas());
+    addPolygons<ChartData::Pontoon>(paths, chart.pontoons());
+    addPolygons<ChartData::ShorelineConstruction>(paths, chart.shorelineConstructions());
+    addPolygons<ChartData::Road>(paths, chart.roads());
+    addLines<ChartData::CoastLine>(paths, chart.coastLines());
+    addLines<ChartData::DepthContour>(paths, chart.depthContours());
+    addLines<ChartData::Pontoon>(paths, chart.pontoons());
+    addLines<ChartData::ShorelineConstruction>(paths, chart.shorelineConstructions());
+    addLines<ChartData::Road>(paths, chart.roads());
+    return paths;
+}
+
+// The paths as lines of a single depth contour, without ranks
+void writeDelta(capnp::MessageBuilder &message, const Paths &paths)
+{
+    ChartData::Builder root = message.initRoot<ChartData>();
+    capnp::List<ChartData::Line>::Builder lines = root.initDepthContours(1)[0].initLines(static_cast<unsigned int>(paths.size()));
+
+    for (unsigned int i = 0; i < paths.size(); i++) {
+        Coordinates::fromPositions(lines[i].initPositions(), paths[i]);
+    }
+}
+
+void writeFloat64(capnp::MessageBuilder &message, const Paths &paths)
+{
+    Float64Paths::Builder root = message.initRoot<Float64Paths>();
+    capnp::List<Float64Paths::Line>::Builder lines = root.initLines(static_cast<unsigned int>(paths.size()));
+
+    for (unsigned int i = 0; i < paths.size(); i++) {
+        capnp::List<Float64Paths::Position>::Builder positions = lines[i].initPositions(static_cast<unsigned int>(paths[i].size()));
+        for (unsigned int j = 0; j < paths[i].size(); j++) {
+            positions[j].setLatitude(paths[i][j].lat());
+            positions[j].setLongitude(paths[i][j].lon());
+        }
+    }
+}
+
+double checksum(const ChartData::Reader &root)
+{
+    double sum = 0;
+    for (const ChartData::Line::Reader &line : root.getDepthContours()[0].getLines()) {
+        for (const Pos &pos : Coordinates::Path(line.getPositions())) {
+            sum += pos.lat() + pos.lon();
+        }
+    }
+    return sum;
+}
+
+double checksum(const Float64Paths::Reader &root)
+{
+    double sum = 0;
+    for (const Float64Paths::Line::Reader &line : root.getLines()) {
+        for (const Float64Paths::Position::Reader &pos : line.getPositions()) {
+            sum += pos.getLatitude() + pos.getLongitude();
+        }
+    }
+    return sum;
+}
+
+capnp::ReaderOptions readerOptions()
+{
+    capnp::ReaderOptions options;
+    options.traversalLimitInWords = std::numeric_limits<uint64_t>::max();
+    return options;
+}
+
+template <typename T>
+void run(const std::string &label, capnp::MessageBuilder &message, size_t positions, int passes)
+{
+    const kj::Array<capnp::word> words = capnp::messageToFlatArray(message);
+    kj::VectorOutputStream packed;
+    capnp::writePackedMessage(packed, message);
+
+    double sum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < passes; i++) {
+        capnp::FlatArrayMessageReader reader(words, readerOptions());
+        sum += checksum(reader.getRoot<T>());
+    }
+    const double unpackedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < passes; i++) {
+        kj::ArrayInputStream input(packed.getArray());
+        capnp::PackedMessageReader reader(input, readerOptions());
+        sum += checksum(reader.getRoot<T>());
+    }
+    const double packedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const size_t unpackedBytes = words.asBytes().size();
+    const size_t packedBytes = packed.getArray().size();
+    const double perPosition = 1. / std::max<size_t>(positions, 1);
+    const double millionPositions = static_cast<double>(positions) * passes / 1e6;
+
+    std::cout << label << ":" << std::endl
+              << "  Unpacked: " << unpackedBytes << " bytes, "
+              << unpackedBytes * perPosition << " bytes per position, "
+              << millionPositions / std::max(unpackedSeconds, 1e-9) << " million positions read per second" << std::endl
+              << "  Packed: " << packedBytes << " bytes, "
+              << packedBytes * perPosition << " bytes per position, "
+              << millionPositions / std::max(packedSeconds, 1e-9) << " million positions read per second" << std::endl
+              << "  Checksum " << sum << std::endl;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <chart file> [passes]" << std::endl;
+        return 1;
+    }
+
+    std::shared_ptr<Chart> chart = Chart::open(argv[1]);
+
+    if (!chart) {
+        return 1;
+    }
+
+    const int passes = argc > 2 ? std::stoi(argv[2]) : 10;
+    const Paths paths = readPaths(*chart);
+
+    size_t positions = 0;
+    for (const std::vector<Pos> &path : paths) {
+        positions += path.size();
+    }
+
+    std::cout << paths.size() << " paths with " << positions << " positions, "
+              << passes << " passes" << std::endl;
+
+    capnp::MallocMessageBuilder deltaMessage;
+    writeDelta(deltaMessage, paths);
+    run<ChartData>("Delta encoded Int32", deltaMessage, positions, passes);
+
+    capnp::MallocMessageBuilder float64Message;
+    writeFloat64(float64Message, paths);
+    run<Float64Paths>("Float64", float64Message, positions, passes);
+
+    return 0;
+}
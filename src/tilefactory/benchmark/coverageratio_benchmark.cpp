@@ -0,0 +1,157 @@
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <capnp/message.h>
+
+#include "tilefactory/coordinates.h"
+#include "tilefactory/triangulator.h"
+
+#include "coverageratio.h"
+
+/*
+    Accumulates the coverage of 1, 5 and 20 overlapping synthetic charts
+    into a tile, and compares CoverageRatio with a full union and
+    triangulation after every chart.
+
+    Usage: coverageratio_benchmark [iterations]
+*/
+
+namespace {
+constexpr int verticesPerChart = 4096;
+
+const GeoRect tileRect(59.5, 59.0, 18.0, 19.0);
+
+std::unique_ptr<capnp::MallocMessageBuilder> createChart(int index, int chartCount)
+{
+    // Jagged rings spread around the tile center. Each ring reaches outside
+    // the tile and the rings overlap, but together they leave the corners
+    // uncovered so that no run stops early.
+    const double angle = 2 * M_PI * index / chartCount;
+    const double centerLat = (tileRect.top() + tileRect.bottom()) / 2
+        + (chartCount > 1 ? 0.15 * tileRect.height() * std::sin(angle) : 0);
+    const double centerLon = (tileRect.left() + tileRect.right()) / 2
+        + (chartCount > 1 ? 0.15 * tileRect.width() * std::cos(angle) : 0);
+    const double radiusLat = 0.45 * tileRect.height();
+    const double radiusLon = 0.45 * tileRect.width();
+
+    std::vector<Pos> positions;
+    positions.reserve(verticesPerChart + 1);
+
+    for (int i = 0; i < verticesPerChart; i++) {
+        const double a = 2 * M_PI * i / verticesPerChart;
+        const double r = 1 + 0.05 * std::sin(37 * a + index);
+        positions.emplace_back(centerLat + r * radiusLat * std::sin(a), centerLon + r * radiusLon * std::cos(a));
+    }
+    positions.push_back(positions.front());
+
+    auto message = std::make_unique<capnp::MallocMessageBuilder>();
+    ChartData::Builder root = message->initRoot<ChartData>();
+    ChartData::CoverageArea::Builder coverage = root.initCoverage(1)[0];
+
+    ChartData::BoundingBox::Builder box = coverage.initBoundingBox();
+    box.setTop(centerLat + 1.05 * radiusLat);
+    box.setBottom(centerLat - 1.05 * radiusLat);
+    box.setLeft(centerLon - 1.05 * radiusLon);
+    box.setRight(centerLon + 1.05 * radiusLon);
+
+    Coordinates::fromPositions(coverage.initPolygons(1)[0].initMain(), positions);
+    return message;
+}
+
+// The accumulation CoverageRatio used before: the whole coverage is united
+// again for every chart and the union is triangulated to get its area.
+class FullUnionRatio
+{
+public:
+    void accumulate(const capnp::List<ChartData::CoverageArea>::Reader &coverages)
+    {
+        Clipper2Lib::PathsD input = m_coverage;
+
+        for (const ChartData::CoverageArea::Reader &coverage : coverages) {
+            for (const ChartData::Polygon::Reader &polygon : coverage.getPolygons()) {
+                Clipper2Lib::PathD path;
+                for (const Pos &pos : Coordinates::Path(polygon.getMain())) {
+                    path.push_back({ pos.lat(), pos.lon() });
+                }
+                input.push_back(path);
+            }
+        }
+
+        m_coverage = Clipper2Lib::Union(input, Clipper2Lib::FillRule::EvenOdd, 5);
+    }
+
+    float ratio() const
+    {
+        std::vector<std::vector<Triangulator::Point>> lines;
+        for (const Clipper2Lib::PathD &path : m_coverage) {
+            std::vector<Triangulator::Point> line;
+            for (const Clipper2Lib::PointD &point : path) {
+                line.push_back({ point.x, point.y });
+            }
+            lines.push_back(line);
+        }
+
+        std::vector<Triangulator::Point> triangles = Triangulator::calc(lines);
+
+        double area = 0;
+        for (size_t i = 0; i + 2 < triangles.size(); i += 3) {
+            const Triangulator::Point &a = triangles[i];
+            const Triangulator::Point &b = triangles[i + 1];
+            const Triangulator::Point &c = triangles[i + 2];
+            area += 0.5 * std::fabs(a[0] * (b[1] - c[1]) + b[0] * (c[1] - a[1]) + c[0] * (a[1] - b[1]));
+        }
+
+        return static_cast<float>(area / (tileRect.width() * tileRect.height()));
+    }
+
+private:
+    Clipper2Lib::PathsD m_coverage;
+};
+
+template <typename Ratio>
+void run(const std::string &label,
+         const std::vector<std::unique_ptr<capnp::MallocMessageBuilder>> &charts,
+         int iterations,
+         Ratio createRatio)
+{
+    float ratio = 0;
+    const auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < iterations; i++) {
+        auto coverageRatio = createRatio();
+        for (const std::unique_ptr<capnp::MallocMessageBuilder> &chart : charts) {
+            coverageRatio.accumulate(chart->getRoot<ChartData>().asReader().getCoverage());
+            ratio = coverageRatio.ratio();
+        }
+    }
+
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "  " << label << ": "
+              << std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() / iterations
+              << " us per tile, ratio " << ratio << std::endl;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    const int iterations = argc > 1 ? std::stoi(argv[1]) : 20;
+
+    for (int chartCount : { 1, 5, 20 }) {
+        std::vector<std::unique_ptr<capnp::MallocMessageBuilder>> charts;
+        for (int i = 0; i < chartCount; i++) {
+            charts.push_back(createChart(i, chartCount));
+        }
+
+        std::cout << chartCount << " overlapping charts" << std::endl;
+
+        run("Incremental", charts, iterations, [] { return CoverageRatio(tileRect); });
+        run("Full union", charts, iterations, [] { return FullUnionRatio(); });
+    }
+
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <string>
+
+#ifdef HAVE_RUST_SIMPLIFIER
+#include <tilefactory_rust/lib.rs.h>
+#endif
+
+#include "tilefactory/chart.h"
+#include "tilefactory/coordinates.h"
+#include "tilefactory/linesimplifier.h"
+
+/*
+    Simplifies every polygon ring and line of an internal chart with the
+    native simplifier, and with the Rust simplifier when it is built.
+
+    Usage: linesimplifier_benchmark <chart file> [epsilon in degrees]
+*/
+
+namespace {
+void addPath(LineSimplifier::Batch &batch, const ChartData::Path::Reader &path)
+{
+    batch.beginPath();
+    for (const Pos &pos : Coordinates::Path(path)) {
+        batch.append(pos);
+    }
+}
+
+template <typename T>
+void addPolygons(LineSimplifier::Batch &batch, const typename capnp::List<T>::Reader &items)
+{
+    for (const typename T::Reader &item : items) {
+        for (const ChartData::Polygon::Reader &polygon : item.getPolygons()) {
+            addPath(batch, polygon.getMain());
+            for (const ChartData::Path::Reader &hole : polygon.getHoles()) {
+                addPath(batch, hole);
+            }
+        }
+    }
+}
+
+template <typename T>
+void addLines(LineSimplifier::Batch &batch, const typename capnp::List<T>::Reader &items)
+{
+    for (const typename T::Reader &item : items) {
+        for (const ChartData::Line::Reader &line : item.getLines()) {
+            addPath(batch, line.getPositions());
+        }
+    }
+}
+
+size_t positions(const LineSimplifier::Batch &batch)
+{
+    return std::accumulate(batch.sizes.begin(), batch.sizes.end(), size_t(0));
+}
+
+void run(const std::string &label,
+         LineSimplifier::Batch batch,
+         double epsilon,
+         LineSimplifier::Algorithm algorithm)
+{
+    const auto start = std::chrono::steady_clock::now();
+    LineSimplifier::simplify(batch, epsilon, algorithm);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << label << ": "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms, "
+              << positions(batch) << " positions kept" << std::endl;
+}
+
+#ifdef HAVE_RUST_SIMPLIFIER
+void runRust(const LineSimplifier::Batch &batch, double epsilon)
+{
+    size_t kept = 0;
+    const auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < batch.size(); i++) {
+        ::rust::Vec<tilefactory_rust::Pos> input;
+        input.reserve(batch.sizes[i]);
+        for (const Pos &pos : batch.path(i)) {
+            input.push_back({ pos.lat(), pos.lon() });
+        }
+        kept += tilefactory_rust::simplify(input, epsilon).size();
+    }
+
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "Rust Douglas-Peucker: "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms, "
+              << kept << " positions kept" << std::endl;
+}
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <chart file> [epsilon in degrees]" << std::endl;
+        return 1;
+    }
+
+    std::shared_ptr<Chart> chart = Chart::open(argv[1]);
+
+    if (!chart) {
+        return 1;
+    }
+
+    const double epsilon = argc > 2 ? std::stod(argv[2]) : 1e-4;
+
+    LineSimplifier::Batch batch;
+    addPolygons<ChartData::CoverageArea>(batch, chart->coverage());
+    addPolygons<ChartData::LandArea>(batch, chart->landAreas());
+    addPolygons<ChartData::BuiltUpArea>(batch, chart->builtUpAreas());
+    addPolygons<ChartData::DepthArea>(batch, chart->depthAreas());
+    addPolygons<ChartData::Pontoon>(batch, chart->pontoons());
+    addPolygons<ChartData::ShorelineConstruction>(batch, chart->shorelineConstructions());
+    addPolygons<ChartData::Road>(batch, chart->roads());
+    addLines<ChartData::CoastLine>(batch, chart->coastLines());
+    addLines<ChartData::DepthContour>(batch, chart->depthContours());
+    addLines<ChartData::Pontoon>(batch, chart->pontoons());
+    addLines<ChartData::ShorelineConstruction>(batch, chart->shorelineConstructions());
+    addLines<ChartData::Road>(batch, chart->roads());
+
+    std::cout << batch.size() << " paths with " << positions(batch)
+              << " positions simplified with epsilon " << epsilon << std::endl;
+
+    run("Douglas-Peucker", batch, epsilon, LineSimplifier::Algorithm::DouglasPeucker);
+    run("Visvalingam", batch, epsilon, LineSimplifier::Algorithm::Visvalingam);
+
+#ifdef HAVE_RUST_SIMPLIFIER
+    runRust(batch, epsilon);
+#endif
+
+    return 0;
+}
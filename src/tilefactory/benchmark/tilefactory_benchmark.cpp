@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <capnp/message.h>
+
+#include "tilefactory/coordinates.h"
+#include "tilefactory/itilesource.h"
+#include "tilefactory/tilefactory.h"
+
+/*
+    Calls tileData from 16 threads on random tiles of a catalog of synthetic
+    charts while another thread keeps enabling and disabling charts.
+
+    Usage: tilefactory_benchmark [charts per side] [seconds]
+*/
+
+namespace {
+constexpr int readerCount = 16;
+constexpr double chartSize = 0.5;
+
+// Returns the same small chart for every tile
+class StaticTileSource : public ITileSource
+{
+public:
+    StaticTileSource(const GeoRect &extent, int scale, std::shared_ptr<Chart> chart)
+        : m_extent(extent)
+        , m_scale(scale)
+        , m_chart(std::move(chart))
+    {
+    }
+
+    std::shared_ptr<Chart> create(const GeoRect &, int) override { return m_chart; }
+    GeoRect extent() const override { return m_extent; }
+    int scale() const override { return m_scale; }
+
+private:
+    GeoRect m_extent;
+    int m_scale;
+    std::shared_ptr<Chart> m_chart;
+};
+
+std::shared_ptr<Chart> createChart(const std::string &filename)
+{
+    capnp::MallocMessageBuilder message;
+    ChartData::Builder root = message.initRoot<ChartData>();
+    ChartData::CoverageArea::Builder coverage = root.initCoverage(1)[0];
+
+    // Coverage of a quarter of the world so that charts only partially
+    // cover a tile and several charts are opened for each one
+    const std::vector<Pos> positions { Pos(0, 0), Pos(0, 90), Pos(45, 90), Pos(45, 0), Pos(0, 0) };
+    Coordinates::fromPositions(coverage.initPolygons(1)[0].initMain(), positions);
+
+    Chart::write(&message, filename);
+    return Chart::open(filename);
+}
+}
+
+int main(int argc, char *argv[])
+{
+    const int chartsPerSide = argc > 1 ? std::stoi(argv[1]) : 60;
+    const int seconds = argc > 2 ? std::stoi(argv[2]) : 5;
+
+    const std::string filename = (std::filesystem::temp_directory_path() / ("tilefactory_benchmark" + Chart::fileExtension(Chart::Format::Packed))).string();
+    std::shared_ptr<Chart> chart = createChart(filename);
+
+    if (!chart) {
+        return 1;
+    }
+
+    std::vector<TileFactory::Source> sources;
+    std::mt19937 random(1);
+    std::uniform_int_distribution<int> scales(10000, 500000);
+
+    for (int row = 0; row < chartsPerSide; row++) {
+        for (int column = 0; column < chartsPerSide; column++) {
+            const double bottom = 50 + row * chartSize / 2;
+            const double left = 10 + column * chartSize / 2;
+            const GeoRect extent(bottom + chartSize, bottom, left, left + chartSize);
+            sources.push_back({ "chart" + std::to_string(sources.size()),
+                                std::make_shared<StaticTileSource>(extent, scales(random), chart) });
+        }
+    }
+
+    TileFactory tileFactory;
+    tileFactory.setSources(sources);
+
+    const double span = chartsPerSide * chartSize / 2;
+    std::atomic<bool> running = true;
+    std::atomic<size_t> calls = 0;
+    std::vector<std::chrono::nanoseconds> maxLatencies(readerCount);
+    std::vector<std::thread> readers;
+
+    for (int i = 0; i < readerCount; i++) {
+        readers.emplace_back([&, i] {
+            std::mt19937 random(i);
+            std::uniform_real_distribution<double> offset(0, span);
+
+            while (running) {
+                const double bottom = 50 + offset(random);
+                const double left = 10 + offset(random);
+                const GeoRect rect(bottom + 0.05, bottom, left, left + 0.05);
+
+                const auto start = std::chrono::steady_clock::now();
+                tileFactory.tileData(rect, 40000);
+                const auto elapsed = std::chrono::steady_clock::now() - start;
+
+                maxLatencies[i] = std::max<std::chrono::nanoseconds>(maxLatencies[i], elapsed);
+                calls++;
+            }
+        });
+    }
+
+    size_t toggles = 0;
+    std::uniform_int_distribution<size_t> sourceIndex(0, sources.size() - 1);
+    const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+
+    while (std::chrono::steady_clock::now() < end) {
+        const TileFactory::Source &source = sources[sourceIndex(random)];
+        tileFactory.setChartEnabled(source.name, toggles % 2 == 0);
+        toggles++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    running = false;
+    for (std::thread &reader : readers) {
+        reader.join();
+    }
+
+    std::remove(filename.c_str());
+
+    const auto maxLatency = *std::max_element(maxLatencies.begin(), maxLatencies.end());
+
+    std::cout << sources.size() << " charts, " << readerCount << " readers, "
+              << toggles << " toggles" << std::endl;
+    std::cout << "tileData: " << calls / seconds << " calls per second, max "
+              << std::chrono::duration_cast<std::chrono::microseconds>(maxLatency).count() << " us" << std::endl;
+
+    return 0;
+}
@@ -1,12 +1,25 @@
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <memory>
 #include <oesenc/chartfile.h>
 #include <oesenc/keylistreader.h>
 #include <oesenc/serverreader.h>
 #include <regex>
+#include <sstream>
+#include <thread>
 
+#include <capnp/message.h>
+#include <capnp/serialize-packed.h>
+#include <kj/io.h>
+
+#include "catalogindex.capnp.h"
+#include "filehelper.h"
+#include "layerindex.h"
+#include "streampool.h"
 #include "tilefactory/catalog.h"
 
 using namespace std;
@@ -80,19 +93,72 @@ Catalog::Type detectCatalogType(oesenc::ServerControl *serverControl, string_vie
 }
 
 Catalog::Catalog(oesenc::ServerControl *serverControl, string_view dir)
+    : Catalog(vector<oesenc::ServerControl *> { serverControl }, dir)
+{
+}
+
+Catalog::Catalog(const vector<oesenc::ServerControl *> &serverControls, string_view dir)
     : m_dir(dir)
-    , m_serverControl(serverControl)
 {
-    m_type = detectCatalogType(m_serverControl, dir);
+    vector<oesenc::ServerControl *> readyServers;
+    for (oesenc::ServerControl *serverControl : serverControls) {
+        if (serverControl != nullptr && serverControl->isReady()) {
+            readyServers.push_back(serverControl);
+        }
+    }
+
+    m_type = detectCatalogType(readyServers.empty() ? nullptr : readyServers.front(), dir);
 
     if (m_type == Type::Invalid) {
         return;
     }
 
-    if (serverControl != nullptr && serverControl->isReady()) {
+    if (!readyServers.empty()) {
         m_oesuKeys = oesenc::KeyListReader::readOesuKeys(dir);
         m_oesencKey = oesenc::KeyListReader::readOesencKey(dir);
     }
+
+    if (m_type != Type::Oesu && m_type != Type::Oesenc) {
+        return;
+    }
+
+    // One session per server, since a server serves one stream at a time
+    vector<Session> sessions;
+
+    for (oesenc::ServerControl *serverControl : readyServers) {
+        const string pipeName = serverControl->pipeName();
+
+        if (m_type == Type::Oesu) {
+            sessions.push_back([pipeName, keys = m_oesuKeys](const filesystem::path &file) -> shared_ptr<istream> {
+                auto key = keys.find(file.stem().string());
+                if (key == keys.end()) {
+                    return nullptr;
+                }
+                return oesenc::ServerReader::openOesu(pipeName, file.string(), key->second);
+            });
+        } else {
+            sessions.push_back([pipeName, key = m_oesencKey](const filesystem::path &file) -> shared_ptr<istream> {
+                return oesenc::ServerReader::openOesenc(pipeName, file.string(), key);
+            });
+        }
+    }
+
+    setSessions(std::move(sessions));
+}
+
+Catalog::~Catalog() = default;
+
+void Catalog::setSessions(vector<Session> sessions)
+{
+    m_streamPool = make_unique<StreamPool>(std::move(sessions));
+}
+
+size_t Catalog::maxConcurrentStreams() const
+{
+    if (m_streamPool) {
+        return std::max<size_t>(m_streamPool->size(), 1);
+    }
+    return std::max(thread::hardware_concurrency(), 1u);
 }
 
 Catalog::Type Catalog::type() const
@@ -119,29 +185,13 @@ vector<string> Catalog::chartFileNames() const
 
 std::shared_ptr<std::istream> Catalog::openChart(std::string_view fileName)
 {
-    // The user of this class should ensure that there is only one std::istream
-    // reading from the oexserverd process.
-    //
-    // The following expression asserts if that rule is broken
-    assert(m_currentStream.use_count() <= 1);
-
     filesystem::path filePath = m_dir / std::string(fileName);
-    string fileNameWithoutExtension = filePath.stem().string();
+
+    if (m_streamPool) {
+        return m_streamPool->open(filePath);
+    }
 
     switch (m_type) {
-    case Type::Oesu:
-        assert(m_serverControl);
-        if (m_oesuKeys.find(fileNameWithoutExtension) == m_oesuKeys.end()) {
-            return nullptr;
-        }
-        m_currentStream = oesenc::ServerReader::openOesu(m_serverControl->pipeName(),
-                                                         filePath.string(),
-                                                         m_oesuKeys[fileNameWithoutExtension]);
-        return m_currentStream;
-    case Type::Oesenc:
-        assert(m_serverControl);
-        m_currentStream = oesenc::ServerReader::openOesenc(m_serverControl->pipeName(), filePath.string(), m_oesencKey);
-        return m_currentStream;
     case Type::Unencrypted:
         return make_shared<ifstream>(filePath, std::ios::binary);
     default:
@@ -150,3 +200,194 @@ std::shared_ptr<std::istream> Catalog::openChart(std::string_view fileName)
 
     return nullptr;
 }
+
+bool Catalog::readHeader(ChartHeader &header)
+{
+    shared_ptr<istream> stream = openChart(header.fileName);
+
+    if (!stream) {
+        return false;
+    }
+
+    oesenc::ChartFile chart(*stream);
+
+    if (!chart.readHeaders()) {
+        return false;
+    }
+
+    const oesenc::Rect &extent = chart.extent();
+    header.scale = chart.nativeScale();
+    header.extent = GeoRect(extent.top(), extent.bottom(), extent.left(), extent.right());
+    return true;
+}
+
+vector<Catalog::ChartHeader> Catalog::readHeaders(vector<ChartHeader> headers, const Progress &progress)
+{
+    atomic<size_t> next = 0;
+    atomic<size_t> done = 0;
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < headers.size() && !m_cancelled; i = next++) {
+            headers[i].valid = readHeader(headers[i]);
+
+            if (progress) {
+                progress(++done, headers.size());
+            }
+        }
+    };
+
+    const size_t workerCount = std::clamp<size_t>(maxConcurrentStreams(), 1, headers.size());
+
+    vector<thread> workers;
+    for (size_t i = 1; i < workerCount; i++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+
+    for (thread &workerThread : workers) {
+        workerThread.join();
+    }
+
+    return headers;
+}
+
+string Catalog::indexFileName(string_view indexDir) const
+{
+    stringstream ss;
+    ss << hex << std::hash<string>()(m_dir.string()) << ".bin";
+    return (filesystem::path(FileHelper::getTileDir(string(indexDir), CatalogIndex::_capnpPrivate::typeId)) / ss.str()).string();
+}
+
+vector<Catalog::ChartHeader> Catalog::loadIndex(const string &fileName)
+{
+    vector<ChartHeader> headers;
+    ifstream file(fileName, ios::binary);
+
+    if (!file) {
+        return headers;
+    }
+
+    const string data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+    try {
+        kj::ArrayInputStream input(kj::arrayPtr(reinterpret_cast<const kj::byte *>(data.data()), data.size()));
+        capnp::PackedMessageReader message(input);
+        CatalogIndex::Reader index = message.getRoot<CatalogIndex>();
+
+        for (const CatalogIndex::Chart::Reader &chart : index.getCharts()) {
+            ChartHeader header;
+            header.fileName = chart.getFileName();
+            header.fileSize = chart.getFileSize();
+            header.modified = chart.getModified();
+            header.valid = chart.getValid();
+            header.scale = chart.getScale();
+            header.extent = LayerIndex::toGeoRect(chart.getExtent());
+            headers.push_back(header);
+        }
+    } catch (const kj::Exception &exception) {
+        cerr << "Ignoring unreadable catalog index " << fileName << ": "
+             << exception.getDescription().cStr() << endl;
+        return {};
+    }
+
+    return headers;
+}
+
+void Catalog::saveIndex(const string &fileName, const vector<ChartHeader> &headers)
+{
+    capnp::MallocMessageBuilder message;
+    CatalogIndex::Builder index = message.initRoot<CatalogIndex>();
+    auto charts = index.initCharts(static_cast<unsigned int>(headers.size()));
+
+    for (unsigned int i = 0; i < headers.size(); i++) {
+        const ChartHeader &header = headers[i];
+        CatalogIndex::Chart::Builder chart = charts[i];
+        chart.setFileName(header.fileName);
+        chart.setFileSize(header.fileSize);
+        chart.setModified(header.modified);
+        chart.setValid(header.valid);
+        chart.setScale(header.scale);
+        LayerIndex::fromGeoRect(chart.initExtent(), header.extent);
+    }
+
+    Chart::write(&message, fileName);
+}
+
+vector<Catalog::ChartHeader> Catalog::chartHeaders(string_view indexDir, Progress progress)
+{
+    if (m_cancelled) {
+        return {};
+    }
+
+    const string indexFile = indexFileName(indexDir);
+
+    unordered_map<string, ChartHeader> indexed;
+    for (ChartHeader &header : loadIndex(indexFile)) {
+        indexed[header.fileName] = std::move(header);
+    }
+
+    vector<string> fileNames = chartFileNames();
+    sort(fileNames.begin(), fileNames.end());
+
+    vector<ChartHeader> headers;
+    vector<ChartHeader> changed;
+
+    for (const string &fileName : fileNames) {
+        const filesystem::path filePath = m_dir / fileName;
+        error_code errorCode;
+
+        ChartHeader header;
+        header.fileName = fileName;
+        header.fileSize = filesystem::file_size(filePath, errorCode);
+        header.modified = filesystem::last_write_time(filePath, errorCode).time_since_epoch().count();
+
+        auto it = indexed.find(fileName);
+
+        // Charts that failed to read are tried again, since that may be due
+        // to the server rather than the file
+        if (it != indexed.end()
+            && it->second.valid
+            && it->second.fileSize == header.fileSize
+            && it->second.modified == header.modified) {
+            headers.push_back(it->second);
+        } else {
+            changed.push_back(header);
+        }
+    }
+
+    if (progress) {
+        progress(headers.size(), fileNames.size());
+    }
+
+    const size_t indexedCount = headers.size();
+
+    if (!changed.empty()) {
+        for (ChartHeader &header : readHeaders(std::move(changed), [&](size_t done, size_t) {
+                 if (progress) {
+                     progress(indexedCount + done, fileNames.size());
+                 }
+             })) {
+            headers.push_back(std::move(header));
+        }
+
+        sort(headers.begin(), headers.end(), [](const ChartHeader &a, const ChartHeader &b) {
+            return a.fileName < b.fileName;
+        });
+    }
+
+    // Charts not read before the cancellation would be missing
+    if (m_cancelled) {
+        return {};
+    }
+
+    if (indexedCount != headers.size() || indexed.size() != headers.size()) {
+        saveIndex(indexFile, headers);
+    }
+
+    return headers;
+}
+
+void Catalog::cancelChartHeaders()
+{
+    m_cancelled = true;
+}
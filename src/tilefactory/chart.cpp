@@ -1,13 +1,35 @@
+#include <algorithm>
 #include <chrono>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <span>
 #include <thread>
 
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <capnp/serialize.h>
+
 #include "cutlines/cutlines.h"
+#include "edgegraph.h"
+#include "layerindex.h"
 #include "tilefactory/chart.h"
+#include "tilefactory/coordinates.h"
 #include "tilefactory/georect.h"
+#include "tilefactory/linesimplifier.h"
 #include "tilefactory/mercator.h"
 #include "tilefactory/triangulator.h"
+#include "workerpool.h"
 
 namespace {
+constexpr size_t prefetchLimitInBytes = 4 * 1024 * 1024;
 
 template <typename T>
 void copyLinesToBuilder(typename T::Builder dst, const std::vector<cutlines::Line> &lines)
@@ -17,13 +39,12 @@ void copyLinesToBuilder(typename T::Builder dst, const std::vector<cutlines::Lin
     int i = 0;
     for (const cutlines::Line &line : lines) {
         ChartData::Line::Builder lineBuilder = dstLines[i++];
-        capnp::List<ChartData::Position>::Builder positions = lineBuilder.initPositions(static_cast<unsigned int>(line.size()));
-        int i = 0;
+        std::vector<Pos> positions;
+        positions.reserve(line.size());
         for (const cutlines::Point &pos : line) {
-            ChartData::Position::Builder dstPos = positions[i++];
-            dstPos.setLatitude(pos[1]);
-            dstPos.setLongitude(pos[0]);
+            positions.push_back(Pos(pos[1], pos[0]));
         }
+        Coordinates::fromPositions(lineBuilder.initPositions(), positions);
     }
 }
 
@@ -37,34 +58,13 @@ struct ClippedItem
 
 using Polygon = std::vector<Pos>;
 
-void toCapnPolygon(capnp::List<ChartData::Position>::Builder dst, const Polygon &src)
-{
-    int positionIndex = 0;
-    for (const Pos &pos : src) {
-        auto dstPos = dst[positionIndex++];
-        dstPos.setLatitude(pos.lat());
-        dstPos.setLongitude(pos.lon());
-    }
-}
-
-void toCapnPolygons(::capnp::List<capnp::List<ChartData::Position>>::Builder dst,
+void toCapnPolygons(::capnp::List<ChartData::Path>::Builder dst,
                     const std::vector<Polygon> &src)
 {
-    int polygonIndex = 0;
+    unsigned int polygonIndex = 0;
 
     for (const Polygon &srcPolygon : src) {
-        dst.init(polygonIndex, (unsigned int)srcPolygon.size());
-        auto dstPositions = dst[polygonIndex];
-
-        int positionIndex = 0;
-        for (const Pos &pos : srcPolygon) {
-            auto dstPos = dstPositions[positionIndex];
-            dstPos.setLatitude(pos.lat());
-            dstPos.setLongitude(pos.lon());
-            positionIndex++;
-        }
-
-        polygonIndex++;
+        Coordinates::fromPositions(dst[polygonIndex++], srcPolygon);
     }
 }
 
@@ -76,8 +76,7 @@ void copyPolygonsToBuilder(typename T::Builder dst, const std::vector<ChartClipp
     int polygonIndex = 0;
     for (const ChartClipper::Polygon &polygon : src) {
         ChartData::Polygon::Builder dstPolygon = dstPolygons[polygonIndex++];
-        auto main = dstPolygon.initMain(static_cast<unsigned int>(polygon.main.size()));
-        toCapnPolygon(main, polygon.main);
+        Coordinates::fromPositions(dstPolygon.initMain(), polygon.main);
         auto holes = dstPolygon.initHoles(static_cast<unsigned int>(polygon.holes.size()));
         toCapnPolygons(holes, polygon.holes);
     }
@@ -96,45 +95,80 @@ std::vector<ChartClipper::Polygon> clipPolygons(const capnp::List<ChartData::Pol
     return clipped;
 }
 
-template <typename T>
-void clipPolygonItems(const typename capnp::List<T>::Reader &src,
-                      ChartClipper::Config config,
-                      std::function<typename capnp::List<T>::Builder(unsigned int length)> init,
-                      std::function<void(typename T::Builder &, const typename T::Reader &)> copyFunction)
+GeoRect marginBox(const ChartClipper::Config &config)
 {
-    std::vector<ClippedItem<T>> clippedItems;
+    return GeoRect(config.box.top() + config.latitudeMargin,
+                   config.box.bottom() - config.latitudeMargin,
+                   config.box.left() - config.longitudeMargin,
+                   config.box.right() + config.longitudeMargin);
+}
 
-    for (const typename T::Reader &element : src) {
-        std::vector<ChartClipper::Polygon> polygons = clipPolygons(element.getPolygons(), config);
+std::vector<uint32_t> allItems(unsigned int size)
+{
+    std::vector<uint32_t> all(size);
+    for (uint32_t i = 0; i < size; i++) {
+        all[i] = i;
+    }
+    return all;
+}
 
-        if (!polygons.empty()) {
-            clippedItems.push_back({ polygons, {}, element });
-        }
+/*!
+    Returns the indexes of the layer items that may intersect rect. All items
+    are returned for charts written before the layer index was introduced.
+*/
+std::vector<uint32_t> candidateItems(unsigned int size,
+                                     bool hasIndex,
+                                     const ChartData::GridIndex::Reader &index,
+                                     const GeoRect &rect)
+{
+    if (hasIndex) {
+        return LayerIndex::query(index, rect);
     }
 
-    typename capnp::List<T>::Builder list = init(static_cast<unsigned int>(clippedItems.size()));
+    return allItems(size);
+}
 
-    int i = 0;
+/*!
+    Returns the indexes of the point items that may be inside rect. All items
+    are returned for charts whose point layers are not sorted by key.
+*/
+std::vector<uint32_t> candidatePoints(unsigned int size,
+                                      bool hasIndex,
+                                      const ChartData::PointIndex::Reader &index,
+                                      const GeoRect &rect)
+{
+    if (hasIndex) {
+        return LayerIndex::queryPoints(index, rect);
+    }
 
-    for (const ClippedItem<T> &item : clippedItems) {
-        typename T::Builder builder = list[i++];
-        if (copyFunction) {
-            copyFunction(builder, item.sourceItem);
-        }
-        copyPolygonsToBuilder<T>(builder, item.polygons);
+    return allItems(size);
+}
+
+template <typename T>
+bool mayIntersect(const typename T::Reader &element, const GeoRect &rect)
+{
+    if (!element.hasBoundingBox()) {
+        return true;
     }
+
+    return LayerIndex::toGeoRect(element.getBoundingBox()).intersects(rect);
 }
 
 std::vector<cutlines::Line> clipLines(const capnp::List<ChartData::Line>::Reader &lines,
-                                      const cutlines::Rect &clipRect)
+                                      const cutlines::Rect &clipRect,
+                                      double epsilon)
 {
     std::vector<cutlines::Line> clipped;
 
     for (const ChartData::Line::Reader &line : lines) {
         cutlines::Line dstLine;
 
-        for (const ChartData::Position::Reader &pos : line.getPositions()) {
-            dstLine.push_back({ pos.getLongitude(), pos.getLatitude() });
+        for (const Pos &pos : Coordinates::Path(line.getPositions(), epsilon)) {
+            dstLine.push_back({ pos.lon(), pos.lat() });
+        }
+
+        if (dstLine.size() < 2) {
+            continue;
         }
 
         std::vector<cutlines::Line> clippedLines = cutlines::clip(dstLine, clipRect);
@@ -144,7 +178,7 @@ std::vector<cutlines::Line> clipLines(const capnp::List<ChartData::Line>::Reader
     return clipped;
 }
 
-cutlines::Rect toCutlinesRect(const GeoRect &rect, ChartClipper::Config &config)
+cutlines::Rect toCutlinesRect(const GeoRect &rect, const ChartClipper::Config &config)
 {
     return cutlines::Rect { rect.left() - config.longitudeMargin,
                             rect.right() + config.longitudeMargin,
@@ -152,66 +186,95 @@ cutlines::Rect toCutlinesRect(const GeoRect &rect, ChartClipper::Config &config)
                             rect.top() + config.latitudeMargin };
 }
 
+// Clipped items of one layer for each tile
+template <typename Item>
+using ClippedTiles = std::vector<std::vector<Item>>;
+
 template <typename T>
-void clipLineItems(const typename capnp::List<T>::Reader &src,
-                   ChartClipper::Config config,
-                   std::function<typename capnp::List<T>::Builder(unsigned int length)> init,
-                   std::function<void(typename T::Builder &, const typename T::Reader &)> copyFunction)
+ClippedTiles<ClippedItem<T>> clipPolygonItems(const typename capnp::List<T>::Reader &src,
+                                              std::span<const uint32_t> candidates,
+                                              const std::vector<ChartClipper::Config> &configs)
 {
-    std::vector<ClippedItem<T>> clippedItems;
+    ClippedTiles<ClippedItem<T>> clippedItems(configs.size());
 
-    for (const typename T::Reader &element : src) {
-        std::vector<cutlines::Line> lines = clipLines(element.getLines(),
-                                                      toCutlinesRect(config.box, config));
+    for (uint32_t index : candidates) {
+        const typename T::Reader element = src[index];
+
+        for (size_t tile = 0; tile < configs.size(); tile++) {
+            if (!mayIntersect<T>(element, marginBox(configs[tile]))) {
+                continue;
+            }
+
+            std::vector<ChartClipper::Polygon> polygons = clipPolygons(element.getPolygons(), configs[tile]);
 
-        if (!lines.empty()) {
-            clippedItems.push_back({ {}, lines, element });
+            if (!polygons.empty()) {
+                clippedItems[tile].push_back({ polygons, {}, element });
+            }
         }
     }
 
-    typename capnp::List<T>::Builder list = init(static_cast<unsigned int>(clippedItems.size()));
+    return clippedItems;
+}
+
+template <typename T>
+ClippedTiles<ClippedItem<T>> clipLineItems(const typename capnp::List<T>::Reader &src,
+                                           std::span<const uint32_t> candidates,
+                                           const std::vector<ChartClipper::Config> &configs)
+{
+    ClippedTiles<ClippedItem<T>> clippedItems(configs.size());
 
-    int i = 0;
+    for (uint32_t index : candidates) {
+        const typename T::Reader element = src[index];
 
-    for (const ClippedItem<T> &item : clippedItems) {
-        typename T::Builder builder = list[i++];
-        if (copyFunction) {
-            copyFunction(builder, item.sourceItem);
+        for (size_t tile = 0; tile < configs.size(); tile++) {
+            const ChartClipper::Config &config = configs[tile];
+
+            if (!mayIntersect<T>(element, marginBox(config))) {
+                continue;
+            }
+
+            std::vector<cutlines::Line> lines = clipLines(element.getLines(),
+                                                          toCutlinesRect(config.box, config),
+                                                          config.lineEpsilon);
+
+            if (!lines.empty()) {
+                clippedItems[tile].push_back({ {}, lines, element });
+            }
         }
-        copyLinesToBuilder<T>(builder, item.lines);
     }
+
+    return clippedItems;
 }
 
 template <typename T>
-void clipPolygonOrLineItems(const typename capnp::List<T>::Reader &src,
-                            ChartClipper::Config config,
-                            std::function<typename capnp::List<T>::Builder(unsigned int length)> init,
-                            std::function<void(typename T::Builder &, const typename T::Reader &)> copyFunction)
+ClippedTiles<ClippedItem<T>> clipPolygonOrLineItems(const typename capnp::List<T>::Reader &src,
+                                                    std::span<const uint32_t> candidates,
+                                                    const std::vector<ChartClipper::Config> &configs)
 {
-    std::vector<ClippedItem<T>> clippedItems;
+    ClippedTiles<ClippedItem<T>> clippedItems(configs.size());
 
-    for (const typename T::Reader &element : src) {
-        std::vector<ChartClipper::Polygon> polygons = clipPolygons(element.getPolygons(), config);
-        std::vector<cutlines::Line> lines = clipLines(element.getLines(),
-                                                      toCutlinesRect(config.box, config));
+    for (uint32_t index : candidates) {
+        const typename T::Reader element = src[index];
 
-        if (!polygons.empty() || !lines.empty()) {
-            clippedItems.push_back({ polygons, lines, element });
-        }
-    }
+        for (size_t tile = 0; tile < configs.size(); tile++) {
+            const ChartClipper::Config &config = configs[tile];
 
-    typename capnp::List<T>::Builder list = init(static_cast<unsigned int>(clippedItems.size()));
+            if (!mayIntersect<T>(element, marginBox(config))) {
+                continue;
+            }
 
-    int i = 0;
+            std::vector<ChartClipper::Polygon> polygons = clipPolygons(element.getPolygons(), config);
+            std::vector<cutlines::Line> lines = clipLines(element.getLines(),
+                                                          toCutlinesRect(config.box, config),
+                                                          config.lineEpsilon);
 
-    for (const ClippedItem<T> &item : clippedItems) {
-        typename T::Builder builder = list[i++];
-        if (copyFunction) {
-            copyFunction(builder, item.sourceItem);
+            if (!polygons.empty() || !lines.empty()) {
+                clippedItems[tile].push_back({ polygons, lines, element });
+            }
         }
-        copyPolygonsToBuilder<T>(builder, item.polygons);
-        copyLinesToBuilder<T>(builder, item.lines);
     }
+
+    return clippedItems;
 }
 
 template <typename T>
@@ -222,31 +285,155 @@ struct ClippedPointItem
 };
 
 template <typename T>
-void clipPointItems(const typename capnp::List<T>::Reader &src,
-                    ChartClipper::Config config,
-                    std::function<typename capnp::List<T>::Builder(unsigned int length)> init,
-                    std::function<void(typename T::Builder &, const typename T::Reader &)> copyFunction)
+ClippedTiles<ClippedPointItem<T>> clipPointItems(const typename capnp::List<T>::Reader &src,
+                                                 std::span<const uint32_t> candidates,
+                                                 const std::vector<ChartClipper::Config> &configs)
+{
+    ClippedTiles<ClippedPointItem<T>> clipped(configs.size());
+
+    for (uint32_t index : candidates) {
+        const typename T::Reader element = src[index];
+        const Pos pos = Coordinates::toPos(element.getPosition());
+
+        for (size_t tile = 0; tile < configs.size(); tile++) {
+            if (configs[tile].box.contains(pos.lat(), pos.lon())) {
+                clipped[tile].push_back(ClippedPointItem<T> { pos, element });
+            }
+        }
+    }
+
+    return clipped;
+}
+
+/*!
+    Clipped items of one layer, clipped in independent ranges of the
+    candidate items. The ranges are concatenated in order when written, so
+    the output is the same as when the layer is clipped in one go.
+*/
+template <typename Item>
+struct ClippedLayer
 {
-    std::vector<ClippedPointItem<T>> clipped;
+    std::vector<uint32_t> candidates;
+    std::vector<ClippedTiles<Item>> ranges;
+};
 
-    for (const auto &element : src) {
-        const Pos pos(element.getPosition().getLatitude(), element.getPosition().getLongitude());
-        if (config.box.contains(pos.lat(), pos.lon())) {
-            clipped.push_back(ClippedPointItem<T> { pos, element });
+/*!
+    Clips the layers of a chart concurrently
+
+    Every layer is split into ranges of candidate items that are clipped as
+    independent jobs on the shared worker pool, so that one expensive polygon
+    layer is spread over all cores. Clipping only reads the source chart. The
+    results are written to the messages on the calling thread afterwards,
+    since a message builder must not be used from several threads.
+*/
+class ClipJobs
+{
+public:
+    template <typename Item, typename ClipFunction>
+    void add(ClippedLayer<Item> &layer, size_t rangeSize, ClipFunction clip)
+    {
+        const size_t rangeCount = (layer.candidates.size() + rangeSize - 1) / rangeSize;
+        layer.ranges.resize(rangeCount);
+
+        for (size_t range = 0; range < rangeCount; range++) {
+            m_jobs.push_back([&layer, range, rangeSize, clip]() {
+                const size_t first = range * rangeSize;
+                const size_t count = std::min(rangeSize, layer.candidates.size() - first);
+                layer.ranges[range] = clip(std::span<const uint32_t>(layer.candidates).subspan(first, count));
+            });
         }
     }
 
-    auto dst = init(static_cast<unsigned int>(clipped.size()));
+    void run()
+    {
+        WorkerPool::instance().forEach(m_jobs.size(), [this](size_t job) {
+            m_jobs[job]();
+        });
+    }
 
-    int i = 0;
-    for (const auto &item : clipped) {
-        auto element = dst[i++];
-        element.getPosition().setLatitude(item.pos.lat());
-        element.getPosition().setLongitude(item.pos.lon());
-        copyFunction(element, item.item);
+private:
+    std::vector<std::function<void()>> m_jobs;
+};
+
+template <typename T, typename Item>
+void writeClippedLayer(const ClippedLayer<Item> &layer,
+                       size_t tileCount,
+                       std::function<typename capnp::List<T>::Builder(size_t tile, unsigned int length)> init,
+                       std::function<void(typename T::Builder &, const Item &)> write)
+{
+    for (size_t tile = 0; tile < tileCount; tile++) {
+        size_t length = 0;
+        for (const ClippedTiles<Item> &range : layer.ranges) {
+            length += range[tile].size();
+        }
+
+        typename capnp::List<T>::Builder list = init(tile, static_cast<unsigned int>(length));
+
+        unsigned int i = 0;
+        for (const ClippedTiles<Item> &range : layer.ranges) {
+            for (const Item &item : range[tile]) {
+                typename T::Builder builder = list[i++];
+                write(builder, item);
+            }
+        }
     }
 }
 
+template <typename T>
+void writePolygonItems(const ClippedLayer<ClippedItem<T>> &layer,
+                       size_t tileCount,
+                       std::function<typename capnp::List<T>::Builder(size_t tile, unsigned int length)> init,
+                       std::function<void(typename T::Builder &, const typename T::Reader &)> copyFunction)
+{
+    writeClippedLayer<T, ClippedItem<T>>(layer, tileCount, init, [&copyFunction](typename T::Builder &builder, const ClippedItem<T> &item) {
+        if (copyFunction) {
+            copyFunction(builder, item.sourceItem);
+        }
+        copyPolygonsToBuilder<T>(builder, item.polygons);
+    });
+}
+
+template <typename T>
+void writeLineItems(const ClippedLayer<ClippedItem<T>> &layer,
+                    size_t tileCount,
+                    std::function<typename capnp::List<T>::Builder(size_t tile, unsigned int length)> init,
+                    std::function<void(typename T::Builder &, const typename T::Reader &)> copyFunction)
+{
+    writeClippedLayer<T, ClippedItem<T>>(layer, tileCount, init, [&copyFunction](typename T::Builder &builder, const ClippedItem<T> &item) {
+        if (copyFunction) {
+            copyFunction(builder, item.sourceItem);
+        }
+        copyLinesToBuilder<T>(builder, item.lines);
+    });
+}
+
+template <typename T>
+void writePolygonOrLineItems(const ClippedLayer<ClippedItem<T>> &layer,
+                             size_t tileCount,
+                             std::function<typename capnp::List<T>::Builder(size_t tile, unsigned int length)> init,
+                             std::function<void(typename T::Builder &, const typename T::Reader &)> copyFunction)
+{
+    writeClippedLayer<T, ClippedItem<T>>(layer, tileCount, init, [&copyFunction](typename T::Builder &builder, const ClippedItem<T> &item) {
+        if (copyFunction) {
+            copyFunction(builder, item.sourceItem);
+        }
+        copyPolygonsToBuilder<T>(builder, item.polygons);
+        copyLinesToBuilder<T>(builder, item.lines);
+    });
+}
+
+template <typename T>
+void writePointItems(const ClippedLayer<ClippedPointItem<T>> &layer,
+                     size_t tileCount,
+                     std::function<typename capnp::List<T>::Builder(size_t tile, unsigned int length)> init,
+                     std::function<void(typename T::Builder &, const typename T::Reader &)> copyFunction)
+{
+    writeClippedLayer<T, ClippedPointItem<T>>(layer, tileCount, init, [&copyFunction](typename T::Builder &builder, const ClippedPointItem<T> &item) {
+        Coordinates::fromPos(builder.getPosition(), item.pos);
+        copyFunction(builder, item.item);
+    });
+}
+
 template <typename T>
 void computeCentroidFromPolygons(typename T::Builder builder)
 {
@@ -259,27 +446,30 @@ void computeCentroidFromPolygons(typename T::Builder builder)
     int nPositions = 0;
 
     for (ChartData::Polygon::Builder polygon : builder.getPolygons()) {
-        for (ChartData::Position::Builder pos : polygon.getMain()) {
-            avgLat += pos.getLatitude();
-            avgLon += pos.getLongitude();
+        for (const Pos &pos : Coordinates::Path(polygon.getMain().asReader())) {
+            avgLat += pos.lat();
+            avgLon += pos.lon();
             nPositions++;
         }
     }
 
-    ChartData::Position::Builder centroid = builder.getCentroid();
-    centroid.setLatitude(avgLat / nPositions);
-    centroid.setLongitude(avgLon / nPositions);
+    if (nPositions == 0) {
+        return;
+    }
+
+    Coordinates::fromPos(builder.getCentroid(), avgLat / nPositions, avgLon / nPositions);
 }
 
-void fromOesencPosToCapnp(capnp::List<ChartData::Position>::Builder &dst,
-                          const std::vector<oesenc::Position> &src)
+template <typename T>
+void fromOesencPosToCapnp(ChartData::Path::Builder dst, const T &src)
 {
-    int i = 0;
+    std::vector<Pos> positions;
+    positions.reserve(src.size());
     for (const oesenc::Position &pos : src) {
-        auto dstPos = dst[i++];
-        dstPos.setLatitude(pos.latitude());
-        dstPos.setLongitude(pos.longitude());
+        positions.push_back(Pos(pos.latitude(), pos.longitude()));
     }
+
+    Coordinates::fromPositions(dst, positions);
 }
 
 template <typename T>
@@ -292,19 +482,16 @@ void loadPolygonsFromS57(typename T::Builder dst, const oesenc::S57 *s57)
     capnp::List<ChartData::Polygon>::Builder polygons = dst.initPolygons(1);
     int polygonIndex = 0;
 
-    capnp::List<capnp::List<ChartData::Position>>::Builder holes;
+    capnp::List<ChartData::Path>::Builder holes;
     if (s57->polygons().size() > 1) {
         holes = polygons[0].initHoles(static_cast<unsigned int>(s57->polygons().size() - 1));
     }
 
     for (const std::vector<oesenc::Position> &srcPolygon : s57->polygons()) {
         if (polygonIndex == 0) {
-            capnp::List<ChartData::Position>::Builder main = polygons[0].initMain(static_cast<unsigned int>(srcPolygon.size()));
-            fromOesencPosToCapnp(main, srcPolygon);
+            fromOesencPosToCapnp(polygons[0].initMain(), srcPolygon);
         } else {
-            auto hole = holes.init(polygonIndex - 1,
-                                   static_cast<unsigned int>(srcPolygon.size()));
-            fromOesencPosToCapnp(hole, srcPolygon);
+            fromOesencPosToCapnp(holes[polygonIndex - 1], srcPolygon);
         }
 
         polygonIndex++;
@@ -320,34 +507,19 @@ void loadLinesFromS57(typename T::Builder dst, const oesenc::S57 *s57)
     int i = 0;
     for (const oesenc::S57::MultiGeometry &line : srcLines) {
         ChartData::Line::Builder dstLine = dstLines[i++];
-        capnp::List<ChartData::Position>::Builder dstPositions = dstLine.initPositions(static_cast<unsigned int>(line.size()));
-
-        int j = 0;
-        for (const oesenc::Position &position : line) {
-            ChartData::Position::Builder dstPos = dstPositions[j++];
-            dstPos.setLatitude(position.latitude());
-            dstPos.setLongitude(position.longitude());
-        }
+        fromOesencPosToCapnp(dstLine.initPositions(), line);
     }
 }
 
-using S57Vector = const std::vector<const oesenc::S57 *>;
-
-void loadLandAreas(ChartData::Builder &root, const S57Vector &src)
+void loadLandArea(ChartData::LandArea::Builder dst, const oesenc::S57 *s57)
 {
-    auto landAreas = root.initLandAreas(static_cast<unsigned int>(src.size()));
-
-    unsigned int i = 0;
-    for (const oesenc::S57 *s57 : src) {
-        auto dstElement = landAreas[i++];
-        auto name = s57->attribute<std::string>(oesenc::S57::Attribute::ObjectName);
-        if (name.has_value()) {
-            dstElement.setName(name.value());
-        }
-
-        loadPolygonsFromS57<ChartData::LandArea>(dstElement, s57);
-        computeCentroidFromPolygons<ChartData::LandArea>(dstElement);
+    auto name = s57->attribute<std::string>(oesenc::S57::Attribute::ObjectName);
+    if (name.has_value()) {
+        dst.setName(name.value());
     }
+
+    loadPolygonsFromS57<ChartData::LandArea>(dst, s57);
+    computeCentroidFromPolygons<ChartData::LandArea>(dst);
 }
 
 bool isPolygonObject(const oesenc::S57 *obj)
@@ -360,518 +532,778 @@ bool isPointObject(const oesenc::S57 *obj)
     return obj->pointGeometry().has_value();
 }
 
-int countPolygonObjects(S57Vector &s57s)
+void loadBuiltUpArea(ChartData::BuiltUpArea::Builder dst, const oesenc::S57 *s57)
 {
-    int n = 0;
-    for (const auto &obj : s57s) {
-        if (isPolygonObject(obj)) {
-            n++;
-        }
+    auto name = s57->attribute<std::string>(oesenc::S57::Attribute::ObjectName);
+    if (name.has_value()) {
+        dst.setName(name.value());
     }
-    return n;
+
+    loadPolygonsFromS57<ChartData::BuiltUpArea>(dst, s57);
+    computeCentroidFromPolygons<ChartData::BuiltUpArea>(dst);
 }
 
-int countPointObjects(S57Vector &s57s)
+void loadBuiltUpPoint(ChartData::BuiltUpPoint::Builder dst, const oesenc::S57 *s57)
 {
-    int n = 0;
-    for (const auto &obj : s57s) {
-        if (isPointObject(obj)) {
-            n++;
-        }
+    auto name = s57->attribute<std::string>(oesenc::S57::Attribute::ObjectName);
+    auto point = s57->pointGeometry();
+    if (point.has_value() && name.has_value()) {
+        dst.setName(name.value());
+        Coordinates::fromPos(dst.getPosition(), point->latitude(), point->longitude());
     }
-    return n;
 }
 
-void loadBuiltUpAreas(ChartData::Builder &root, const S57Vector &src)
+bool isCoverage(const oesenc::S57 *s57)
 {
+    auto categoryOfCoverage = s57->attribute<uint32_t>(oesenc::S57::Attribute::CategoryOfCoverage);
+    return categoryOfCoverage.has_value() && categoryOfCoverage.value() == 1;
+}
 
-    // Built-Up areas actaully have either polygons OR points. Those two variants
-    // are handled independently below.
+void loadDepthArea(ChartData::DepthArea::Builder dst, const oesenc::S57 *s57)
+{
+    // Should read both limits here
+    auto depth = s57->attribute<float>(oesenc::S57::Attribute::DepthValue1);
+    if (depth.has_value()) {
+        dst.setDepth(depth.value());
+    }
 
-    int n = countPolygonObjects(src);
-    if (n > 0) {
-        auto dst = root.initBuiltUpAreas(static_cast<unsigned int>(n));
-        unsigned int i = 0;
-        for (const auto &obj : src) {
-            if (!isPolygonObject(obj)) {
-                continue;
-            }
-            auto dstElement = dst[i++];
-            auto name = obj->attribute<std::string>(oesenc::S57::Attribute::ObjectName);
-            if (name.has_value()) {
-                dstElement.setName(name.value());
-            }
+    loadPolygonsFromS57<ChartData::DepthArea>(dst, s57);
+}
 
-            loadPolygonsFromS57<ChartData::BuiltUpArea>(dstElement, obj);
-            computeCentroidFromPolygons<ChartData::BuiltUpArea>(dstElement);
-        }
+void loadLandRegion(ChartData::LandRegion::Builder dst, const oesenc::S57 *s57)
+{
+    auto name = s57->attribute<std::string>(oesenc::S57::Attribute::ObjectName);
+    auto point = s57->pointGeometry();
+
+    if (point.has_value() && name.has_value()) {
+        dst.setName(name.value());
+        Coordinates::fromPos(dst.getPosition(), point->latitude(), point->longitude());
     }
+}
 
-    n = countPointObjects(src);
-    if (n > 0) {
-        auto dst = root.initBuiltUpPoints(static_cast<unsigned int>(n));
-        unsigned int i = 0;
-        for (const auto &obj : src) {
-            if (!isPointObject(obj)) {
-                continue;
-            }
-            auto dstElement = dst[i++];
-            auto name = obj->attribute<std::string>(oesenc::S57::Attribute::ObjectName);
-            auto point = obj->pointGeometry();
-            if (point.has_value() && name.has_value()) {
-                dstElement.setName(name.value());
-                auto pos = dstElement.getPosition();
-                pos.setLatitude(point.value().latitude());
-                pos.setLongitude(point.value().longitude());
-            }
+void loadBeacon(ChartData::Beacon::Builder dst, const oesenc::S57 *s57)
+{
+    auto name = s57->attribute<std::string>(oesenc::S57::Attribute::ObjectName);
+    auto shape = s57->attribute<uint32_t>(oesenc::S57::Attribute::BeaconShape);
+    auto position = s57->pointGeometry();
+
+    if (position.has_value() && name.has_value() && shape.has_value()) {
+        Coordinates::fromPos(dst.getPosition(), position->latitude(), position->longitude());
+        dst.setName(name.value());
+        switch (shape.value()) {
+        case 1:
+            dst.setShape(ChartData::BeaconShape::STAKE);
+            break;
+        case 2:
+            dst.setShape(ChartData::BeaconShape::WITHY);
+            break;
+        case 3:
+            dst.setShape(ChartData::BeaconShape::BEACON_TOWER);
+            break;
+        case 4:
+            dst.setShape(ChartData::BeaconShape::LATTICE_BEACON);
+            break;
+        case 5:
+            dst.setShape(ChartData::BeaconShape::PILE_BEACON);
+            break;
+        case 6:
+            dst.setShape(ChartData::BeaconShape::CAIRN);
+            break;
+        case 7:
+            dst.setShape(ChartData::BeaconShape::BOYANT);
+            break;
         }
     }
 }
 
-void loadCoastLines(ChartData::Builder &root, const S57Vector &src)
+void loadUnderwaterRock(ChartData::UnderwaterRock::Builder dst, const oesenc::S57 *s57)
 {
-    auto coastLines = root.initCoastLines(static_cast<unsigned int>(src.size()));
-
-    int i = 0;
-    for (const oesenc::S57 *s57 : src) {
-        loadLinesFromS57<ChartData::CoastLine>(coastLines[i++], s57);
+    auto waterLevelEffect = s57->attribute<uint32_t>(oesenc::S57::Attribute::WaterLevelEffect);
+    auto valueOfSounding = s57->attribute<float>(oesenc::S57::Attribute::ValueOfSounding);
+    auto position = s57->pointGeometry();
+
+    if (waterLevelEffect.has_value() && valueOfSounding.has_value() && position.has_value()) {
+        Coordinates::fromPos(dst.getPosition(), position->latitude(), position->longitude());
+        dst.setDepth(valueOfSounding.value());
+
+        switch (waterLevelEffect.value()) {
+        case 1:
+            dst.setWaterlevelEffect(ChartData::WaterLevelEffect::PARTLY_SUBMERGED_AT_HIGH_WATER);
+            break;
+        case 2:
+            dst.setWaterlevelEffect(ChartData::WaterLevelEffect::ALWAYS_DRY);
+            break;
+        case 3:
+            dst.setWaterlevelEffect(ChartData::WaterLevelEffect::ALWAYS_SUBMERGED);
+            break;
+        case 4:
+            dst.setWaterlevelEffect(ChartData::WaterLevelEffect::COVERS_AND_UNCOVERS);
+            break;
+        case 5:
+            dst.setWaterlevelEffect(ChartData::WaterLevelEffect::AWASH);
+            break;
+        case 6:
+            dst.setWaterlevelEffect(ChartData::WaterLevelEffect::SUBJECT_TO_FLOODING);
+            break;
+        case 7:
+            dst.setWaterlevelEffect(ChartData::WaterLevelEffect::FLOATING);
+            break;
+        }
     }
 }
 
-void loadDepthContours(ChartData::Builder &root, const S57Vector &src)
+void loadBuoyLateral(ChartData::BuoyLateral::Builder dst, const oesenc::S57 *s57)
 {
-    auto depthContours = root.initDepthContours(static_cast<unsigned int>(src.size()));
+    auto position = s57->pointGeometry();
+    auto category = s57->attribute<uint32_t>(oesenc::S57::Attribute::CategoryOfLateralMark);
+    auto shape = s57->attribute<uint32_t>(oesenc::S57::Attribute::BuoyShape);
+    auto color = s57->attribute<std::string>(oesenc::S57::Attribute::Colour);
+
+    if (!position.has_value()
+        || !category.has_value()
+        || !shape.has_value()
+        || !color.has_value()) {
+        return;
+    }
 
-    int i = 0;
-    for (const oesenc::S57 *s57 : src) {
-        loadLinesFromS57<ChartData::DepthContour>(depthContours[i++], s57);
+    Coordinates::fromPos(dst.getPosition(), position->latitude(), position->longitude());
+
+    switch (category.value()) {
+    case 1:
+        dst.setCategory(ChartData::CategoryOfLateralMark::PORT);
+        break;
+    case 2:
+        dst.setCategory(ChartData::CategoryOfLateralMark::STARBOARD);
+        break;
+    case 3:
+        dst.setCategory(ChartData::CategoryOfLateralMark::CHANNEL_TO_STARBOARD);
+        break;
+    case 4:
+        dst.setCategory(ChartData::CategoryOfLateralMark::CHANNEL_TO_PORT);
+        break;
+    }
+
+    switch (shape.value()) {
+    case 1:
+        dst.setShape(ChartData::BuoyShape::CONICAL);
+        break;
+    case 2:
+        dst.setShape(ChartData::BuoyShape::CAN);
+        break;
+    case 3:
+        dst.setShape(ChartData::BuoyShape::SPHERICAL);
+        break;
+    case 4:
+        dst.setShape(ChartData::BuoyShape::PILLAR);
+        break;
+    case 5:
+        dst.setShape(ChartData::BuoyShape::SPAR);
+        break;
+    case 6:
+        dst.setShape(ChartData::BuoyShape::BARREL);
+        break;
+    case 7:
+        dst.setShape(ChartData::BuoyShape::SUPER_BUOY);
+        break;
+    case 8:
+        dst.setShape(ChartData::BuoyShape::ICE_BUOY);
+        break;
+    }
+
+    if (color.value() == "1") {
+        dst.setColor(ChartData::Color::WHITE);
+    } else if (color.value() == "2") {
+        dst.setColor(ChartData::Color::BLACK);
+    } else if (color.value() == "3") {
+        dst.setColor(ChartData::Color::RED);
+    } else if (color.value() == "4") {
+        dst.setColor(ChartData::Color::GREEN);
+    } else if (color.value() == "5") {
+        dst.setColor(ChartData::Color::BLUE);
+    } else if (color.value() == "6") {
+        dst.setColor(ChartData::Color::YELLOW);
+    } else if (color.value() == "7") {
+        dst.setColor(ChartData::Color::GREY);
+    } else if (color.value() == "8") {
+        dst.setColor(ChartData::Color::BROWN);
+    } else if (color.value() == "9") {
+        dst.setColor(ChartData::Color::AMBER);
+    } else if (color.value() == "10") {
+        dst.setColor(ChartData::Color::VIOLET);
+    } else if (color.value() == "11") {
+        dst.setColor(ChartData::Color::ORANGE);
+    } else if (color.value() == "12") {
+        dst.setColor(ChartData::Color::MAGENTA);
+    } else if (color.value() == "13") {
+        dst.setColor(ChartData::Color::PINK);
+    } else {
+        std::cerr << "Unable to parse color: " << color.value() << " (multiple colors?)" << std::endl;
     }
 }
 
-void loadCoverage(ChartData::Builder &root, const S57Vector &src)
+void loadPontoon(ChartData::Pontoon::Builder dst, const oesenc::S57 *s57)
 {
-    std::vector<const oesenc::S57 *> coverageRecords;
-
-    for (const oesenc::S57 *s57 : src) {
-        auto categoryOfCoverage = s57->attribute<uint32_t>(oesenc::S57::Attribute::CategoryOfCoverage);
-        if (categoryOfCoverage.has_value() && categoryOfCoverage.value() == 1) {
-            coverageRecords.push_back(s57);
-        }
+    auto name = s57->attribute<std::string>(oesenc::S57::Attribute::ObjectName);
+    if (name.has_value()) {
+        dst.setName(name.value());
     }
 
-    auto coverages = root.initCoverage(static_cast<unsigned int>(coverageRecords.size()));
+    loadPolygonsFromS57<ChartData::Pontoon>(dst, s57);
+    loadLinesFromS57<ChartData::Pontoon>(dst, s57);
+}
 
-    int i = 0;
-    for (const auto &obj : coverageRecords) {
-        ChartData::CoverageArea::Builder coverage = coverages[i++];
-        loadPolygonsFromS57<ChartData::CoverageArea>(coverage, obj);
+void loadShorelineConstruction(ChartData::ShorelineConstruction::Builder dst, const oesenc::S57 *s57)
+{
+    auto name = s57->attribute<std::string>(oesenc::S57::Attribute::ObjectName);
+    if (name.has_value()) {
+        dst.setName(name.value());
     }
+
+    loadPolygonsFromS57<ChartData::ShorelineConstruction>(dst, s57);
+    loadLinesFromS57<ChartData::ShorelineConstruction>(dst, s57);
 }
 
-void loadDepthAreas(ChartData::Builder &root, const S57Vector &src)
+void loadRoad(ChartData::Road::Builder dst, const oesenc::S57 *s57)
 {
-    auto dst = root.initDepthAreas(static_cast<unsigned int>(src.size()));
+    loadPolygonsFromS57<ChartData::Road>(dst, s57);
+    loadLinesFromS57<ChartData::Road>(dst, s57);
 
-    unsigned int i = 0;
-    for (const oesenc::S57 *s57 : src) {
-        auto dstArea = dst[i++];
-        // Should read both limits here
-        auto depth = s57->attribute<float>(oesenc::S57::Attribute::DepthValue1);
-        if (depth.has_value()) {
-            dstArea.setDepth(depth.value());
-        }
+    std::optional<std::string> name = s57->attribute<std::string>(oesenc::S57::Attribute::ObjectName);
+    auto categoryOfRoad = s57->attribute<uint32_t>(oesenc::S57::Attribute::CategoryOfRoad);
+
+    if (name.has_value()) {
+        dst.setName(name.value());
+    }
 
-        loadPolygonsFromS57<ChartData::DepthArea>(dstArea, s57);
+    if (categoryOfRoad.has_value()) {
+        switch (categoryOfRoad.value()) {
+        case 1:
+            dst.setCategory(::ChartData::CategoryOfRoad::MOTORWAY);
+            break;
+        case 2:
+            dst.setCategory(::ChartData::CategoryOfRoad::MAJOR_ROAD);
+            break;
+        case 3:
+            dst.setCategory(::ChartData::CategoryOfRoad::MINOR_ROAD);
+            break;
+        case 4:
+            dst.setCategory(::ChartData::CategoryOfRoad::TRACK);
+            break;
+        case 5:
+            dst.setCategory(::ChartData::CategoryOfRoad::MAJOR_STREET);
+            break;
+        case 6:
+            dst.setCategory(::ChartData::CategoryOfRoad::MINOR_STREET);
+            break;
+        case 7:
+            dst.setCategory(::ChartData::CategoryOfRoad::CROSSING);
+            break;
+        }
     }
 }
 
-void loadLandRegions(ChartData::Builder &root, S57Vector &src)
+/*!
+    Moves the orphaned items of a layer into its list in the message. Only the
+    small fixed size part of each item is copied. Geometry and names stay where
+    they were allocated.
+*/
+template <typename T>
+void adoptItems(typename capnp::List<T>::Builder dst, std::vector<capnp::Orphan<T>> &items)
 {
-    auto dst = root.initLandRegions(static_cast<unsigned int>(src.size()));
     unsigned int i = 0;
-    for (const auto &obj : src) {
-        auto dstElement = dst[i++];
-        auto name = obj->attribute<std::string>(oesenc::S57::Attribute::ObjectName);
-        auto point = obj->pointGeometry();
-
-        if (point.has_value() && name.has_value()) {
-            dstElement.setName(name.value());
-            auto pos = dstElement.getPosition();
-            pos.setLatitude(point.value().latitude());
-            pos.setLongitude(point.value().longitude());
-        }
+    for (capnp::Orphan<T> &item : items) {
+        dst.adoptWithCaveats(i++, std::move(item));
     }
+
+    items.clear();
+    items.shrink_to_fit();
 }
 
-struct Sounding
+/*!
+    The paths of a chart ranked in one batch, taken in the same order as they
+    were collected
+*/
+struct RankedPaths
 {
-    Pos pos;
-    double depth = 0;
-    bool hasValue = false;
+    LineSimplifier::Batch batch;
+    std::vector<double> ranks;
+    size_t next = 0;
+
+    void take(ChartData::Path::Builder dst)
+    {
+        assert(next < batch.size());
+        const size_t path = next++;
+        const size_t offset = batch.offsets[path];
+        const size_t size = batch.sizes[path];
+
+        Coordinates::fromPositions(dst, batch.path(path));
+
+        capnp::List<float>::Builder dstRanks = dst.initRanks(static_cast<unsigned int>(size));
+        for (size_t i = 0; i < size; i++) {
+            dstRanks.set(static_cast<unsigned int>(i), static_cast<float>(ranks[offset + i]));
+        }
+    }
 };
 
-void loadSoundings(ChartData::Builder &root, const S57Vector &objs)
+void collectPath(LineSimplifier::Batch &batch, const ChartData::Path::Reader &path)
 {
-    // Soundings are "multi point geometries" which means that there can be
-    // multiple soundings (depth + position) per S57 object. The S57 object may
-    // have other attributes as well.
+    batch.beginPath();
 
-    // Ignore any S57 attributes and flatten the soundings to a flat list
-    // of position and depth using the internal ChartArea::Sounding struct.
+    for (const Pos &pos : Coordinates::Path(path)) {
+        batch.append(pos);
+    }
+}
 
-    std::vector<Sounding> soundings;
+void collectPolygons(LineSimplifier::Batch &batch, const capnp::List<ChartData::Polygon>::Reader &polygons)
+{
+    for (const ChartData::Polygon::Reader &polygon : polygons) {
+        collectPath(batch, polygon.getMain());
 
-    for (const auto &obj : objs) {
-        for (const auto &sounding : obj->multiPointGeometry()) {
-            soundings.push_back(Sounding { { sounding.position.latitude(),
-                                             sounding.position.longitude() },
-                                           sounding.value });
+        for (const ChartData::Path::Reader &hole : polygon.getHoles()) {
+            collectPath(batch, hole);
         }
     }
+}
 
-    auto dst = root.initSoundings(static_cast<unsigned int>(soundings.size()));
-
-    unsigned int i = 0;
-    for (const auto &sounding : soundings) {
-        auto dstItem = dst[i++];
-        auto pos = dstItem.getPosition();
-        pos.setLatitude(sounding.pos.lat());
-        pos.setLongitude(sounding.pos.lon());
-        dstItem.setDepth(sounding.depth);
+void collectLines(LineSimplifier::Batch &batch, const capnp::List<ChartData::Line>::Reader &lines)
+{
+    for (const ChartData::Line::Reader &line : lines) {
+        collectPath(batch, line.getPositions());
     }
 }
 
-void loadBeacons(ChartData::Builder &root, const S57Vector &src)
+template <typename T>
+void collectPolygonItems(LineSimplifier::Batch &batch, const typename capnp::List<T>::Reader &src)
 {
-    auto dst = root.initBeacons(static_cast<unsigned int>(src.size()));
-
-    unsigned int i = 0;
-    for (const auto &obj : src) {
-        auto dstItem = dst[i++];
-        auto name = obj->attribute<std::string>(oesenc::S57::Attribute::ObjectName);
-        auto shape = obj->attribute<uint32_t>(oesenc::S57::Attribute::BeaconShape);
-        auto position = obj->pointGeometry();
-
-        if (position.has_value() && name.has_value() && shape.has_value()) {
-            auto dstPos = dstItem.getPosition();
-            dstPos.setLatitude(position->latitude());
-            dstPos.setLongitude(position->longitude());
-            dstItem.setName(name.value());
-            switch (shape.value()) {
-            case 1:
-                dstItem.setShape(ChartData::BeaconShape::STAKE);
-                break;
-            case 2:
-                dstItem.setShape(ChartData::BeaconShape::WITHY);
-                break;
-            case 3:
-                dstItem.setShape(ChartData::BeaconShape::BEACON_TOWER);
-                break;
-            case 4:
-                dstItem.setShape(ChartData::BeaconShape::LATTICE_BEACON);
-                break;
-            case 5:
-                dstItem.setShape(ChartData::BeaconShape::PILE_BEACON);
-                break;
-            case 6:
-                dstItem.setShape(ChartData::BeaconShape::CAIRN);
-                break;
-            case 7:
-                dstItem.setShape(ChartData::BeaconShape::BOYANT);
-                break;
-            }
-        }
+    for (const typename T::Reader &element : src) {
+        collectPolygons(batch, element.getPolygons());
     }
 }
 
-void loadUnderwaterRocks(ChartData::Builder &root, const S57Vector &src)
+template <typename T>
+void collectLineItems(LineSimplifier::Batch &batch, const typename capnp::List<T>::Reader &src)
 {
-    auto dst = root.initUnderwaterRocks(static_cast<unsigned int>(src.size()));
-
-    unsigned int i = 0;
-    for (const auto &obj : src) {
-        auto dstItem = dst[i++];
-        auto waterLevelEffect = obj->attribute<uint32_t>(oesenc::S57::Attribute::WaterLevelEffect);
-        auto valueOfSounding = obj->attribute<float>(oesenc::S57::Attribute::ValueOfSounding);
-        auto position = obj->pointGeometry();
-
-        if (waterLevelEffect.has_value() && valueOfSounding.has_value() && position.has_value()) {
-            auto dstPos = dstItem.getPosition();
-            dstPos.setLatitude(position->latitude());
-            dstPos.setLongitude(position->longitude());
-            dstItem.setDepth(valueOfSounding.value());
-
-            switch (waterLevelEffect.value()) {
-            case 1:
-                dstItem.setWaterlevelEffect(ChartData::WaterLevelEffect::PARTLY_SUBMERGED_AT_HIGH_WATER);
-                break;
-            case 2:
-                dstItem.setWaterlevelEffect(ChartData::WaterLevelEffect::ALWAYS_DRY);
-                break;
-            case 3:
-                dstItem.setWaterlevelEffect(ChartData::WaterLevelEffect::ALWAYS_SUBMERGED);
-                break;
-            case 4:
-                dstItem.setWaterlevelEffect(ChartData::WaterLevelEffect::COVERS_AND_UNCOVERS);
-                break;
-            case 5:
-                dstItem.setWaterlevelEffect(ChartData::WaterLevelEffect::AWASH);
-                break;
-            case 6:
-                dstItem.setWaterlevelEffect(ChartData::WaterLevelEffect::SUBJECT_TO_FLOODING);
-                break;
-            case 7:
-                dstItem.setWaterlevelEffect(ChartData::WaterLevelEffect::FLOATING);
-                break;
-            }
-        }
+    for (const typename T::Reader &element : src) {
+        collectLines(batch, element.getLines());
     }
 }
 
-void loadBuoyLateral(ChartData::Builder &root, const S57Vector &src)
+template <typename T>
+void collectPolygonOrLineItems(LineSimplifier::Batch &batch, const typename capnp::List<T>::Reader &src)
 {
-    auto dst = root.initLateralBuoys(static_cast<unsigned int>(src.size()));
+    for (const typename T::Reader &element : src) {
+        collectPolygons(batch, element.getPolygons());
+        collectLines(batch, element.getLines());
+    }
+}
 
+void rankPolygons(capnp::List<ChartData::Polygon>::Builder dst,
+                  const capnp::List<ChartData::Polygon>::Reader &src,
+                  RankedPaths &paths)
+{
     unsigned int i = 0;
-    for (const auto &obj : src) {
-        auto dstItem = dst[i++];
-        auto position = obj->pointGeometry();
-        auto category = obj->attribute<uint32_t>(oesenc::S57::Attribute::CategoryOfLateralMark);
-        auto shape = obj->attribute<uint32_t>(oesenc::S57::Attribute::BuoyShape);
-        auto color = obj->attribute<std::string>(oesenc::S57::Attribute::Colour);
-
-        if (position.has_value()
-            && category.has_value()
-            && shape.has_value()
-            && color.has_value()) {
-
-            auto dstPos = dstItem.getPosition();
-            dstPos.setLatitude(position->latitude());
-            dstPos.setLongitude(position->longitude());
-
-            auto colorString = color.value();
-            auto colorInt = color.value();
-
-            switch (category.value()) {
-            case 1:
-                dstItem.setCategory(ChartData::CategoryOfLateralMark::PORT);
-                break;
-            case 2:
-                dstItem.setCategory(ChartData::CategoryOfLateralMark::STARBOARD);
-                break;
-            case 3:
-                dstItem.setCategory(ChartData::CategoryOfLateralMark::CHANNEL_TO_STARBOARD);
-                break;
-            case 4:
-                dstItem.setCategory(ChartData::CategoryOfLateralMark::CHANNEL_TO_PORT);
-                break;
-            }
 
-            switch (shape.value()) {
-            case 1:
-                dstItem.setShape(ChartData::BuoyShape::CONICAL);
-                break;
-            case 2:
-                dstItem.setShape(ChartData::BuoyShape::CAN);
-                break;
-            case 3:
-                dstItem.setShape(ChartData::BuoyShape::SPHERICAL);
-                break;
-            case 4:
-                dstItem.setShape(ChartData::BuoyShape::PILLAR);
-                break;
-            case 5:
-                dstItem.setShape(ChartData::BuoyShape::SPAR);
-                break;
-            case 6:
-                dstItem.setShape(ChartData::BuoyShape::BARREL);
-                break;
-            case 7:
-                dstItem.setShape(ChartData::BuoyShape::SUPER_BUOY);
-                break;
-            case 8:
-                dstItem.setShape(ChartData::BuoyShape::ICE_BUOY);
-                break;
-            }
+    for (const ChartData::Polygon::Reader &polygon : src) {
+        ChartData::Polygon::Builder dstPolygon = dst[i++];
+        paths.take(dstPolygon.initMain());
 
-            if (color.value() == "1") {
-                dstItem.setColor(ChartData::Color::WHITE);
-            } else if (color.value() == "2") {
-                dstItem.setColor(ChartData::Color::BLACK);
-            } else if (color.value() == "3") {
-                dstItem.setColor(ChartData::Color::RED);
-            } else if (color.value() == "4") {
-                dstItem.setColor(ChartData::Color::GREEN);
-            } else if (color.value() == "5") {
-                dstItem.setColor(ChartData::Color::BLUE);
-            } else if (color.value() == "6") {
-                dstItem.setColor(ChartData::Color::YELLOW);
-            } else if (color.value() == "7") {
-                dstItem.setColor(ChartData::Color::GREY);
-            } else if (color.value() == "8") {
-                dstItem.setColor(ChartData::Color::BROWN);
-            } else if (color.value() == "9") {
-                dstItem.setColor(ChartData::Color::AMBER);
-            } else if (color.value() == "10") {
-                dstItem.setColor(ChartData::Color::VIOLET);
-            } else if (color.value() == "11") {
-                dstItem.setColor(ChartData::Color::ORANGE);
-            } else if (color.value() == "12") {
-                dstItem.setColor(ChartData::Color::MAGENTA);
-            } else if (color.value() == "13") {
-                dstItem.setColor(ChartData::Color::PINK);
-            } else {
-                std::cerr << "Unable to parse color: " << color.value() << " (multiple colors?)" << std::endl;
-            }
+        capnp::List<ChartData::Path>::Builder holes = dstPolygon.initHoles(polygon.getHoles().size());
+        for (unsigned int j = 0; j < holes.size(); j++) {
+            paths.take(holes[j]);
         }
     }
 }
 
-void loadPontoons(ChartData::Builder &root, const S57Vector &src)
+void rankLines(capnp::List<ChartData::Line>::Builder dst,
+               const capnp::List<ChartData::Line>::Reader &src,
+               RankedPaths &paths)
 {
-    auto dst = root.initPontoons(static_cast<unsigned int>(src.size()));
-
-    unsigned int i = 0;
-    for (const oesenc::S57 *s57 : src) {
-        ChartData::Pontoon::Builder pontoon = dst[i++];
-
-        auto name = s57->attribute<std::string>(oesenc::S57::Attribute::ObjectName);
-        if (name.has_value()) {
-            pontoon.setName(name.value());
-        }
-
-        loadPolygonsFromS57<ChartData::Pontoon>(pontoon, s57);
-        loadLinesFromS57<ChartData::Pontoon>(pontoon, s57);
+    for (unsigned int i = 0; i < src.size(); i++) {
+        paths.take(dst[i].initPositions());
     }
 }
 
-void loadShorelineConstructions(ChartData::Builder &root, const S57Vector &src)
+template <typename T>
+void rankPolygonItems(const typename capnp::List<T>::Reader &src,
+                      RankedPaths &paths,
+                      std::function<typename capnp::List<T>::Builder(unsigned int length)> init,
+                      std::function<void(typename T::Builder &, const typename T::Reader &)> copyFunction)
 {
-    auto dst = root.initShorelineConstructions(static_cast<unsigned int>(src.size()));
+    typename capnp::List<T>::Builder list = init(src.size());
 
-    unsigned int i = 0;
-    for (const oesenc::S57 *s57 : src) {
-        ChartData::ShorelineConstruction::Builder item = dst[i++];
+    int i = 0;
 
-        auto name = s57->attribute<std::string>(oesenc::S57::Attribute::ObjectName);
-        if (name.has_value()) {
-            item.setName(name.value());
+    for (const typename T::Reader &element : src) {
+        typename T::Builder builder = list[i++];
+        if (copyFunction) {
+            copyFunction(builder, element);
         }
-
-        loadPolygonsFromS57<ChartData::ShorelineConstruction>(item, s57);
-        loadLinesFromS57<ChartData::ShorelineConstruction>(item, s57);
+        rankPolygons(builder.initPolygons(element.getPolygons().size()), element.getPolygons(), paths);
     }
 }
 
-void loadRoads(ChartData::Builder &root, const S57Vector &src)
+template <typename T>
+void rankLineItems(const typename capnp::List<T>::Reader &src,
+                   RankedPaths &paths,
+                   std::function<typename capnp::List<T>::Builder(unsigned int length)> init,
+                   std::function<void(typename T::Builder &, const typename T::Reader &)> copyFunction)
 {
-    auto dst = root.initRoads(static_cast<unsigned int>(src.size()));
+    typename capnp::List<T>::Builder list = init(src.size());
 
     int i = 0;
-    for (const oesenc::S57 *s57 : src) {
-        ChartData::Road::Builder dstItem = dst[i++];
-
-        loadPolygonsFromS57<ChartData::Road>(dstItem, s57);
-        loadLinesFromS57<ChartData::Road>(dstItem, s57);
-
-        std::optional<std::string> name = s57->attribute<std::string>(oesenc::S57::Attribute::ObjectName);
-        auto categoryOfRoad = s57->attribute<uint32_t>(oesenc::S57::Attribute::CategoryOfRoad);
 
-        if (name.has_value()) {
-            dstItem.setName(name.value());
-        }
-
-        if (categoryOfRoad.has_value()) {
-            switch (categoryOfRoad.value()) {
-            case 1:
-                dstItem.setCategory(::ChartData::CategoryOfRoad::MOTORWAY);
-                break;
-            case 2:
-                dstItem.setCategory(::ChartData::CategoryOfRoad::MAJOR_ROAD);
-                break;
-            case 3:
-                dstItem.setCategory(::ChartData::CategoryOfRoad::MINOR_ROAD);
-                break;
-            case 4:
-                dstItem.setCategory(::ChartData::CategoryOfRoad::TRACK);
-                break;
-            case 5:
-                dstItem.setCategory(::ChartData::CategoryOfRoad::MAJOR_STREET);
-                break;
-            case 6:
-                dstItem.setCategory(::ChartData::CategoryOfRoad::MINOR_STREET);
-                break;
-            case 7:
-                dstItem.setCategory(::ChartData::CategoryOfRoad::CROSSING);
-                break;
-            }
+    for (const typename T::Reader &element : src) {
+        typename T::Builder builder = list[i++];
+        if (copyFunction) {
+            copyFunction(builder, element);
         }
+        rankLines(builder.initLines(element.getLines().size()), element.getLines(), paths);
     }
 }
 
-Pos calcAveragePosition(const capnp::List<ChartData::Position>::Reader &positions)
+template <typename T>
+void rankPolygonOrLineItems(const typename capnp::List<T>::Reader &src,
+                            RankedPaths &paths,
+                            std::function<typename capnp::List<T>::Builder(unsigned int length)> init,
+                            std::function<void(typename T::Builder &, const typename T::Reader &)> copyFunction)
 {
-    double avgLat = 0;
-    double avgLon = 0;
-    int nPositions = 0;
-    for (const auto &pos : positions) {
-        avgLat += pos.getLatitude();
-        avgLon += pos.getLongitude();
-        nPositions++;
+    typename capnp::List<T>::Builder list = init(src.size());
+
+    int i = 0;
+
+    for (const typename T::Reader &element : src) {
+        typename T::Builder builder = list[i++];
+        if (copyFunction) {
+            copyFunction(builder, element);
+        }
+        rankPolygons(builder.initPolygons(element.getPolygons().size()), element.getPolygons(), paths);
+        rankLines(builder.initLines(element.getLines().size()), element.getLines(), paths);
     }
+}
 
-    if (nPositions == 0) {
-        return Pos();
+GeoRect positionsBoundingBox(const ChartData::Path::Reader &path)
+{
+    const Coordinates::Path positions(path);
+
+    if (positions.empty()) {
+        return GeoRect();
     }
-    return Pos(avgLat / nPositions, avgLon / nPositions);
+
+    const Pos first = *positions.begin();
+    double top = first.lat();
+    double bottom = top;
+    double left = first.lon();
+    double right = left;
+
+    for (const Pos &pos : positions) {
+        top = std::max(top, pos.lat());
+        bottom = std::min(bottom, pos.lat());
+        left = std::min(left, pos.lon());
+        right = std::max(right, pos.lon());
+    }
+
+    return GeoRect(top, bottom, left, right);
 }
 
+template <typename T>
+GeoRect polygonItemBoundingBox(const typename T::Reader &item)
+{
+    GeoRect box;
+
+    // Holes are always inside the main contour
+    for (const ChartData::Polygon::Reader &polygon : item.getPolygons()) {
+        box = box.united(positionsBoundingBox(polygon.getMain()));
+    }
+
+    return box;
 }
 
-std::unique_ptr<capnp::MallocMessageBuilder>
-Chart::buildFromS57(const std::vector<oesenc::S57> &objects,
-                    const GeoRect &boundingBox,
-                    const std::string &name,
-                    int scale)
+template <typename T>
+GeoRect lineItemBoundingBox(const typename T::Reader &item)
 {
-    auto message = std::make_unique<capnp::MallocMessageBuilder>();
-    ChartData::Builder root = message->initRoot<ChartData>();
-    std::unordered_map<oesenc::S57::Type, std::vector<const oesenc::S57 *>> sortedObjects;
+    GeoRect box;
 
-    for (const oesenc::S57 &obj : objects) {
-        if (sortedObjects.find(obj.type()) == sortedObjects.end()) {
-            sortedObjects[obj.type()];
-        }
-        sortedObjects[obj.type()].push_back(&obj);
+    for (const ChartData::Line::Reader &line : item.getLines()) {
+        box = box.united(positionsBoundingBox(line.getPositions()));
     }
 
+    return box;
+}
+
+template <typename T>
+GeoRect polygonOrLineItemBoundingBox(const typename T::Reader &item)
+{
+    return polygonItemBoundingBox<T>(item).united(lineItemBoundingBox<T>(item));
+}
+
+template <typename T>
+void indexItems(typename capnp::List<T>::Builder items,
+                ChartData::GridIndex::Builder index,
+                std::function<GeoRect(const typename T::Reader &)> boundingBox)
+{
+    std::vector<GeoRect> boxes;
+    boxes.reserve(items.size());
+
+    for (typename T::Builder item : items) {
+        GeoRect box = boundingBox(item.asReader());
+        LayerIndex::fromGeoRect(item.initBoundingBox(), box);
+        boxes.push_back(box);
+    }
+
+    LayerIndex::build(index, boxes);
+}
+
+template <typename T>
+std::vector<Pos> pointItemPositions(const typename capnp::List<T>::Reader &items)
+{
+    std::vector<Pos> positions;
+    positions.reserve(items.size());
+
+    for (const typename T::Reader item : items) {
+        positions.push_back(Coordinates::toPos(item.getPosition()));
+    }
+
+    return positions;
+}
+
+/*!
+    Sorts point items by the Morton key of their position so that the points
+    of a tile are stored next to each other
+*/
+template <typename T>
+void sortPointItems(std::vector<capnp::Orphan<T>> &items)
+{
+    std::vector<Pos> positions;
+    positions.reserve(items.size());
+
+    for (const capnp::Orphan<T> &item : items) {
+        positions.push_back(Coordinates::toPos(item.getReader().getPosition()));
+    }
+
+    const std::vector<uint32_t> keys = LayerIndex::pointKeys(positions, LayerIndex::pointExtent(positions));
+
+    std::vector<uint32_t> order(items.size());
+    for (uint32_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+
+    std::stable_sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) {
+        return keys[a] < keys[b];
+    });
+
+    std::vector<capnp::Orphan<T>> sorted;
+    sorted.reserve(items.size());
+
+    for (uint32_t i : order) {
+        sorted.push_back(std::move(items[i]));
+    }
+
+    items = std::move(sorted);
+}
+
+/*!
+    Stores the keys of a point layer sorted by sortPointItems(). Layers copied
+    from charts that were written unsorted are left without an index.
+*/
+template <typename T>
+void indexPointItems(typename capnp::List<T>::Reader items,
+                     std::function<ChartData::PointIndex::Builder()> initIndex)
+{
+    const std::vector<Pos> positions = pointItemPositions<T>(items);
+    const GeoRect extent = LayerIndex::pointExtent(positions);
+    const std::vector<uint32_t> keys = LayerIndex::pointKeys(positions, extent);
+
+    if (!std::is_sorted(keys.begin(), keys.end())) {
+        return;
+    }
+
+    LayerIndex::buildPoints(initIndex(), extent, keys);
+}
+
+/*!
+    Stores the bounding box of every polygon and line item and builds a grid
+    index for each of those layers, and stores the keys of the point layers.
+    Must run after all layers are populated.
+*/
+void buildLayerIndexes(ChartData::Builder root)
+{
+    indexItems<ChartData::CoverageArea>(root.getCoverage(),
+                                        root.initCoverageIndex(),
+                                        polygonItemBoundingBox<ChartData::CoverageArea>);
+    indexItems<ChartData::LandArea>(root.getLandAreas(),
+                                    root.initLandAreasIndex(),
+                                    polygonItemBoundingBox<ChartData::LandArea>);
+    indexItems<ChartData::BuiltUpArea>(root.getBuiltUpAreas(),
+                                       root.initBuiltUpAreasIndex(),
+                                       polygonItemBoundingBox<ChartData::BuiltUpArea>);
+    indexItems<ChartData::DepthArea>(root.getDepthAreas(),
+                                     root.initDepthAreasIndex(),
+                                     polygonItemBoundingBox<ChartData::DepthArea>);
+    indexItems<ChartData::CoastLine>(root.getCoastLines(),
+                                     root.initCoastLinesIndex(),
+                                     lineItemBoundingBox<ChartData::CoastLine>);
+    indexItems<ChartData::DepthContour>(root.getDepthContours(),
+                                        root.initDepthContoursIndex(),
+                                        lineItemBoundingBox<ChartData::DepthContour>);
+    indexItems<ChartData::Pontoon>(root.getPontoons(),
+                                   root.initPontoonsIndex(),
+                                   polygonOrLineItemBoundingBox<ChartData::Pontoon>);
+    indexItems<ChartData::ShorelineConstruction>(root.getShorelineConstructions(),
+                                                 root.initShorelineConstructionsIndex(),
+                                                 polygonOrLineItemBoundingBox<ChartData::ShorelineConstruction>);
+    indexItems<ChartData::Road>(root.getRoads(),
+                                root.initRoadsIndex(),
+                                polygonOrLineItemBoundingBox<ChartData::Road>);
+
+    const ChartData::Reader reader = root.asReader();
+    indexPointItems<ChartData::BuiltUpPoint>(reader.getBuiltUpPoints(), [&root]() {
+        return root.initBuiltUpPointsIndex();
+    });
+    indexPointItems<ChartData::LandRegion>(reader.getLandRegions(), [&root]() {
+        return root.initLandRegionsIndex();
+    });
+    indexPointItems<ChartData::Sounding>(reader.getSoundings(), [&root]() {
+        return root.initSoundingsIndex();
+    });
+    indexPointItems<ChartData::Beacon>(reader.getBeacons(), [&root]() {
+        return root.initBeaconsIndex();
+    });
+    indexPointItems<ChartData::UnderwaterRock>(reader.getUnderwaterRocks(), [&root]() {
+        return root.initUnderwaterRocksIndex();
+    });
+    indexPointItems<ChartData::BuoyLateral>(reader.getLateralBuoys(), [&root]() {
+        return root.initLateralBuoysIndex();
+    });
+}
+
+}
+
+Chart::S57Builder::S57Builder(const GeoRect &boundingBox, const std::string &name, int scale)
+    : m_message(std::make_unique<capnp::MallocMessageBuilder>())
+{
+    ChartData::Builder root = m_message->initRoot<ChartData>();
+
     root.setNativeScale(scale);
     root.setName(name);
+    root.setLineEpsilon(0);
 
-    ChartData::Position::Builder topLeft = root.initTopLeft();
-    topLeft.setLatitude(boundingBox.top());
-    topLeft.setLongitude(boundingBox.left());
-
-    ChartData::Position::Builder bottomRight = root.initBottomRight();
-    bottomRight.setLatitude(boundingBox.bottom());
-    bottomRight.setLongitude(boundingBox.right());
-
-    loadCoverage(root, sortedObjects[oesenc::S57::Type::Coverage]);
-    loadCoastLines(root, sortedObjects[oesenc::S57::Type::CoastLine]);
-    loadLandAreas(root, sortedObjects[oesenc::S57::Type::LandArea]);
-    loadLandRegions(root, sortedObjects[oesenc::S57::Type::LandRegion]);
-    loadDepthAreas(root, sortedObjects[oesenc::S57::Type::DepthArea]);
-    loadDepthContours(root, sortedObjects[oesenc::S57::Type::DepthContour]);
-    loadBuiltUpAreas(root, sortedObjects[oesenc::S57::Type::BuiltUpArea]);
-    loadSoundings(root, sortedObjects[oesenc::S57::Type::Sounding]);
-    loadRoads(root, sortedObjects[oesenc::S57::Type::Road]);
-    loadBeacons(root, sortedObjects[oesenc::S57::Type::Beacon]);
-    loadUnderwaterRocks(root, sortedObjects[oesenc::S57::Type::UnderwaterRock]);
-    loadBuoyLateral(root, sortedObjects[oesenc::S57::Type::BuoyLateral]);
-    loadPontoons(root, sortedObjects[oesenc::S57::Type::Pontoon]);
-    loadShorelineConstructions(root, sortedObjects[oesenc::S57::Type::ShorelineConstruction]);
+    Coordinates::fromPos(root.initTopLeft(), boundingBox.top(), boundingBox.left());
+    Coordinates::fromPos(root.initBottomRight(), boundingBox.bottom(), boundingBox.right());
+}
 
-    return message;
+template <typename T>
+typename T::Builder Chart::S57Builder::append(std::vector<capnp::Orphan<T>> &layer)
+{
+    layer.push_back(m_message->getOrphanage().newOrphan<T>());
+    return layer.back().get();
+}
+
+void Chart::S57Builder::add(const oesenc::S57 &object)
+{
+    assert(m_message);
+    const oesenc::S57 *s57 = &object;
+
+    switch (object.type()) {
+    case oesenc::S57::Type::Coverage:
+        if (isCoverage(s57)) {
+            loadPolygonsFromS57<ChartData::CoverageArea>(append(m_coverage), s57);
+        }
+        break;
+    case oesenc::S57::Type::CoastLine:
+        loadLinesFromS57<ChartData::CoastLine>(append(m_coastLines), s57);
+        break;
+    case oesenc::S57::Type::LandArea:
+        loadLandArea(append(m_landAreas), s57);
+        break;
+    case oesenc::S57::Type::LandRegion:
+        loadLandRegion(append(m_landRegions), s57);
+        break;
+    case oesenc::S57::Type::DepthArea:
+        loadDepthArea(append(m_depthAreas), s57);
+        break;
+    case oesenc::S57::Type::DepthContour:
+        loadLinesFromS57<ChartData::DepthContour>(append(m_depthContours), s57);
+        break;
+    case oesenc::S57::Type::BuiltUpArea:
+        // Built-Up areas actaully have either polygons OR points. Those two
+        // variants go to separate layers.
+        if (isPolygonObject(s57)) {
+            loadBuiltUpArea(append(m_builtUpAreas), s57);
+        }
+        if (isPointObject(s57)) {
+            loadBuiltUpPoint(append(m_builtUpPoints), s57);
+        }
+        break;
+    case oesenc::S57::Type::Sounding:
+        // Soundings are "multi point geometries" which means that there can be
+        // multiple soundings (depth + position) per S57 object. Any other S57
+        // attributes are ignored and the soundings are flattened to a list of
+        // position and depth.
+        for (const auto &sounding : s57->multiPointGeometry()) {
+            ChartData::Sounding::Builder dst = append(m_soundings);
+            Coordinates::fromPos(dst.getPosition(), sounding.position.latitude(), sounding.position.longitude());
+            dst.setDepth(sounding.value);
+        }
+        break;
+    case oesenc::S57::Type::Road:
+        loadRoad(append(m_roads), s57);
+        break;
+    case oesenc::S57::Type::Beacon:
+        loadBeacon(append(m_beacons), s57);
+        break;
+    case oesenc::S57::Type::UnderwaterRock:
+        loadUnderwaterRock(append(m_underwaterRocks), s57);
+        break;
+    case oesenc::S57::Type::BuoyLateral:
+        loadBuoyLateral(append(m_lateralBuoys), s57);
+        break;
+    case oesenc::S57::Type::Pontoon:
+        loadPontoon(append(m_pontoons), s57);
+        break;
+    case oesenc::S57::Type::ShorelineConstruction:
+        loadShorelineConstruction(append(m_shorelineConstructions), s57);
+        break;
+    default:
+        break;
+    }
+}
+
+std::unique_ptr<capnp::MallocMessageBuilder> Chart::S57Builder::finish()
+{
+    assert(m_message);
+    ChartData::Builder root = m_message->getRoot<ChartData>();
+
+    sortPointItems<ChartData::BuiltUpPoint>(m_builtUpPoints);
+    sortPointItems<ChartData::LandRegion>(m_landRegions);
+    sortPointItems<ChartData::Sounding>(m_soundings);
+    sortPointItems<ChartData::Beacon>(m_beacons);
+    sortPointItems<ChartData::UnderwaterRock>(m_underwaterRocks);
+    sortPointItems<ChartData::BuoyLateral>(m_lateralBuoys);
+
+    adoptItems<ChartData::CoverageArea>(root.initCoverage(static_cast<unsigned int>(m_coverage.size())), m_coverage);
+    adoptItems<ChartData::CoastLine>(root.initCoastLines(static_cast<unsigned int>(m_coastLines.size())), m_coastLines);
+    adoptItems<ChartData::LandArea>(root.initLandAreas(static_cast<unsigned int>(m_landAreas.size())), m_landAreas);
+    adoptItems<ChartData::LandRegion>(root.initLandRegions(static_cast<unsigned int>(m_landRegions.size())), m_landRegions);
+    adoptItems<ChartData::DepthArea>(root.initDepthAreas(static_cast<unsigned int>(m_depthAreas.size())), m_depthAreas);
+    adoptItems<ChartData::DepthContour>(root.initDepthContours(static_cast<unsigned int>(m_depthContours.size())), m_depthContours);
+    adoptItems<ChartData::Sounding>(root.initSoundings(static_cast<unsigned int>(m_soundings.size())), m_soundings);
+    adoptItems<ChartData::Road>(root.initRoads(static_cast<unsigned int>(m_roads.size())), m_roads);
+    adoptItems<ChartData::Beacon>(root.initBeacons(static_cast<unsigned int>(m_beacons.size())), m_beacons);
+    adoptItems<ChartData::UnderwaterRock>(root.initUnderwaterRocks(static_cast<unsigned int>(m_underwaterRocks.size())), m_underwaterRocks);
+    adoptItems<ChartData::BuoyLateral>(root.initLateralBuoys(static_cast<unsigned int>(m_lateralBuoys.size())), m_lateralBuoys);
+    adoptItems<ChartData::Pontoon>(root.initPontoons(static_cast<unsigned int>(m_pontoons.size())), m_pontoons);
+    adoptItems<ChartData::ShorelineConstruction>(root.initShorelineConstructions(static_cast<unsigned int>(m_shorelineConstructions.size())),
+                                                 m_shorelineConstructions);
+
+    if (!m_builtUpAreas.empty()) {
+        adoptItems<ChartData::BuiltUpArea>(root.initBuiltUpAreas(static_cast<unsigned int>(m_builtUpAreas.size())), m_builtUpAreas);
+    }
+
+    if (!m_builtUpPoints.empty()) {
+        adoptItems<ChartData::BuiltUpPoint>(root.initBuiltUpPoints(static_cast<unsigned int>(m_builtUpPoints.size())), m_builtUpPoints);
+    }
+
+    return std::move(m_message);
 }
 
 Chart::~Chart()
@@ -880,6 +1312,14 @@ Chart::~Chart()
     if (m_file) {
         fclose(m_file);
     }
+
+    if (m_mapping) {
+#ifdef _WIN32
+        UnmapViewOfFile(m_mapping);
+#else
+        munmap(const_cast<void *>(m_mapping), m_mappingSize);
+#endif
+    }
 }
 
 Chart::Chart(FILE *file)
@@ -891,11 +1331,58 @@ Chart::Chart(FILE *file)
     const int fd = fileno(file);
 #endif
     assert(fd);
-    m_capnpReader = std::make_unique<::capnp::PackedFdMessageReader>(fd);
+
+    m_capnpReader = std::make_unique<::capnp::PackedFdMessageReader>(fd, readerOptions());
+}
+
+Chart::Chart(const void *mapping, size_t mappingSize, size_t dataOffset, size_t dataSize)
+    : m_mapping(mapping)
+    , m_mappingSize(mappingSize)
+{
+    const char *data = static_cast<const char *>(mapping) + dataOffset;
+    assert(reinterpret_cast<uintptr_t>(data) % sizeof(capnp::word) == 0);
+    kj::ArrayPtr<const capnp::word> words(reinterpret_cast<const capnp::word *>(data),
+                                          dataSize / sizeof(capnp::word));
+    m_capnpReader = std::make_unique<capnp::FlatArrayMessageReader>(words, readerOptions());
+}
+
+capnp::ReaderOptions Chart::readerOptions()
+{
+    // Opened charts may be kept around and traversed many times. The default
+    // traversal limit applies to the lifetime of the reader and would
+    // eventually be exceeded.
+    capnp::ReaderOptions options;
+    options.traversalLimitInWords = std::numeric_limits<uint64_t>::max();
+    return options;
+}
+
+Chart::Format Chart::format(const std::string &filename)
+{
+    if (std::filesystem::path(filename).extension() == fileExtension(Format::Unpacked)) {
+        return Format::Unpacked;
+    }
+
+    return Format::Packed;
+}
+
+std::string Chart::fileExtension(Format format)
+{
+    switch (format) {
+    case Format::Packed:
+        return ".bin";
+    case Format::Unpacked:
+        return ".capnp";
+    }
+
+    return {};
 }
 
 std::shared_ptr<Chart> Chart::open(const std::string &filename)
 {
+    if (format(filename) == Format::Unpacked) {
+        return openMapped(filename);
+    }
+
     FILE *file = nullptr;
 
 #ifdef Q_OS_WIN
@@ -912,25 +1399,122 @@ std::shared_ptr<Chart> Chart::open(const std::string &filename)
     return std::shared_ptr<Chart>(new Chart(file));
 }
 
+std::shared_ptr<Chart> Chart::openMapped(const std::string &filename)
+{
+    std::error_code errorCode;
+    const size_t size = std::filesystem::file_size(filename, errorCode);
+
+    if (errorCode) {
+        std::cerr << "Unable to map file for reading: " << filename << std::endl;
+        return {};
+    }
+
+    return openMapped(filename, 0, size);
+}
+
+std::shared_ptr<Chart> Chart::openMapped(const std::string &filename, uint64_t offset, size_t size)
+{
+    if (size == 0 || size % sizeof(capnp::word) != 0 || offset % sizeof(capnp::word) != 0) {
+        std::cerr << "Unable to map file for reading: " << filename << std::endl;
+        return {};
+    }
+
+#ifdef _WIN32
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    const uint64_t mappingOffset = offset - offset % systemInfo.dwAllocationGranularity;
+#else
+    const uint64_t mappingOffset = offset - offset % sysconf(_SC_PAGESIZE);
+#endif
+    const size_t dataOffset = offset - mappingOffset;
+    const size_t mappingSize = dataOffset + size;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cerr << "Unable to open file for reading: " << filename << std::endl;
+        return {};
+    }
+
+    HANDLE fileMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+
+    if (!fileMapping) {
+        std::cerr << "Unable to map file for reading: " << filename << std::endl;
+        return {};
+    }
+
+    // The view keeps the mapping alive after its handle is closed
+    const void *mapping = MapViewOfFile(fileMapping,
+                                        FILE_MAP_READ,
+                                        static_cast<DWORD>(mappingOffset >> 32),
+                                        static_cast<DWORD>(mappingOffset & 0xffffffff),
+                                        mappingSize);
+    CloseHandle(fileMapping);
+
+    if (!mapping) {
+        std::cerr << "Unable to map file for reading: " << filename << std::endl;
+        return {};
+    }
+#else
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Unable to open file for reading: " << filename << std::endl;
+        return {};
+    }
+
+    void *mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, mappingOffset);
+    ::close(fd);
+
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Unable to map file for reading: " << filename << std::endl;
+        return {};
+    }
+
+    // Small files such as tiles are read whole so fetch them right away.
+    // Layers of larger charts are scanned from start to end.
+    madvise(mapping, mappingSize, size <= prefetchLimitInBytes ? MADV_WILLNEED : MADV_SEQUENTIAL);
+#endif
+
+    return std::shared_ptr<Chart>(new Chart(mapping, mappingSize, dataOffset, size));
+}
+
 GeoRect Chart::boundingBox() const
 {
-    ChartData::Position::Reader topLeft = root().getTopLeft();
-    ChartData::Position::Reader bottomRight = root().getBottomRight();
+    const Pos topLeft = Coordinates::toPos(root().getTopLeft());
+    const Pos bottomRight = Coordinates::toPos(root().getBottomRight());
+
+    return GeoRect(topLeft.lat(), bottomRight.lat(), topLeft.lon(), bottomRight.lon());
+}
+
+size_t Chart::memoryUsage() const
+{
+    assert(m_capnpReader);
+
+    size_t words = 0;
+    for (unsigned int id = 0;; id++) {
+        kj::ArrayPtr<const capnp::word> segment = m_capnpReader->getSegment(id);
+        if (segment == nullptr) {
+            break;
+        }
+        words += segment.size();
+    }
 
-    return GeoRect(topLeft.getLatitude(),
-                   bottomRight.getLatitude(),
-                   topLeft.getLongitude(),
-                   bottomRight.getLongitude());
+    return words * sizeof(capnp::word);
 }
 
 bool Chart::write(capnp::MallocMessageBuilder *message, const std::string &filename)
 {
+    // Write to a temporary file first so that readers never see a partially
+    // written chart
+    const std::string temporaryFilename = filename + ".tmp";
     FILE *file = 0;
 
 #ifdef Q_OS_WIN
-    fopen_s(&file, filename.c_str(), "wb");
+    fopen_s(&file, temporaryFilename.c_str(), "wb");
 #else
-    file = fopen(filename.c_str(), "wb");
+    file = fopen(temporaryFilename.c_str(), "wb");
 #endif
     if (!file) {
         std::cerr << "Failed to write file" << std::endl;
@@ -942,113 +1526,235 @@ bool Chart::write(capnp::MallocMessageBuilder *message, const std::string &filen
 #else
     const int fd = fileno(file);
 #endif
-    capnp::writePackedMessageToFd(fd, *message);
+    if (format(filename) == Format::Unpacked) {
+        capnp::writeMessageToFd(fd, *message);
+    } else {
+        capnp::writePackedMessageToFd(fd, *message);
+    }
     fclose(file);
 
+    std::error_code errorCode;
+    std::filesystem::rename(temporaryFilename, filename, errorCode);
+
+    if (errorCode) {
+        std::cerr << "Failed to rename " << temporaryFilename << ": " << errorCode.message() << std::endl;
+        return false;
+    }
+
     return true;
 }
 
 std::unique_ptr<capnp::MallocMessageBuilder> Chart::buildClipped(ChartClipper::Config config) const
 {
-    // Hack to ensure that resolution in clipper is high enough.
-    config.latitudeResolution /= 10;
-    config.longitudeResolution /= 10;
+    std::vector<std::unique_ptr<capnp::MallocMessageBuilder>> messages = buildClipped(std::vector<ChartClipper::Config> { config });
+    assert(messages.size() == 1);
+    return std::move(messages.front());
+}
 
-    // Ugly to add this here
-    config.chartBoundingBox = boundingBox();
+std::vector<std::unique_ptr<capnp::MallocMessageBuilder>> Chart::buildClipped(std::vector<ChartClipper::Config> configs) const
+{
+    if (configs.empty()) {
+        return {};
+    }
 
-    auto message = std::make_unique<capnp::MallocMessageBuilder>();
-    ChartData::Builder root = message->initRoot<ChartData>();
+    const GeoRect chartBoundingBox = boundingBox();
+    GeoRect box;
 
-    root.setName(name());
-    root.setNativeScale(nativeScale());
+    for (ChartClipper::Config &config : configs) {
+        // Hack to ensure that resolution in clipper is high enough.
+        config.latitudeResolution /= 10;
+        config.longitudeResolution /= 10;
 
-    clipPolygonItems<ChartData::CoverageArea>(
-        coverage(),
-        config,
-        [&](unsigned int length) {
-            return root.initCoverage(length);
+        // Ugly to add this here
+        config.chartBoundingBox = chartBoundingBox;
+
+        box = box.united(marginBox(config));
+    }
+
+    const ChartData::Reader source = this->root();
+
+    auto candidates = [&](unsigned int size, bool hasIndex, const ChartData::GridIndex::Reader &index) {
+        return candidateItems(size, hasIndex, index, box);
+    };
+
+    auto points = [&](unsigned int size, bool hasIndex, const ChartData::PointIndex::Reader &index) {
+        return candidatePoints(size, hasIndex, index, box);
+    };
+
+    std::vector<std::unique_ptr<capnp::MallocMessageBuilder>> messages;
+    std::vector<ChartData::Builder> roots;
+
+    for (size_t tile = 0; tile < configs.size(); tile++) {
+        messages.push_back(std::make_unique<capnp::MallocMessageBuilder>());
+        ChartData::Builder root = messages.back()->initRoot<ChartData>();
+        root.setName(name());
+        root.setNativeScale(nativeScale());
+        root.setTopLeft(source.getTopLeft());
+        root.setBottomRight(source.getBottomRight());
+        root.setLineEpsilon(std::max<double>(source.getLineEpsilon(), configs[tile].lineEpsilon));
+        roots.push_back(root);
+    }
+
+    // Number of candidate items clipped in one job. Polygons are by far the
+    // most expensive to clip.
+    constexpr size_t polygonRange = 32;
+    constexpr size_t lineRange = 128;
+    constexpr size_t pointRange = 4096;
+
+    ClippedLayer<ClippedItem<ChartData::CoverageArea>> coverageLayer { candidates(coverage().size(), source.hasCoverageIndex(), source.getCoverageIndex()) };
+    ClippedLayer<ClippedItem<ChartData::LandArea>> landAreaLayer { candidates(landAreas().size(), source.hasLandAreasIndex(), source.getLandAreasIndex()) };
+    ClippedLayer<ClippedItem<ChartData::BuiltUpArea>> builtUpAreaLayer { candidates(builtUpAreas().size(), source.hasBuiltUpAreasIndex(), source.getBuiltUpAreasIndex()) };
+    ClippedLayer<ClippedPointItem<ChartData::BuiltUpPoint>> builtUpPointLayer { points(builtUpPoints().size(), source.hasBuiltUpPointsIndex(), source.getBuiltUpPointsIndex()) };
+    ClippedLayer<ClippedPointItem<ChartData::LandRegion>> landRegionLayer { points(landRegions().size(), source.hasLandRegionsIndex(), source.getLandRegionsIndex()) };
+    ClippedLayer<ClippedItem<ChartData::DepthArea>> depthAreaLayer { candidates(depthAreas().size(), source.hasDepthAreasIndex(), source.getDepthAreasIndex()) };
+    ClippedLayer<ClippedItem<ChartData::DepthContour>> depthContourLayer { candidates(depthContours().size(), source.hasDepthContoursIndex(), source.getDepthContoursIndex()) };
+    ClippedLayer<ClippedPointItem<ChartData::Sounding>> soundingLayer { points(soundings().size(), source.hasSoundingsIndex(), source.getSoundingsIndex()) };
+    ClippedLayer<ClippedPointItem<ChartData::Beacon>> beaconLayer { points(beacons().size(), source.hasBeaconsIndex(), source.getBeaconsIndex()) };
+    ClippedLayer<ClippedPointItem<ChartData::UnderwaterRock>> underwaterRockLayer { points(underwaterRocks().size(), source.hasUnderwaterRocksIndex(), source.getUnderwaterRocksIndex()) };
+    ClippedLayer<ClippedPointItem<ChartData::BuoyLateral>> lateralBuoyLayer { points(lateralBuoys().size(), source.hasLateralBuoysIndex(), source.getLateralBuoysIndex()) };
+    ClippedLayer<ClippedItem<ChartData::CoastLine>> coastLineLayer { candidates(coastLines().size(), source.hasCoastLinesIndex(), source.getCoastLinesIndex()) };
+    ClippedLayer<ClippedItem<ChartData::Pontoon>> pontoonLayer { candidates(pontoons().size(), source.hasPontoonsIndex(), source.getPontoonsIndex()) };
+    ClippedLayer<ClippedItem<ChartData::ShorelineConstruction>> shorelineConstructionLayer { candidates(shorelineConstructions().size(), source.hasShorelineConstructionsIndex(), source.getShorelineConstructionsIndex()) };
+    ClippedLayer<ClippedItem<ChartData::Road>> roadLayer { candidates(roads().size(), source.hasRoadsIndex(), source.getRoadsIndex()) };
+
+    ClipJobs jobs;
+
+    jobs.add(coverageLayer, polygonRange, [&](std::span<const uint32_t> range) {
+        return clipPolygonItems<ChartData::CoverageArea>(coverage(), range, configs);
+    });
+    jobs.add(landAreaLayer, polygonRange, [&](std::span<const uint32_t> range) {
+        return clipPolygonItems<ChartData::LandArea>(landAreas(), range, configs);
+    });
+    jobs.add(builtUpAreaLayer, polygonRange, [&](std::span<const uint32_t> range) {
+        return clipPolygonItems<ChartData::BuiltUpArea>(builtUpAreas(), range, configs);
+    });
+    jobs.add(builtUpPointLayer, pointRange, [&](std::span<const uint32_t> range) {
+        return clipPointItems<ChartData::BuiltUpPoint>(builtUpPoints(), range, configs);
+    });
+    jobs.add(landRegionLayer, pointRange, [&](std::span<const uint32_t> range) {
+        return clipPointItems<ChartData::LandRegion>(landRegions(), range, configs);
+    });
+    jobs.add(depthAreaLayer, polygonRange, [&](std::span<const uint32_t> range) {
+        return clipPolygonItems<ChartData::DepthArea>(depthAreas(), range, configs);
+    });
+    jobs.add(depthContourLayer, lineRange, [&](std::span<const uint32_t> range) {
+        return clipLineItems<ChartData::DepthContour>(depthContours(), range, configs);
+    });
+    jobs.add(soundingLayer, pointRange, [&](std::span<const uint32_t> range) {
+        return clipPointItems<ChartData::Sounding>(soundings(), range, configs);
+    });
+    jobs.add(beaconLayer, pointRange, [&](std::span<const uint32_t> range) {
+        return clipPointItems<ChartData::Beacon>(beacons(), range, configs);
+    });
+    jobs.add(underwaterRockLayer, pointRange, [&](std::span<const uint32_t> range) {
+        return clipPointItems<ChartData::UnderwaterRock>(underwaterRocks(), range, configs);
+    });
+    jobs.add(lateralBuoyLayer, pointRange, [&](std::span<const uint32_t> range) {
+        return clipPointItems<ChartData::BuoyLateral>(lateralBuoys(), range, configs);
+    });
+    jobs.add(coastLineLayer, lineRange, [&](std::span<const uint32_t> range) {
+        return clipLineItems<ChartData::CoastLine>(coastLines(), range, configs);
+    });
+    jobs.add(pontoonLayer, polygonRange, [&](std::span<const uint32_t> range) {
+        return clipPolygonOrLineItems<ChartData::Pontoon>(pontoons(), range, configs);
+    });
+    jobs.add(shorelineConstructionLayer, polygonRange, [&](std::span<const uint32_t> range) {
+        return clipPolygonOrLineItems<ChartData::ShorelineConstruction>(shorelineConstructions(), range, configs);
+    });
+    jobs.add(roadLayer, polygonRange, [&](std::span<const uint32_t> range) {
+        return clipPolygonOrLineItems<ChartData::Road>(roads(), range, configs);
+    });
+
+    jobs.run();
+
+    const size_t tileCount = configs.size();
+
+    writePolygonItems<ChartData::CoverageArea>(
+        coverageLayer,
+        tileCount,
+        [&](size_t tile, unsigned int length) {
+            return roots[tile].initCoverage(length);
         },
         {});
 
-    clipPolygonItems<ChartData::LandArea>(
-        landAreas(),
-        config,
-        [&](unsigned int length) {
-            return root.initLandAreas(length);
+    writePolygonItems<ChartData::LandArea>(
+        landAreaLayer,
+        tileCount,
+        [&](size_t tile, unsigned int length) {
+            return roots[tile].initLandAreas(length);
         },
         [](ChartData::LandArea::Builder &dst, const ChartData::LandArea::Reader &src) {
             dst.setName(src.getName());
             dst.setCentroid(src.getCentroid());
         });
 
-    clipPolygonItems<ChartData::BuiltUpArea>(
-        builtUpAreas(),
-        config,
-        [&](unsigned int length) {
-            return root.initBuiltUpAreas(length);
+    writePolygonItems<ChartData::BuiltUpArea>(
+        builtUpAreaLayer,
+        tileCount,
+        [&](size_t tile, unsigned int length) {
+            return roots[tile].initBuiltUpAreas(length);
         },
         [](ChartData::BuiltUpArea::Builder &dst, const ChartData::BuiltUpArea::Reader &src) {
             dst.setCentroid(src.getCentroid());
             dst.setName(src.getName());
         });
 
-    clipPointItems<ChartData::BuiltUpPoint>(
-        builtUpPoints(),
-        config,
-        [&](unsigned int length) {
-            return root.initBuiltUpPoints(length);
+    writePointItems<ChartData::BuiltUpPoint>(
+        builtUpPointLayer,
+        tileCount,
+        [&](size_t tile, unsigned int length) {
+            return roots[tile].initBuiltUpPoints(length);
         },
         [](ChartData::BuiltUpPoint::Builder &dst, const ChartData::BuiltUpPoint::Reader &src) {
             dst.setName(src.getName());
             dst.setPosition(src.getPosition());
         });
 
-    clipPointItems<ChartData::LandRegion>(
-        landRegions(),
-        config,
-        [&](unsigned int length) {
-            return root.initLandRegions(length);
+    writePointItems<ChartData::LandRegion>(
+        landRegionLayer,
+        tileCount,
+        [&](size_t tile, unsigned int length) {
+            return roots[tile].initLandRegions(length);
         },
         [](ChartData::LandRegion::Builder &dst, const ChartData::LandRegion::Reader &src) {
             dst.setName(src.getName());
             dst.setPosition(src.getPosition());
         });
 
-    clipPolygonItems<ChartData::DepthArea>(
-        depthAreas(),
-        config,
-        [&](unsigned int length) {
-            return root.initDepthAreas(length);
+    writePolygonItems<ChartData::DepthArea>(
+        depthAreaLayer,
+        tileCount,
+        [&](size_t tile, unsigned int length) {
+            return roots[tile].initDepthAreas(length);
         },
         [](ChartData::DepthArea::Builder &dst, const ChartData::DepthArea::Reader &src) {
             dst.setDepth(src.getDepth());
         });
 
-    clipLineItems<ChartData::DepthContour>(
-        depthContours(),
-        config,
-        [&](unsigned int length) {
-            return root.initDepthContours(length);
+    writeLineItems<ChartData::DepthContour>(
+        depthContourLayer,
+        tileCount,
+        [&](size_t tile, unsigned int length) {
+            return roots[tile].initDepthContours(length);
         },
         {});
 
-    clipPointItems<ChartData::Sounding>(
-        soundings(),
-        config,
-        [&](unsigned int length) {
-            return root.initSoundings(length);
+    writePointItems<ChartData::Sounding>(
+        soundingLayer,
+        tileCount,
+        [&](size_t tile, unsigned int length) {
+            return roots[tile].initSoundings(length);
         },
         [](ChartData::Sounding::Builder &dst, const ChartData::Sounding::Reader &src) {
             dst.setPosition(src.getPosition());
             dst.setDepth(src.getDepth());
         });
 
-    clipPointItems<ChartData::Beacon>(
-        beacons(),
-        config,
-        [&](unsigned int length) {
-            return root.initBeacons(length);
+    writePointItems<ChartData::Beacon>(
+        beaconLayer,
+        tileCount,
+        [&](size_t tile, unsigned int length) {
+            return roots[tile].initBeacons(length);
         },
         [](ChartData::Beacon::Builder &dst, const ChartData::Beacon::Reader &src) {
             dst.setName(src.getName());
@@ -1056,11 +1762,11 @@ std::unique_ptr<capnp::MallocMessageBuilder> Chart::buildClipped(ChartClipper::C
             dst.setShape(src.getShape());
         });
 
-    clipPointItems<ChartData::UnderwaterRock>(
-        underwaterRocks(),
-        config,
-        [&](unsigned int length) {
-            return root.initUnderwaterRocks(length);
+    writePointItems<ChartData::UnderwaterRock>(
+        underwaterRockLayer,
+        tileCount,
+        [&](size_t tile, unsigned int length) {
+            return roots[tile].initUnderwaterRocks(length);
         },
         [](ChartData::UnderwaterRock::Builder &dst, const ChartData::UnderwaterRock::Reader &src) {
             dst.setDepth(src.getDepth());
@@ -1068,11 +1774,11 @@ std::unique_ptr<capnp::MallocMessageBuilder> Chart::buildClipped(ChartClipper::C
             dst.setWaterlevelEffect(src.getWaterlevelEffect());
         });
 
-    clipPointItems<ChartData::BuoyLateral>(
-        lateralBuoys(),
-        config,
-        [&](unsigned int length) {
-            return root.initLateralBuoys(length);
+    writePointItems<ChartData::BuoyLateral>(
+        lateralBuoyLayer,
+        tileCount,
+        [&](size_t tile, unsigned int length) {
+            return roots[tile].initLateralBuoys(length);
         },
         [](ChartData::BuoyLateral::Builder &dst, const ChartData::BuoyLateral::Reader &src) {
             dst.setPosition(src.getPosition());
@@ -1081,17 +1787,502 @@ std::unique_ptr<capnp::MallocMessageBuilder> Chart::buildClipped(ChartClipper::C
             dst.setColor(src.getColor());
         });
 
-    clipLineItems<ChartData::CoastLine>(
+    writeLineItems<ChartData::CoastLine>(
+        coastLineLayer,
+        tileCount,
+        [&](size_t tile, unsigned int length) {
+            return roots[tile].initCoastLines(length);
+        },
+        {});
+
+    writePolygonOrLineItems<ChartData::Pontoon>(
+        pontoonLayer,
+        tileCount,
+        [&](size_t tile, unsigned int length) {
+            return roots[tile].initPontoons(length);
+        },
+        [](ChartData::Pontoon::Builder &dst, const ChartData::Pontoon::Reader &src) {
+            dst.setName(src.getName());
+        });
+
+    writePolygonOrLineItems<ChartData::ShorelineConstruction>(
+        shorelineConstructionLayer,
+        tileCount,
+        [&](size_t tile, unsigned int length) {
+            return roots[tile].initShorelineConstructions(length);
+        },
+        [](ChartData::ShorelineConstruction::Builder &dst, const ChartData::ShorelineConstruction::Reader &src) {
+            dst.setName(src.getName());
+        });
+
+    writePolygonOrLineItems<ChartData::Road>(
+        roadLayer,
+        tileCount,
+        [&](size_t tile, unsigned int length) {
+            return roots[tile].initRoads(length);
+        },
+        [](ChartData::Road::Builder &dst, const ChartData::Road::Reader &src) {
+            dst.setCategory(src.getCategory());
+            dst.setName(src.getName());
+        });
+
+    return messages;
+}
+
+std::unique_ptr<capnp::MallocMessageBuilder> Chart::buildRanked(const ChartData::Reader &source)
+{
+    // Every path of the chart is ranked in one batch. The paths are
+    // collected in the same order as the layers are written below.
+    RankedPaths paths;
+    collectPolygonItems<ChartData::CoverageArea>(paths.batch, source.getCoverage());
+    collectPolygonItems<ChartData::LandArea>(paths.batch, source.getLandAreas());
+    collectPolygonItems<ChartData::BuiltUpArea>(paths.batch, source.getBuiltUpAreas());
+    collectPolygonItems<ChartData::DepthArea>(paths.batch, source.getDepthAreas());
+    collectLineItems<ChartData::DepthContour>(paths.batch, source.getDepthContours());
+    collectLineItems<ChartData::CoastLine>(paths.batch, source.getCoastLines());
+    collectPolygonOrLineItems<ChartData::Pontoon>(paths.batch, source.getPontoons());
+    collectPolygonOrLineItems<ChartData::ShorelineConstruction>(paths.batch, source.getShorelineConstructions());
+    collectPolygonOrLineItems<ChartData::Road>(paths.batch, source.getRoads());
+
+    // Borders shared by neighbouring areas and lines are ranked once so that
+    // the neighbours still meet at any tolerance
+    paths.batch = EdgeGraph(paths.batch).rank(paths.ranks);
+
+    auto message = std::make_unique<capnp::MallocMessageBuilder>();
+    ChartData::Builder root = message->initRoot<ChartData>();
+
+    root.setName(source.getName());
+    root.setNativeScale(source.getNativeScale());
+    root.setTopLeft(source.getTopLeft());
+    root.setBottomRight(source.getBottomRight());
+    root.setLineEpsilon(0);
+
+    rankPolygonItems<ChartData::CoverageArea>(
+        source.getCoverage(),
+        paths,
+        [&](unsigned int length) {
+            return root.initCoverage(length);
+        },
+        {});
+
+    rankPolygonItems<ChartData::LandArea>(
+        source.getLandAreas(),
+        paths,
+        [&](unsigned int length) {
+            return root.initLandAreas(length);
+        },
+        [](ChartData::LandArea::Builder &dst, const ChartData::LandArea::Reader &src) {
+            dst.setName(src.getName());
+            dst.setCentroid(src.getCentroid());
+        });
+
+    rankPolygonItems<ChartData::BuiltUpArea>(
+        source.getBuiltUpAreas(),
+        paths,
+        [&](unsigned int length) {
+            return root.initBuiltUpAreas(length);
+        },
+        [](ChartData::BuiltUpArea::Builder &dst, const ChartData::BuiltUpArea::Reader &src) {
+            dst.setCentroid(src.getCentroid());
+            dst.setName(src.getName());
+        });
+
+    rankPolygonItems<ChartData::DepthArea>(
+        source.getDepthAreas(),
+        paths,
+        [&](unsigned int length) {
+            return root.initDepthAreas(length);
+        },
+        [](ChartData::DepthArea::Builder &dst, const ChartData::DepthArea::Reader &src) {
+            dst.setDepth(src.getDepth());
+        });
+
+    rankLineItems<ChartData::DepthContour>(
+        source.getDepthContours(),
+        paths,
+        [&](unsigned int length) {
+            return root.initDepthContours(length);
+        },
+        {});
+
+    rankLineItems<ChartData::CoastLine>(
+        source.getCoastLines(),
+        paths,
+        [&](unsigned int length) {
+            return root.initCoastLines(length);
+        },
+        {});
+
+    rankPolygonOrLineItems<ChartData::Pontoon>(
+        source.getPontoons(),
+        paths,
+        [&](unsigned int length) {
+            return root.initPontoons(length);
+        },
+        [](ChartData::Pontoon::Builder &dst, const ChartData::Pontoon::Reader &src) {
+            dst.setName(src.getName());
+        });
+
+    rankPolygonOrLineItems<ChartData::ShorelineConstruction>(
+        source.getShorelineConstructions(),
+        paths,
+        [&](unsigned int length) {
+            return root.initShorelineConstructions(length);
+        },
+        [](ChartData::ShorelineConstruction::Builder &dst, const ChartData::ShorelineConstruction::Reader &src) {
+            dst.setName(src.getName());
+        });
+
+    rankPolygonOrLineItems<ChartData::Road>(
+        source.getRoads(),
+        paths,
+        [&](unsigned int length) {
+            return root.initRoads(length);
+        },
+        [](ChartData::Road::Builder &dst, const ChartData::Road::Reader &src) {
+            dst.setCategory(src.getCategory());
+            dst.setName(src.getName());
+        });
+
+    // Point geometry is not affected by line simplification
+    root.setBuiltUpPoints(source.getBuiltUpPoints());
+    root.setLandRegions(source.getLandRegions());
+    root.setSoundings(source.getSoundings());
+    root.setBeacons(source.getBeacons());
+    root.setUnderwaterRocks(source.getUnderwaterRocks());
+    root.setLateralBuoys(source.getLateralBuoys());
+
+    assert(paths.next == paths.batch.size());
+
+    buildLayerIndexes(root);
+
+    return message;
+}
+
+namespace {
+/*!
+    Area of a tile drawn over by other charts
+*/
+struct HiddenArea
+{
+    Clipper2Lib::PathsD paths;
+    GeoRect bounds;
+
+    bool contains(const Pos &pos) const
+    {
+        if (!bounds.contains(pos.lat(), pos.lon())) {
+            return false;
+        }
+
+        // The paths are the output of a union, so a position is inside when
+        // it is inside an odd number of them
+        const Clipper2Lib::PointD point(pos.lon(), pos.lat());
+        bool inside = false;
+
+        for (const Clipper2Lib::PathD &path : paths) {
+            if (Clipper2Lib::PointInPolygon(point, path) != Clipper2Lib::PointInPolygonResult::IsOutside) {
+                inside = !inside;
+            }
+        }
+
+        return inside;
+    }
+};
+
+ChartClipper::Line toLine(const Clipper2Lib::PathD &path)
+{
+    ChartClipper::Line line;
+    line.reserve(path.size());
+
+    for (const Clipper2Lib::PointD &point : path) {
+        line.push_back(Pos(point.y, point.x));
+    }
+
+    return line;
+}
+
+void appendPolygons(const Clipper2Lib::PolyPathD &node, std::vector<ChartClipper::Polygon> &polygons)
+{
+    for (size_t i = 0; i < node.Count(); i++) {
+        const Clipper2Lib::PolyPathD *outer = node.Child(i);
+        ChartClipper::Polygon polygon;
+        polygon.main = toLine(outer->Polygon());
+
+        for (size_t j = 0; j < outer->Count(); j++) {
+            const Clipper2Lib::PolyPathD *hole = outer->Child(j);
+            polygon.holes.push_back(toLine(hole->Polygon()));
+
+            // Islands within a hole are polygons of their own
+            appendPolygons(*hole, polygons);
+        }
+
+        polygons.push_back(std::move(polygon));
+    }
+}
+
+Clipper2Lib::PathD toClipperPath(const ChartData::Path::Reader &path)
+{
+    const Coordinates::Path positions(path);
+    Clipper2Lib::PathD clipperPath;
+    clipperPath.reserve(positions.size());
+
+    for (const Pos &pos : positions) {
+        clipperPath.push_back({ pos.lon(), pos.lat() });
+    }
+
+    return clipperPath;
+}
+
+std::vector<ChartClipper::Polygon> trimPolygons(const capnp::List<ChartData::Polygon>::Reader &polygons,
+                                                const HiddenArea &hidden)
+{
+    Clipper2Lib::PathsD subject;
+
+    for (const ChartData::Polygon::Reader &polygon : polygons) {
+        subject.push_back(toClipperPath(polygon.getMain()));
+
+        for (const ChartData::Path::Reader &hole : polygon.getHoles()) {
+            subject.push_back(toClipperPath(hole));
+        }
+    }
+
+    Clipper2Lib::ClipperD clipper(Chart::trimPrecision);
+    clipper.AddSubject(subject);
+    clipper.AddClip(hidden.paths);
+
+    Clipper2Lib::PolyTreeD tree;
+    clipper.Execute(Clipper2Lib::ClipType::Difference, Clipper2Lib::FillRule::EvenOdd, tree);
+
+    std::vector<ChartClipper::Polygon> trimmed;
+    appendPolygons(tree, trimmed);
+    return trimmed;
+}
+
+std::vector<cutlines::Line> trimLines(const capnp::List<ChartData::Line>::Reader &lines,
+                                      const HiddenArea &hidden)
+{
+    Clipper2Lib::PathsD subject;
+
+    for (const ChartData::Line::Reader &line : lines) {
+        subject.push_back(toClipperPath(line.getPositions()));
+    }
+
+    Clipper2Lib::ClipperD clipper(Chart::trimPrecision);
+    clipper.AddOpenSubject(subject);
+    clipper.AddClip(hidden.paths);
+
+    Clipper2Lib::PathsD closed;
+    Clipper2Lib::PathsD open;
+    clipper.Execute(Clipper2Lib::ClipType::Difference, Clipper2Lib::FillRule::EvenOdd, closed, open);
+
+    std::vector<cutlines::Line> trimmed;
+
+    for (const Clipper2Lib::PathD &path : open) {
+        cutlines::Line line;
+        line.reserve(path.size());
+
+        for (const Clipper2Lib::PointD &point : path) {
+            line.push_back({ point.x, point.y });
+        }
+
+        trimmed.push_back(std::move(line));
+    }
+
+    return trimmed;
+}
+
+/*!
+    Returns the bounding box of an item. Items of clipped tiles carry no
+    bounding box, so it is computed from their paths.
+*/
+template <typename T>
+GeoRect itemBoundingBox(const typename T::Reader &element)
+{
+    constexpr bool hasPolygons = requires(typename T::Reader item) { item.getPolygons(); };
+    constexpr bool hasLines = requires(typename T::Reader item) { item.getLines(); };
+
+    if (element.hasBoundingBox()) {
+        return LayerIndex::toGeoRect(element.getBoundingBox());
+    }
+
+    if constexpr (hasPolygons && hasLines) {
+        return polygonOrLineItemBoundingBox<T>(element);
+    } else if constexpr (hasPolygons) {
+        return polygonItemBoundingBox<T>(element);
+    } else {
+        return lineItemBoundingBox<T>(element);
+    }
+}
+
+/*!
+    Writes the items of a polygon or line layer without the parts in the
+    hidden area. Items outside the hidden area are copied as they are, and
+    items hidden entirely are left out. Trimmed items are written from their
+    new geometry and the attributes copied by copyFunction, so that none of
+    the original geometry is copied into the message.
+*/
+template <typename T>
+void trimItems(const typename capnp::List<T>::Reader &src,
+               const HiddenArea &hidden,
+               std::function<typename capnp::List<T>::Builder(unsigned int length)> init,
+               std::function<void(typename T::Builder &, const typename T::Reader &)> copyFunction)
+{
+    constexpr bool hasPolygons = requires(typename T::Reader item) { item.getPolygons(); };
+    constexpr bool hasLines = requires(typename T::Reader item) { item.getLines(); };
+
+    struct TrimmedItem
+    {
+        typename T::Reader item;
+        bool trimmed = false;
+        std::vector<ChartClipper::Polygon> polygons;
+        std::vector<cutlines::Line> lines;
+    };
+
+    std::vector<TrimmedItem> items;
+
+    for (const typename T::Reader &element : src) {
+        if (!itemBoundingBox<T>(element).intersects(hidden.bounds)) {
+            items.push_back({ element });
+            continue;
+        }
+
+        TrimmedItem item { element, true };
+
+        if constexpr (hasPolygons) {
+            item.polygons = trimPolygons(element.getPolygons(), hidden);
+        }
+
+        if constexpr (hasLines) {
+            item.lines = trimLines(element.getLines(), hidden);
+        }
+
+        if (!item.polygons.empty() || !item.lines.empty()) {
+            items.push_back(std::move(item));
+        }
+    }
+
+    typename capnp::List<T>::Builder dst = init(static_cast<unsigned int>(items.size()));
+
+    for (unsigned int i = 0; i < items.size(); i++) {
+        if (!items[i].trimmed) {
+            dst.setWithCaveats(i, items[i].item);
+            continue;
+        }
+
+        typename T::Builder builder = dst[i];
+
+        if (copyFunction) {
+            copyFunction(builder, items[i].item);
+        }
+
+        if constexpr (hasPolygons) {
+            copyPolygonsToBuilder<T>(builder, items[i].polygons);
+        }
+
+        if constexpr (hasLines) {
+            copyLinesToBuilder<T>(builder, items[i].lines);
+        }
+    }
+}
+
+/*!
+    Writes the items of a point layer that are outside the hidden area
+*/
+template <typename T>
+void trimPointItems(const typename capnp::List<T>::Reader &src,
+                    const HiddenArea &hidden,
+                    std::function<typename capnp::List<T>::Builder(unsigned int length)> init)
+{
+    std::vector<typename T::Reader> items;
+
+    for (const typename T::Reader &element : src) {
+        if (!hidden.contains(Coordinates::toPos(element.getPosition()))) {
+            items.push_back(element);
+        }
+    }
+
+    typename capnp::List<T>::Builder dst = init(static_cast<unsigned int>(items.size()));
+
+    for (unsigned int i = 0; i < items.size(); i++) {
+        dst.setWithCaveats(i, items[i]);
+    }
+}
+}
+
+std::unique_ptr<capnp::MallocMessageBuilder> Chart::buildTrimmed(const Clipper2Lib::PathsD &hidden) const
+{
+    const Clipper2Lib::RectD bounds = Clipper2Lib::GetBounds(hidden);
+    const HiddenArea hiddenArea { hidden, GeoRect(bounds.bottom, bounds.top, bounds.left, bounds.right) };
+
+    auto message = std::make_unique<capnp::MallocMessageBuilder>();
+    ChartData::Builder root = message->initRoot<ChartData>();
+    const ChartData::Reader source = this->root();
+
+    root.setName(source.getName());
+    root.setNativeScale(source.getNativeScale());
+    root.setTopLeft(source.getTopLeft());
+    root.setBottomRight(source.getBottomRight());
+    root.setLineEpsilon(source.getLineEpsilon());
+
+    trimItems<ChartData::CoverageArea>(
+        coverage(),
+        hiddenArea,
+        [&](unsigned int length) {
+            return root.initCoverage(length);
+        },
+        {});
+
+    trimItems<ChartData::LandArea>(
+        landAreas(),
+        hiddenArea,
+        [&](unsigned int length) {
+            return root.initLandAreas(length);
+        },
+        [](ChartData::LandArea::Builder &dst, const ChartData::LandArea::Reader &src) {
+            dst.setName(src.getName());
+            dst.setCentroid(src.getCentroid());
+        });
+
+    trimItems<ChartData::BuiltUpArea>(
+        builtUpAreas(),
+        hiddenArea,
+        [&](unsigned int length) {
+            return root.initBuiltUpAreas(length);
+        },
+        [](ChartData::BuiltUpArea::Builder &dst, const ChartData::BuiltUpArea::Reader &src) {
+            dst.setCentroid(src.getCentroid());
+            dst.setName(src.getName());
+        });
+
+    trimItems<ChartData::DepthArea>(
+        depthAreas(),
+        hiddenArea,
+        [&](unsigned int length) {
+            return root.initDepthAreas(length);
+        },
+        [](ChartData::DepthArea::Builder &dst, const ChartData::DepthArea::Reader &src) {
+            dst.setDepth(src.getDepth());
+        });
+
+    trimItems<ChartData::DepthContour>(
+        depthContours(),
+        hiddenArea,
+        [&](unsigned int length) {
+            return root.initDepthContours(length);
+        },
+        {});
+
+    trimItems<ChartData::CoastLine>(
         coastLines(),
-        config,
+        hiddenArea,
         [&](unsigned int length) {
             return root.initCoastLines(length);
         },
         {});
 
-    clipPolygonOrLineItems<ChartData::Pontoon>(
+    trimItems<ChartData::Pontoon>(
         pontoons(),
-        config,
+        hiddenArea,
         [&](unsigned int length) {
             return root.initPontoons(length);
         },
@@ -1099,9 +2290,9 @@ std::unique_ptr<capnp::MallocMessageBuilder> Chart::buildClipped(ChartClipper::C
             dst.setName(src.getName());
         });
 
-    clipPolygonOrLineItems<ChartData::ShorelineConstruction>(
+    trimItems<ChartData::ShorelineConstruction>(
         shorelineConstructions(),
-        config,
+        hiddenArea,
         [&](unsigned int length) {
             return root.initShorelineConstructions(length);
         },
@@ -1109,9 +2300,9 @@ std::unique_ptr<capnp::MallocMessageBuilder> Chart::buildClipped(ChartClipper::C
             dst.setName(src.getName());
         });
 
-    clipPolygonOrLineItems<ChartData::Road>(
+    trimItems<ChartData::Road>(
         roads(),
-        config,
+        hiddenArea,
         [&](unsigned int length) {
             return root.initRoads(length);
         },
@@ -1120,5 +2311,35 @@ std::unique_ptr<capnp::MallocMessageBuilder> Chart::buildClipped(ChartClipper::C
             dst.setName(src.getName());
         });
 
+    trimPointItems<ChartData::BuiltUpPoint>(builtUpPoints(), hiddenArea, [&](unsigned int length) {
+        return root.initBuiltUpPoints(length);
+    });
+    trimPointItems<ChartData::LandRegion>(landRegions(), hiddenArea, [&](unsigned int length) {
+        return root.initLandRegions(length);
+    });
+    trimPointItems<ChartData::Sounding>(soundings(), hiddenArea, [&](unsigned int length) {
+        return root.initSoundings(length);
+    });
+    trimPointItems<ChartData::Beacon>(beacons(), hiddenArea, [&](unsigned int length) {
+        return root.initBeacons(length);
+    });
+    trimPointItems<ChartData::UnderwaterRock>(underwaterRocks(), hiddenArea, [&](unsigned int length) {
+        return root.initUnderwaterRocks(length);
+    });
+    trimPointItems<ChartData::BuoyLateral>(lateralBuoys(), hiddenArea, [&](unsigned int length) {
+        return root.initLateralBuoys(length);
+    });
+
     return message;
 }
+
+std::shared_ptr<Chart> Chart::fromMessage(capnp::MessageBuilder &message)
+{
+    return std::shared_ptr<Chart>(new Chart(capnp::messageToFlatArray(message)));
+}
+
+Chart::Chart(kj::Array<capnp::word> words)
+    : m_words(kj::mv(words))
+{
+    m_capnpReader = std::make_unique<capnp::FlatArrayMessageReader>(m_words.asPtr(), readerOptions());
+}
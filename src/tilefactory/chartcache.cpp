@@ -0,0 +1,60 @@
+#include "tilefactory/chartcache.h"
+
+ChartCache::ChartCache(size_t budgetInBytes)
+    : m_budget(budgetInBytes)
+{
+}
+
+std::shared_ptr<Chart> ChartCache::open(const std::string &fileName)
+{
+    {
+        std::lock_guard guard(m_mutex);
+        auto it = m_lookup.find(fileName);
+        if (it != m_lookup.end()) {
+            m_entries.splice(m_entries.begin(), m_entries, it->second);
+            m_hits++;
+            return it->second->chart;
+        }
+    }
+
+    m_misses++;
+
+    // Opening is slow so do it without holding the lock. Concurrent misses
+    // on the same file may both open it but only one of them is kept.
+    std::shared_ptr<Chart> chart = Chart::open(fileName);
+
+    if (!chart) {
+        return {};
+    }
+
+    std::lock_guard guard(m_mutex);
+
+    auto it = m_lookup.find(fileName);
+    if (it != m_lookup.end()) {
+        return it->second->chart;
+    }
+
+    Entry entry;
+    entry.fileName = fileName;
+    entry.chart = chart;
+    entry.size = chart->memoryUsage();
+
+    m_size += entry.size;
+    m_entries.push_front(std::move(entry));
+    m_lookup[fileName] = m_entries.begin();
+    evict();
+
+    return chart;
+}
+
+void ChartCache::evict()
+{
+    // The most recently used chart is always kept even if it alone exceeds
+    // the budget. Evicted charts stay alive as long as someone uses them.
+    while (m_size > m_budget && m_entries.size() > 1) {
+        const Entry &entry = m_entries.back();
+        m_size -= entry.size;
+        m_lookup.erase(entry.fileName);
+        m_entries.pop_back();
+    }
+}
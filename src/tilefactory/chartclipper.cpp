@@ -1,22 +1,33 @@
 #include <assert.h>
 
 #include "tilefactory/chartclipper.h"
+#include "tilefactory/coordinates.h"
 #include "tilefactory/georect.h"
 #include "tilefactory/pos.h"
 
-Clipper2Lib::Path64 ChartClipper::toClipperPath(const capnp::List<ChartData::Position>::Reader &positions,
-                                                const GeoRect &roi, double xRes, double yRes)
+Clipper2Lib::Path64 ChartClipper::toClipperPath(const ChartData::Path::Reader &positions,
+                                                const GeoRect &roi, double xRes, double yRes,
+                                                double epsilon)
 {
     Clipper2Lib::Path64 path;
     Clipper2Lib::Point64 prevPoint;
 
-    for (const auto &p : positions) {
-        Pos pos(p.getLatitude(), p.getLongitude());
+    for (const Pos &pos : Coordinates::Path(positions, epsilon)) {
         Clipper2Lib::Point64 point = toIntPoint(pos, roi, xRes, yRes);
-        if (point == prevPoint) {
+        if (!path.empty() && point == prevPoint) {
             continue;
         }
         path.push_back(point);
+        prevPoint = point;
+    }
+
+    // Rings are implicitly closed
+    if (path.size() > 1 && path.back() == path.front()) {
+        path.pop_back();
+    }
+
+    if (path.size() < 3) {
+        return {};
     }
 
     return path;
@@ -35,8 +46,7 @@ ChartClipper::Line ChartClipper::toLine(const Clipper2Lib::Path64 &path,
     return polygon;
 }
 
-std::vector<ChartClipper::Polygon> ChartClipper::clipPolygon(const ChartData::Polygon::Reader &polygon,
-                                                             Config clipConfig)
+ChartClipper::Grid ChartClipper::grid(const Config &clipConfig)
 {
     assert(clipConfig.longitudeResolution > 0);
     assert(clipConfig.latitudeResolution > 0);
@@ -44,23 +54,232 @@ std::vector<ChartClipper::Polygon> ChartClipper::clipPolygon(const ChartData::Po
     assert(!clipConfig.chartBoundingBox.isNull());
 
     const GeoRect &boundingBox = clipConfig.box;
-    GeoRect clipRect(boundingBox.top() + clipConfig.latitudeMargin,
-                     boundingBox.bottom() - clipConfig.latitudeMargin,
-                     boundingBox.left() - clipConfig.longitudeMargin,
-                     boundingBox.right() + clipConfig.longitudeMargin);
 
-    int xRes = (clipConfig.box.right() - clipConfig.box.left()) / clipConfig.longitudeResolution;
-    int yRes = (clipConfig.box.top() - clipConfig.box.bottom()) / clipConfig.latitudeResolution;
+    Grid grid;
+    grid.rect = GeoRect(boundingBox.top() + clipConfig.latitudeMargin,
+                        boundingBox.bottom() - clipConfig.latitudeMargin,
+                        boundingBox.left() - clipConfig.longitudeMargin,
+                        boundingBox.right() + clipConfig.longitudeMargin);
+
+    grid.xRes = (clipConfig.box.right() - clipConfig.box.left()) / clipConfig.longitudeResolution;
+    grid.yRes = (clipConfig.box.top() - clipConfig.box.bottom()) / clipConfig.latitudeResolution;
 
     // Add a fudge factor here to increase resolution
-    xRes *= 2;
-    yRes *= 2;
+    grid.xRes *= 2;
+    grid.yRes *= 2;
+
+    return grid;
+}
+
+Clipper2Lib::Paths64 ChartClipper::deflateHoles(const Clipper2Lib::Paths64 &holes)
+{
+    if (holes.empty()) {
+        return {};
+    }
+
+    // The holes should already be cut so that they do not intersect with
+    // the main contour. However, some investigation revealed that the
+    // triangulation algorithm in the scene library failed to triangulate
+    // in rare occasions, likely because it does not support holes that
+    // intersect or touch the parent contour.
+    //
+    // To address this issue, the following statement "deflates" all holes
+    // by one unit to ensure a minimum space from the parent area or contour.
+    static int holeDeflateAmount = -1;
+    return Clipper2Lib::InflatePaths(holes,
+                                     holeDeflateAmount,
+                                     Clipper2Lib::JoinType::Round,
+                                     Clipper2Lib::EndType::Polygon);
+}
+
+namespace {
+enum class Placement {
+    Inside,
+    Outside,
+    Crossing
+};
+
+Placement placement(const Clipper2Lib::Path64 &path, const Clipper2Lib::Rect64 &rect)
+{
+    const Clipper2Lib::Rect64 bounds = Clipper2Lib::GetBounds(path);
+
+    if (bounds.right < rect.left || bounds.left > rect.right
+        || bounds.bottom < rect.top || bounds.top > rect.bottom) {
+        return Placement::Outside;
+    }
+
+    if (bounds.left >= rect.left && bounds.right <= rect.right
+        && bounds.top >= rect.top && bounds.bottom <= rect.bottom) {
+        return Placement::Inside;
+    }
+
+    return Placement::Crossing;
+}
+
+/*
+    Tells whether path is inside area without touching or crossing its
+    border. Every position of path must be inside area, and no position of
+    area may be inside or on path.
+*/
+bool strictlyContains(const Clipper2Lib::Path64 &area, const Clipper2Lib::Path64 &path)
+{
+    for (const Clipper2Lib::Point64 &point : path) {
+        if (Clipper2Lib::PointInPolygon(point, area) != Clipper2Lib::PointInPolygonResult::IsInside) {
+            return false;
+        }
+    }
+
+    const Clipper2Lib::Rect64 bounds = Clipper2Lib::GetBounds(path);
+
+    for (const Clipper2Lib::Point64 &point : area) {
+        if (point.x < bounds.left || point.x > bounds.right
+            || point.y < bounds.top || point.y > bounds.bottom) {
+            continue;
+        }
+        if (Clipper2Lib::PointInPolygon(point, path) != Clipper2Lib::PointInPolygonResult::IsOutside) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool containsPath(const Clipper2Lib::Path64 &area, const Clipper2Lib::Path64 &path)
+{
+    for (const Clipper2Lib::Point64 &point : path) {
+        switch (Clipper2Lib::PointInPolygon(point, area)) {
+        case Clipper2Lib::PointInPolygonResult::IsInside:
+            return true;
+        case Clipper2Lib::PointInPolygonResult::IsOutside:
+            return false;
+        case Clipper2Lib::PointInPolygonResult::IsOn:
+            break;
+        }
+    }
+
+    return false;
+}
+}
+
+std::vector<ChartClipper::Polygon> ChartClipper::clipPolygon(const ChartData::Polygon::Reader &polygon,
+                                                             Config clipConfig)
+{
+    const Grid grid = ChartClipper::grid(clipConfig);
+    const Clipper2Lib::Rect64 rect(0, 0, grid.xRes, grid.yRes);
+
+    // Repeated positions are already gone. Also remove spikes and collinear
+    // positions, which the boolean operations removed before.
+    Clipper2Lib::Path64 mainPath = Clipper2Lib::TrimCollinear(toClipperPath(polygon.getMain(), grid.rect, grid.xRes, grid.yRes, clipConfig.lineEpsilon));
+    const Placement mainPlacement = placement(mainPath, rect);
+
+    if (mainPath.size() < 3 || mainPlacement == Placement::Outside) {
+        return {};
+    }
+
+    // Holes inside the tile and strictly inside the main contour are kept as
+    // they are. Holes crossing the tile edge, or touching or crossing the
+    // main contour, are clipped together with the main contour.
+    Clipper2Lib::Paths64 holes;
+    Clipper2Lib::Paths64 joinedHoles;
+
+    for (const ChartData::Path::Reader &hole : polygon.getHoles()) {
+        Clipper2Lib::Path64 holePath = Clipper2Lib::TrimCollinear(toClipperPath(hole, grid.rect, grid.xRes, grid.yRes, clipConfig.lineEpsilon));
+
+        // Small holes collapse when their ranked positions are skipped
+        if (holePath.size() < 3) {
+            continue;
+        }
+
+        switch (placement(holePath, rect)) {
+        case Placement::Inside:
+            if (strictlyContains(mainPath, holePath)) {
+                holes.push_back(std::move(holePath));
+            } else {
+                joinedHoles.push_back(std::move(holePath));
+            }
+            break;
+        case Placement::Crossing:
+            joinedHoles.push_back(std::move(holePath));
+            break;
+        case Placement::Outside:
+            break;
+        }
+    }
+
+    Clipper2Lib::Paths64 mainAreas;
+
+    if (!joinedHoles.empty()) {
+        // Clip the main contour and the joined holes together. Holes come
+        // out with negative orientation.
+        Clipper2Lib::Paths64 subject = std::move(joinedHoles);
+        subject.push_back(std::move(mainPath));
+
+        Clipper2Lib::Paths64 solution = Clipper2Lib::Intersect(subject,
+                                                               { rect.AsPath() },
+                                                               Clipper2Lib::FillRule::EvenOdd);
+
+        for (Clipper2Lib::Path64 &path : solution) {
+            if (Clipper2Lib::IsPositive(path)) {
+                mainAreas.push_back(std::move(path));
+            } else {
+                holes.push_back(std::move(path));
+            }
+        }
+    } else if (mainPlacement == Placement::Inside) {
+        mainAreas.push_back(std::move(mainPath));
+    } else {
+        mainAreas = Clipper2Lib::RectClip(rect, Clipper2Lib::Paths64 { mainPath });
+    }
+
+    std::vector<Clipper2Lib::Paths64> holesPerArea(mainAreas.size());
+
+    for (Clipper2Lib::Path64 &hole : holes) {
+        if (mainAreas.size() == 1) {
+            holesPerArea.front().push_back(std::move(hole));
+            continue;
+        }
+
+        for (size_t i = 0; i < mainAreas.size(); i++) {
+            if (containsPath(mainAreas[i], hole)) {
+                holesPerArea[i].push_back(std::move(hole));
+                break;
+            }
+        }
+    }
+
+    std::vector<Polygon> output;
+
+    for (size_t i = 0; i < mainAreas.size(); i++) {
+        Polygon area;
+        area.main = toLine(mainAreas[i], grid.rect, grid.xRes, grid.yRes);
+
+        if (clipConfig.inflateAtChartEdges) {
+            area.main = inflateAtChartEdges(area.main, clipConfig);
+        }
+
+        for (const Clipper2Lib::Path64 &path : deflateHoles(holesPerArea[i])) {
+            area.holes.push_back(toLine(path, grid.rect, grid.xRes, grid.yRes));
+        }
+
+        output.push_back(area);
+    }
+
+    return output;
+}
+
+std::vector<ChartClipper::Polygon> ChartClipper::clipPolygonGeneral(const ChartData::Polygon::Reader &polygon,
+                                                                    Config clipConfig)
+{
+    const Grid grid = ChartClipper::grid(clipConfig);
+    const GeoRect &clipRect = grid.rect;
+    const int xRes = grid.xRes;
+    const int yRes = grid.yRes;
 
     Clipper2Lib::Paths64 paths;
 
     GeoRect geoRect(clipRect.top(), clipRect.bottom(), clipRect.left(), clipRect.right());
 
-    paths.push_back(toClipperPath(polygon.getMain(), clipRect, xRes, yRes));
+    paths.push_back(toClipperPath(polygon.getMain(), clipRect, xRes, yRes, clipConfig.lineEpsilon));
 
     Clipper2Lib::Path64 clipPath;
     clipPath.push_back(Clipper2Lib::Point64(0, 0));
@@ -81,8 +300,8 @@ std::vector<ChartClipper::Polygon> ChartClipper::clipPolygon(const ChartData::Po
 
     Clipper2Lib::Paths64 holePaths;
 
-    for (const capnp::List<ChartData::Position>::Reader &hole : polygon.getHoles()) {
-        holePaths.push_back(toClipperPath(hole, clipRect, xRes, yRes));
+    for (const ChartData::Path::Reader &hole : polygon.getHoles()) {
+        holePaths.push_back(toClipperPath(hole, clipRect, xRes, yRes, clipConfig.lineEpsilon));
     }
 
     for (const Clipper2Lib::Path64 &mainAreas : solution) {
@@ -104,21 +323,7 @@ std::vector<ChartClipper::Polygon> ChartClipper::clipPolygon(const ChartData::Po
                                                                   { mainAreas },
                                                                   Clipper2Lib::FillRule::EvenOdd);
 
-        // The holes should already be cut so that they do not intersect with
-        // the main contour. However, some investigation revealed that the
-        // triangulation algorithm in the scene library failed to triangulate
-        // in rare occasions, likely because it does not support holes that
-        // intersect or touch the parent contour.
-        //
-        // To address this issue, the following statement "deflates" all holes
-        // by one unit to ensure a minimum space from the parent area or contour.
-        static int holeDeflateAmount = -1;
-        holeResults = Clipper2Lib::InflatePaths(holeResults,
-                                                holeDeflateAmount,
-                                                Clipper2Lib::JoinType::Round,
-                                                Clipper2Lib::EndType::Polygon);
-
-        for (const Clipper2Lib::Path64 &path : holeResults) {
+        for (const Clipper2Lib::Path64 &path : deflateHoles(holeResults)) {
             area.holes.push_back(toLine(path, geoRect, xRes, yRes));
         }
         output.push_back(area);
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "tilefactory/coordinates.h"
+
+Coordinates::Path::Path(const ChartData::Path::Reader &path, double epsilon)
+    : m_coordinates(path.getCoordinates())
+    , m_ranks(path.getRanks())
+    , m_epsilon(epsilon)
+{
+}
+
+Coordinates::Path::Iterator::Iterator(capnp::List<uint32_t>::Reader coordinates,
+                                      capnp::List<float>::Reader ranks,
+                                      double epsilon,
+                                      unsigned int index)
+    : m_coordinates(coordinates)
+    , m_ranks(ranks)
+    , m_epsilon(epsilon)
+    , m_index(index)
+{
+    decode();
+    skipDropped();
+}
+
+Pos Coordinates::Path::Iterator::operator*() const
+{
+    return Pos(dequantize(m_lat), dequantize(m_lon));
+}
+
+Coordinates::Path::Iterator &Coordinates::Path::Iterator::operator++()
+{
+    m_index += 2;
+    decode();
+    skipDropped();
+    return *this;
+}
+
+void Coordinates::Path::Iterator::decode()
+{
+    if (m_index + 1 >= m_coordinates.size()) {
+        return;
+    }
+
+    m_lat = decodeDelta(m_coordinates[m_index], m_lat);
+    m_lon = decodeDelta(m_coordinates[m_index + 1], m_lon);
+}
+
+void Coordinates::Path::Iterator::skipDropped()
+{
+    if (m_epsilon <= 0 || m_ranks.size() == 0) {
+        return;
+    }
+
+    // Dropped vertices are still decoded since the next ones are stored as
+    // differences to them
+    while (m_index + 1 < m_coordinates.size() && m_ranks[m_index / 2] <= m_epsilon) {
+        m_index += 2;
+        decode();
+    }
+}
+
+int32_t Coordinates::quantize(double degrees)
+{
+    const double value = std::round(degrees / ChartData::COORDINATE_RESOLUTION);
+    return static_cast<int32_t>(std::clamp(value,
+                                           static_cast<double>(std::numeric_limits<int32_t>::min()),
+                                           static_cast<double>(std::numeric_limits<int32_t>::max())));
+}
+
+double Coordinates::dequantize(int32_t value)
+{
+    return value * ChartData::COORDINATE_RESOLUTION;
+}
+
+Pos Coordinates::toPos(const ChartData::Position::Reader &src)
+{
+    return Pos(dequantize(src.getLatitude()), dequantize(src.getLongitude()));
+}
+
+void Coordinates::fromPos(ChartData::Position::Builder dst, const Pos &src)
+{
+    fromPos(dst, src.lat(), src.lon());
+}
+
+void Coordinates::fromPos(ChartData::Position::Builder dst, double lat, double lon)
+{
+    dst.setLatitude(quantize(lat));
+    dst.setLongitude(quantize(lon));
+}
+
+std::vector<Pos> Coordinates::toPositions(const ChartData::Path::Reader &src)
+{
+    const Path path(src);
+    std::vector<Pos> positions;
+    positions.reserve(path.size());
+
+    for (const Pos &pos : path) {
+        positions.push_back(pos);
+    }
+
+    return positions;
+}
+
+void Coordinates::fromPositions(ChartData::Path::Builder dst, const std::vector<Pos> &src)
+{
+    capnp::List<uint32_t>::Builder coordinates = dst.initCoordinates(static_cast<unsigned int>(src.size() * 2));
+
+    int32_t lat = 0;
+    int32_t lon = 0;
+    unsigned int i = 0;
+
+    for (const Pos &pos : src) {
+        const int32_t nextLat = quantize(pos.lat());
+        const int32_t nextLon = quantize(pos.lon());
+        coordinates.set(i++, encodeDelta(nextLat, lat));
+        coordinates.set(i++, encodeDelta(nextLon, lon));
+        lat = nextLat;
+        lon = nextLon;
+    }
+}
+
+uint32_t Coordinates::encodeDelta(int32_t value, int32_t previous)
+{
+    // Wraps around instead of overflowing when crossing the antimeridian
+    const uint32_t delta = static_cast<uint32_t>(value) - static_cast<uint32_t>(previous);
+    return (delta << 1) ^ (0u - (delta >> 31));
+}
+
+int32_t Coordinates::decodeDelta(uint32_t delta, int32_t previous)
+{
+    const uint32_t value = (delta >> 1) ^ (0u - (delta & 1));
+    return static_cast<int32_t>(static_cast<uint32_t>(previous) + value);
+}
@@ -1,64 +1,92 @@
-#include "tilefactory/triangulator.h"
+#include <cmath>
+
+#include "tilefactory/coordinates.h"
 
 #include "coverageratio.h"
+#include "layerindex.h"
+
+namespace {
+constexpr int precision = 5;
+constexpr double coveredTolerance = 1e-9;
+}
 
 CoverageRatio::CoverageRatio(const GeoRect &rect)
     : m_rect(rect)
+    , m_clipRect(rect.left(), rect.bottom(), rect.right(), rect.top())
+    , m_rectArea(rect.width() * rect.height())
 {
 }
 
-float CoverageRatio::coveredArea() const
+float CoverageRatio::ratio() const
 {
-    std::vector<std::vector<Triangulator::Point>> lines;
-
-    for (Clipper2Lib::PathD path : m_coverage) {
-        std::vector<Triangulator::Point> line;
-
-        for (Clipper2Lib::PointD point : path) {
-            line.push_back({ point.x, point.y });
-        }
-        lines.push_back(line);
-    }
-
-    std::vector<Triangulator::Point> triangles = Triangulator::calc(lines);
-
-    assert((triangles.size() % 3) == 0);
-
-    float area = 0;
-
-    for (int i = 0; i < triangles.size() / 3; i++) {
-        const Triangulator::Point &a = triangles[i * 3];
-        const Triangulator::Point &b = triangles[i * 3 + 1];
-        const Triangulator::Point &c = triangles[i * 3 + 2];
-
-        // https://en.wikipedia.org/wiki/Triangle#Using_coordinates
-        float arg = a[0] * (b[1] - c[1])
-            + b[0] * (c[1] - a[1])
-            + c[0] * (a[1] - b[1]);
-        area += 0.5f * fabs(arg);
+    if (m_rectArea <= 0) {
+        return 0;
     }
-
-    return area;
+    return static_cast<float>(m_coveredArea / m_rectArea);
 }
 
-float CoverageRatio::ratio() const
+bool CoverageRatio::isCovered() const
 {
-    return coveredArea() / (m_rect.width() * m_rect.height());
+    return m_rectArea > 0 && m_coveredArea >= m_rectArea * (1 - coveredTolerance);
 }
 
 void CoverageRatio::accumulate(const capnp::List<ChartData::CoverageArea>::Reader &coverages)
 {
-    Clipper2Lib::PathsD input = m_coverage;
+    if (isCovered()) {
+        return;
+    }
+
+    Clipper2Lib::PathsD paths;
 
     for (const ChartData::CoverageArea::Reader &coverage : coverages) {
+        const GeoRect box = LayerIndex::toGeoRect(coverage.getBoundingBox());
+        if (!box.isNull() && !box.intersects(m_rect)) {
+            continue;
+        }
+
         for (const ChartData::Polygon::Reader &polygon : coverage.getPolygons()) {
-            Clipper2Lib::PathD newCoveragePath;
-            for (const ChartData::Position::Reader &pos : polygon.getMain()) {
-                newCoveragePath.push_back({ pos.getLatitude(), pos.getLongitude() });
+            const Coordinates::Path main(polygon.getMain());
+            Clipper2Lib::PathD path;
+            path.reserve(main.size());
+            for (const Pos &pos : main) {
+                path.push_back({ pos.lon(), pos.lat() });
             }
-            input.push_back(newCoveragePath);
+            paths.push_back(std::move(path));
         }
     }
 
-    m_coverage = Clipper2Lib::Union(input, Clipper2Lib::FillRule::EvenOdd, 5);
+    accumulate(paths);
+}
+
+void CoverageRatio::accumulate(const Clipper2Lib::PathsD &paths)
+{
+    if (paths.empty() || isCovered()) {
+        return;
+    }
+
+    // Clipping first keeps the union small: neither the new coverage nor the
+    // accumulated coverage ever reaches outside the tile.
+    const Clipper2Lib::PathsD clipped = Clipper2Lib::RectClip(m_clipRect, paths, precision);
+
+    if (clipped.empty()) {
+        return;
+    }
+
+    if (m_coverage.empty()) {
+        m_coverage = Clipper2Lib::Union(clipped, Clipper2Lib::FillRule::EvenOdd, precision);
+    } else {
+        m_coverage = Clipper2Lib::Union(m_coverage, clipped, Clipper2Lib::FillRule::EvenOdd, precision);
+    }
+
+    // Outer rings and holes of a union have opposite orientations, so the
+    // signed areas of all rings add up to the covered area.
+    m_coveredArea = std::min(std::fabs(Clipper2Lib::Area(m_coverage)), m_rectArea);
+
+    if (isCovered()) {
+        m_coverage = { { { m_rect.left(), m_rect.bottom() },
+                         { m_rect.right(), m_rect.bottom() },
+                         { m_rect.right(), m_rect.top() },
+                         { m_rect.left(), m_rect.top() } } };
+        m_coveredArea = m_rectArea;
+    }
 }
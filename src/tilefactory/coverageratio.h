@@ -5,15 +5,35 @@
 #include "tilefactory/chart.h"
 #include "tilefactory/georect.h"
 
+/*!
+ *  Accumulates the coverage of the charts drawn into a tile. Each new
+ *  coverage is clipped to the tile before it is merged, so the accumulated
+ *  area never grows beyond the tile and the covered area is kept up to date
+ *  with the shoelace formula instead of being recomputed on every ratio().
+ */
 class CoverageRatio
 {
 public:
     CoverageRatio(const GeoRect &rect);
     void accumulate(const capnp::List<ChartData::CoverageArea>::Reader &coverages);
+    void accumulate(const Clipper2Lib::PathsD &paths);
     float ratio() const;
 
+    /*!
+     *  Returns true when the tile is entirely covered. Further coverage is
+     *  ignored.
+     */
+    bool isCovered() const;
+
+    /*!
+     *  Returns the accumulated coverage within the tile
+     */
+    const Clipper2Lib::PathsD &coverage() const { return m_coverage; }
+
 private:
-    float coveredArea() const;
     GeoRect m_rect;
+    Clipper2Lib::RectD m_clipRect;
     Clipper2Lib::PathsD m_coverage;
+    double m_rectArea = 0;
+    double m_coveredArea = 0;
 };
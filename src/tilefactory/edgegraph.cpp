@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+#include "edgegraph.h"
+
+namespace {
+struct Key
+{
+    double lat = 0;
+    double lon = 0;
+
+    bool operator==(const Key &other) const { return lat == other.lat && lon == other.lon; }
+    bool operator!=(const Key &other) const { return !(*this == other); }
+    bool operator<(const Key &other) const
+    {
+        return lat < other.lat || (lat == other.lat && lon < other.lon);
+    }
+};
+
+size_t combineHash(size_t seed, size_t value)
+{
+    return seed ^ (value + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2));
+}
+
+struct KeyHash
+{
+    size_t operator()(const Key &key) const
+    {
+        return combineHash(std::hash<double>()(key.lat), std::hash<double>()(key.lon));
+    }
+};
+
+struct Vertex
+{
+    // The neighbours of the first visit, in sorted order
+    Key first;
+    Key second;
+    bool junction = false;
+};
+
+using Vertices = std::unordered_map<Key, Vertex, KeyHash>;
+
+struct PathView
+{
+    const double *lat = nullptr;
+    const double *lon = nullptr;
+    size_t size = 0;
+    bool closed = false;
+
+    Key key(size_t i) const { return { lat[i], lon[i] }; }
+
+    /// Number of distinct positions, excluding the repeated end of a closed path
+    size_t count() const { return closed ? size - 1 : size; }
+};
+
+PathView pathView(const LineSimplifier::Batch &batch, size_t index)
+{
+    PathView view;
+    view.lat = batch.lat.data() + batch.offsets[index];
+    view.lon = batch.lon.data() + batch.offsets[index];
+    view.size = batch.sizes[index];
+    view.closed = view.size >= 4 && view.key(0) == view.key(view.size - 1);
+    return view;
+}
+
+void markJunction(Vertices &vertices, const Key &key)
+{
+    vertices[key].junction = true;
+}
+
+void visit(Vertices &vertices, const Key &key, const Key &previous, const Key &next)
+{
+    const Key first = std::min(previous, next);
+    const Key second = std::max(previous, next);
+    const auto [it, inserted] = vertices.try_emplace(key, Vertex { first, second, false });
+
+    if (!inserted && (it->second.first != first || it->second.second != second)) {
+        it->second.junction = true;
+    }
+}
+
+void findJunctions(Vertices &vertices, const PathView &path)
+{
+    const size_t count = path.count();
+
+    if (count < 2) {
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (!path.closed && (i == 0 || i == count - 1)) {
+            markJunction(vertices, path.key(i));
+            continue;
+        }
+
+        const size_t previous = (i + count - 1) % count;
+        const size_t next = (i + 1) % count;
+        visit(vertices, path.key(i), path.key(previous), path.key(next));
+    }
+}
+
+bool isJunction(const Vertices &vertices, const Key &key)
+{
+    auto it = vertices.find(key);
+    return it != vertices.end() && it->second.junction;
+}
+
+/*!
+    Returns the edges of a path as lists of position indexes. A closed path
+    starts at its first junction, or at its smallest position when it has no
+    junction, so that equal rings give equal edges.
+*/
+std::vector<std::vector<size_t>> splitPath(const Vertices &vertices, const PathView &path)
+{
+    const size_t count = path.count();
+
+    if (count < 2 || !path.closed) {
+        std::vector<std::vector<size_t>> edges;
+        std::vector<size_t> edge;
+
+        for (size_t i = 0; i < path.size; i++) {
+            edge.push_back(i);
+            if (i > 0 && i + 1 < path.size && isJunction(vertices, path.key(i))) {
+                edges.push_back(edge);
+                edge = { i };
+            }
+        }
+
+        edges.push_back(edge);
+        return edges;
+    }
+
+    size_t start = count;
+    for (size_t i = 0; i < count; i++) {
+        if (isJunction(vertices, path.key(i))) {
+            start = i;
+            break;
+        }
+    }
+
+    if (start == count) {
+        start = 0;
+        for (size_t i = 1; i < count; i++) {
+            if (path.key(i) < path.key(start)) {
+                start = i;
+            }
+        }
+    }
+
+    std::vector<std::vector<size_t>> edges;
+    std::vector<size_t> edge = { start };
+
+    for (size_t step = 1; step <= count; step++) {
+        const size_t i = (start + step) % count;
+        edge.push_back(i);
+        if (step < count && isJunction(vertices, path.key(i))) {
+            edges.push_back(edge);
+            edge = { i };
+        }
+    }
+
+    edges.push_back(edge);
+    return edges;
+}
+}
+
+EdgeGraph::EdgeGraph(const LineSimplifier::Batch &paths)
+{
+    Vertices vertices;
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        findJunctions(vertices, pathView(paths, i));
+    }
+
+    // Edges with the same hash, to be told apart by their positions
+    std::unordered_map<size_t, std::vector<size_t>> edgesByHash;
+    std::vector<Key> keys;
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        const PathView path = pathView(paths, i);
+        m_pathOffsets.push_back(m_uses.size());
+
+        if (path.size == 0) {
+            continue;
+        }
+
+        for (const std::vector<size_t> &indexes : splitPath(vertices, path)) {
+            keys.clear();
+            for (size_t index : indexes) {
+                keys.push_back(path.key(index));
+            }
+
+            // Store each edge in one direction regardless of how it is walked
+            const bool reversed = keys.back() < keys.front()
+                || (keys.back() == keys.front() && keys.size() > 2 && keys[keys.size() - 2] < keys[1]);
+
+            if (reversed) {
+                std::reverse(keys.begin(), keys.end());
+            }
+
+            size_t hash = keys.size();
+            for (const Key &key : keys) {
+                hash = combineHash(hash, KeyHash()(key));
+            }
+
+            std::vector<size_t> &candidates = edgesByHash[hash];
+            auto match = std::find_if(candidates.begin(), candidates.end(), [&](size_t edge) {
+                if (m_edges.sizes[edge] != keys.size()) {
+                    return false;
+                }
+                const size_t offset = m_edges.offsets[edge];
+                for (size_t k = 0; k < keys.size(); k++) {
+                    if (Key { m_edges.lat[offset + k], m_edges.lon[offset + k] } != keys[k]) {
+                        return false;
+                    }
+                }
+                return true;
+            });
+
+            if (match != candidates.end()) {
+                m_uses.push_back({ *match, reversed });
+                continue;
+            }
+
+            const size_t edge = m_edges.beginPath();
+            for (const Key &key : keys) {
+                m_edges.append(Pos(key.lat, key.lon));
+            }
+
+            candidates.push_back(edge);
+            m_uses.push_back({ edge, reversed });
+        }
+    }
+
+    m_pathOffsets.push_back(m_uses.size());
+}
+
+LineSimplifier::Batch EdgeGraph::simplify(double epsilon, LineSimplifier::Algorithm algorithm) const
+{
+    LineSimplifier::Batch edges = m_edges;
+    LineSimplifier::simplify(edges, epsilon, algorithm);
+
+    return paths(edges, nullptr, nullptr);
+}
+
+LineSimplifier::Batch EdgeGraph::rank(std::vector<double> &ranks) const
+{
+    std::vector<double> edgeRanks;
+    LineSimplifier::rank(m_edges, edgeRanks);
+
+    ranks.clear();
+    return paths(m_edges, &edgeRanks, &ranks);
+}
+
+LineSimplifier::Batch EdgeGraph::paths(const LineSimplifier::Batch &edges,
+                                       const std::vector<double> *edgeRanks,
+                                       std::vector<double> *ranks) const
+{
+    LineSimplifier::Batch paths;
+
+    for (size_t path = 0; path + 1 < m_pathOffsets.size(); path++) {
+        paths.beginPath();
+
+        for (size_t use = m_pathOffsets[path]; use < m_pathOffsets[path + 1]; use++) {
+            const EdgeUse &edgeUse = m_uses[use];
+            const size_t offset = edges.offsets[edgeUse.edge];
+            const size_t size = edges.sizes[edgeUse.edge];
+
+            // Consecutive edges share their junction
+            const size_t first = use == m_pathOffsets[path] ? 0 : 1;
+
+            for (size_t k = first; k < size; k++) {
+                const size_t i = offset + (edgeUse.reversed ? size - 1 - k : k);
+                paths.append(Pos(edges.lat[i], edges.lon[i]));
+
+                if (ranks) {
+                    ranks->push_back((*edgeRanks)[i]);
+                }
+            }
+        }
+    }
+
+    return paths;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+
+#include "tilefactory/linesimplifier.h"
+
+/*!
+    Splits paths into edges between junctions and stores every shared edge
+    once
+
+    Neighbouring areas and lines in a chart repeat the positions of their
+    common borders. Simplifying the unique edges instead of the paths does
+    that work once per border, and the neighbours keep the same border after
+    simplification instead of drifting apart into slivers.
+
+    A junction is a position where paths meet or part, or the end of an open
+    path. A path is closed when its first and last position are equal.
+*/
+class EdgeGraph
+{
+public:
+    explicit EdgeGraph(const LineSimplifier::Batch &paths);
+
+    /*!
+        Simplifies every unique edge with fixed ends and rebuilds the paths in
+        their original order. Closed paths may start at another position than
+        before.
+    */
+    LineSimplifier::Batch simplify(double epsilon, LineSimplifier::Algorithm algorithm) const;
+
+    /*!
+        Ranks the positions of every unique edge and rebuilds the paths in
+        their original order. ranks receives the rank of every position of the
+        returned paths. Junctions rank infinite so that neighbours meet at any
+        tolerance.
+    */
+    LineSimplifier::Batch rank(std::vector<double> &ranks) const;
+
+    size_t edgeCount() const { return m_edges.size(); }
+
+private:
+    struct EdgeUse
+    {
+        size_t edge = 0;
+        bool reversed = false;
+    };
+
+    /*!
+        Joins the given edges into the paths. The edge ranks are carried over
+        to ranks when given.
+    */
+    LineSimplifier::Batch paths(const LineSimplifier::Batch &edges,
+                                const std::vector<double> *edgeRanks,
+                                std::vector<double> *ranks) const;
+
+    LineSimplifier::Batch m_edges;
+
+    // The edges of path i are m_uses[m_pathOffsets[i]] up to m_uses[m_pathOffsets[i + 1]]
+    std::vector<EdgeUse> m_uses;
+    std::vector<size_t> m_pathOffsets;
+};
@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "extenttree.h"
+
+namespace {
+constexpr uint32_t nodeCapacity = 16;
+
+double centerLat(const GeoRect &rect)
+{
+    return (rect.top() + rect.bottom()) / 2;
+}
+
+double centerLon(const GeoRect &rect)
+{
+    return (rect.left() + rect.right()) / 2;
+}
+}
+
+ExtentTree::ExtentTree(const std::vector<GeoRect> &extents)
+    : m_items(extents.size())
+    , m_extents(extents)
+{
+    if (extents.empty()) {
+        return;
+    }
+
+    std::iota(m_items.begin(), m_items.end(), 0);
+
+    // Sort-tile-recursive: cut the extents into vertical slices by
+    // longitude and sort each slice by latitude, so that consecutive runs of
+    // nodeCapacity extents are close to each other.
+    const size_t leafCount = (extents.size() + nodeCapacity - 1) / nodeCapacity;
+    const size_t sliceCount = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(leafCount))));
+    const size_t sliceSize = sliceCount * nodeCapacity;
+
+    std::sort(m_items.begin(), m_items.end(), [&extents](uint32_t a, uint32_t b) {
+        return centerLon(extents[a]) < centerLon(extents[b]);
+    });
+
+    for (size_t i = 0; i < m_items.size(); i += sliceSize) {
+        auto last = m_items.begin() + std::min(i + sliceSize, m_items.size());
+        std::sort(m_items.begin() + i, last, [&extents](uint32_t a, uint32_t b) {
+            return centerLat(extents[a]) < centerLat(extents[b]);
+        });
+    }
+
+    std::vector<GeoRect> boxes(m_items.size());
+    std::transform(m_items.begin(), m_items.end(), boxes.begin(), [&extents](uint32_t i) {
+        return extents[i];
+    });
+
+    do {
+        m_levels.push_back(group(boxes));
+
+        boxes.resize(m_levels.back().size());
+        std::transform(m_levels.back().begin(), m_levels.back().end(), boxes.begin(), [](const Node &node) {
+            return node.box;
+        });
+    } while (m_levels.back().size() > 1);
+}
+
+std::vector<ExtentTree::Node> ExtentTree::group(const std::vector<GeoRect> &boxes)
+{
+    std::vector<Node> nodes;
+    nodes.reserve((boxes.size() + nodeCapacity - 1) / nodeCapacity);
+
+    for (size_t i = 0; i < boxes.size(); i += nodeCapacity) {
+        Node node;
+        node.first = static_cast<uint32_t>(i);
+        node.count = static_cast<uint32_t>(std::min<size_t>(nodeCapacity, boxes.size() - i));
+        node.box = boxes[i];
+
+        for (uint32_t j = 1; j < node.count; j++) {
+            node.box = node.box.united(boxes[i + j]);
+        }
+
+        nodes.push_back(node);
+    }
+
+    return nodes;
+}
+
+template <typename Visitor>
+bool ExtentTree::visit(const GeoRect &rect, Visitor visitor) const
+{
+    if (m_levels.empty()) {
+        return false;
+    }
+
+    struct Entry
+    {
+        size_t level;
+        uint32_t node;
+    };
+
+    std::vector<Entry> stack { { m_levels.size() - 1, 0 } };
+
+    while (!stack.empty()) {
+        const Entry entry = stack.back();
+        stack.pop_back();
+
+        const Node &node = m_levels[entry.level][entry.node];
+
+        if (!node.box.intersects(rect)) {
+            continue;
+        }
+
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            if (entry.level > 0) {
+                stack.push_back({ entry.level - 1, i });
+            } else if (m_extents[m_items[i]].intersects(rect) && visitor(m_items[i])) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+std::vector<uint32_t> ExtentTree::query(const GeoRect &rect) const
+{
+    std::vector<uint32_t> result;
+
+    visit(rect, [&result](uint32_t index) {
+        result.push_back(index);
+        return false;
+    });
+
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+bool ExtentTree::intersects(const GeoRect &rect) const
+{
+    return visit(rect, [](uint32_t) {
+        return true;
+    });
+}
+
+GeoRect ExtentTree::bounds() const
+{
+    if (m_levels.empty()) {
+        return GeoRect();
+    }
+    return m_levels.back().front().box;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "tilefactory/georect.h"
+
+/*!
+    Static R-tree over a set of rectangles
+
+    The tree is bulk loaded with the sort-tile-recursive algorithm and is
+    rebuilt as a whole whenever the rectangles change. It answers which
+    rectangles intersect a region without visiting every rectangle.
+*/
+class ExtentTree
+{
+public:
+    ExtentTree() = default;
+    explicit ExtentTree(const std::vector<GeoRect> &extents);
+
+    /*!
+        Returns the sorted indexes of the extents intersecting the given
+        rectangle
+    */
+    std::vector<uint32_t> query(const GeoRect &rect) const;
+
+    /*!
+        Returns true if any extent intersects the given rectangle
+    */
+    bool intersects(const GeoRect &rect) const;
+
+    /*!
+        Returns the smallest rectangle enclosing all extents, or a null
+        rectangle if the tree is empty
+    */
+    GeoRect bounds() const;
+    bool empty() const { return m_levels.empty(); }
+
+private:
+    struct Node
+    {
+        GeoRect box;
+        uint32_t first = 0;
+        uint32_t count = 0;
+    };
+
+    template <typename Visitor>
+    bool visit(const GeoRect &rect, Visitor visitor) const;
+
+    static std::vector<Node> group(const std::vector<GeoRect> &boxes);
+
+    // Indexes of the extents in leaf order
+    std::vector<uint32_t> m_items;
+    std::vector<GeoRect> m_extents;
+
+    // m_levels[0] groups m_items, every following level groups the nodes of
+    // the level below. The last level holds the single root.
+    std::vector<std::vector<Node>> m_levels;
+};
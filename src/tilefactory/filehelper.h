@@ -2,18 +2,20 @@
 
 #include <string>
 
+#include "tilefactory/chart.h"
 #include "tilefactory/georect.h"
 
 class FileHelper
 {
 public:
+    /*!
+        Returns the z-x-y id of the tile with the given bounding box and
+        resolution
+    */
     static std::string tileId(const GeoRect &boundingBox, int pixelsPerLongitude);
     static std::string chartTypeIdToString(uint64_t typeId);
     static std::string getTileDir(const std::string &tileDir, uint64_t typeId);
-    static std::string tileFileName(const std::string &tileDir,
-                                    const std::string &name,
-                                    const std::string &id);
-    static std::string internalChartFileName(const std::string &tileDir,
-                                             const std::string &name,
-                                             int pixelsPerLon);
+    static std::string nativeChartFileName(const std::string &tileDir,
+                                           const std::string &name,
+                                           Chart::Format format);
 };
@@ -45,6 +45,22 @@ GeoRect GeoRect::intersection(const GeoRect &other) const
     return output;
 }
 
+GeoRect GeoRect::united(const GeoRect &other) const
+{
+    if (isNull()) {
+        return other;
+    }
+
+    if (other.isNull()) {
+        return *this;
+    }
+
+    return GeoRect(std::max(m_top, other.m_top),
+                   std::min(m_bottom, other.m_bottom),
+                   std::min(m_left, other.m_left),
+                   std::max(m_right, other.m_right));
+}
+
 bool GeoRect::encloses(const GeoRect &other) const
 {
     return (m_left <= other.m_left
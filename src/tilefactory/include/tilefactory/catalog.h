@@ -1,14 +1,21 @@
 #pragma once
 
+#include <atomic>
 #include <filesystem>
+#include <functional>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <oesenc/servercontrol.h>
 
+#include "tilefactory/georect.h"
+
 #include "tilefactory_export.h"
 
+class StreamPool;
+
 class TILEFACTORY_EXPORT Catalog
 {
 public:
@@ -19,16 +26,91 @@ public:
         Unencrypted,
     };
 
+    /*!
+        Metadata read from the headers of a chart file
+    */
+    struct ChartHeader
+    {
+        std::string fileName;
+        uint64_t fileSize = 0;
+        int64_t modified = 0;
+        bool valid = false;
+        int scale = 0;
+        GeoRect extent;
+    };
+
+    using Progress = std::function<void(size_t done, size_t total)>;
+
+    /*!
+        Opens a decrypted stream of a chart file. A session serves one stream
+        at a time.
+    */
+    using Session = std::function<std::shared_ptr<std::istream>(const std::filesystem::path &file)>;
+
     Catalog(oesenc::ServerControl *serverControl, std::string_view dir);
+
+    /*!
+        Creates a catalog decrypted by several servers, so that as many
+        charts can be decoded at the same time
+
+        The application starts a single oexserverd and so decodes one chart
+        at a time. Running several oexserverd instances side by side is not
+        verified, so only catalog_benchmark uses more than one session,
+        through setSessions with a local stand-in.
+    */
+    Catalog(const std::vector<oesenc::ServerControl *> &serverControls, std::string_view dir);
+    ~Catalog();
+
+    /*!
+        Opens a chart for reading
+
+        For encrypted catalogs this blocks until one of the decryption
+        sessions is free. The session is busy until the returned stream is
+        released. Callers are served in the order they called.
+    */
     std::shared_ptr<std::istream> openChart(std::string_view fileName);
     std::vector<std::string> chartFileNames() const;
     Type type() const;
 
+    /*!
+        Replaces the decryption sessions, for instance with a local stand-in
+        for oexserverd. Streams already open are not affected.
+    */
+    void setSessions(std::vector<Session> sessions);
+
+    /*!
+        Returns how many charts can be read at the same time
+    */
+    size_t maxConcurrentStreams() const;
+
+    /*!
+        Returns the headers of all charts in the catalog sorted by file name
+
+        Headers are taken from the index stored in indexDir for charts whose
+        file size and modification time are unchanged. The other charts are
+        read, concurrently when the catalog type allows it, and the index is
+        updated. Progress is called from the reading threads.
+    */
+    std::vector<ChartHeader> chartHeaders(std::string_view indexDir, Progress progress = {});
+
+    /*!
+        Makes a running chartHeaders call stop after the charts being read
+        and return no headers. Later calls return no headers either. Can be
+        called from any thread.
+    */
+    void cancelChartHeaders();
+
 private:
+    std::vector<ChartHeader> readHeaders(std::vector<ChartHeader> headers, const Progress &progress);
+    bool readHeader(ChartHeader &header);
+    std::string indexFileName(std::string_view indexDir) const;
+    static std::vector<ChartHeader> loadIndex(const std::string &fileName);
+    static void saveIndex(const std::string &fileName, const std::vector<ChartHeader> &headers);
+
     std::unordered_map<std::string, std::string> m_oesuKeys;
     std::string m_oesencKey;
     std::filesystem::path m_dir;
     Type m_type = Type::Invalid;
-    oesenc::ServerControl *m_serverControl;
-    std::shared_ptr<std::istream> m_currentStream;
+    std::unique_ptr<StreamPool> m_streamPool;
+    std::atomic<bool> m_cancelled = false;
 };
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <assert.h>
+#include <functional>
 #include <memory>
 
 #include "chartdata.capnp.h"
@@ -19,13 +20,72 @@
 class TILEFACTORY_EXPORT Chart
 {
 public:
+    /*!
+        On-disk formats of a chart
+
+        Unpacked files are memory mapped and read in place without any decode
+        step. Packed files are smaller but are decoded into memory when opened.
+        The format is given by the file extension.
+    */
+    enum class Format {
+        Packed,
+        Unpacked
+    };
+
     static std::shared_ptr<Chart> open(const std::string &filename);
+
+    /*!
+        Maps an unpacked message stored at offset in the given file
+    */
+    static std::shared_ptr<Chart> openMapped(const std::string &filename, uint64_t offset, size_t size);
     static bool write(capnp::MallocMessageBuilder *message, const std::string &filename);
-    static std::unique_ptr<capnp::MallocMessageBuilder>
-    buildFromS57(const std::vector<oesenc::S57> &objects,
-                 const GeoRect &boundingBox,
-                 const std::string &name,
-                 int scale);
+    static Format format(const std::string &filename);
+    static std::string fileExtension(Format format);
+
+    /*!
+        Converts S57 objects into a chart message one object at a time
+
+        Every added object is written straight into the message as an orphan
+        of its layer, and the orphans are adopted into the layer lists by
+        finish(). Geometry and names are thus written once, without an
+        intermediate copy per layer. This does not lower peak memory, since
+        oesenc::ChartFile parses the whole chart before any object can be
+        added, and the parsed objects and the message coexist until the
+        chart is released.
+    */
+    class TILEFACTORY_EXPORT S57Builder
+    {
+    public:
+        S57Builder(const GeoRect &boundingBox, const std::string &name, int scale);
+        void add(const oesenc::S57 &object);
+
+        /*!
+            Returns the message without layer indexes, which buildRanked()
+            builds on its copy
+        */
+        std::unique_ptr<capnp::MallocMessageBuilder> finish();
+
+    private:
+        template <typename T>
+        typename T::Builder append(std::vector<capnp::Orphan<T>> &layer);
+
+        std::unique_ptr<capnp::MallocMessageBuilder> m_message;
+        std::vector<capnp::Orphan<ChartData::CoverageArea>> m_coverage;
+        std::vector<capnp::Orphan<ChartData::CoastLine>> m_coastLines;
+        std::vector<capnp::Orphan<ChartData::LandArea>> m_landAreas;
+        std::vector<capnp::Orphan<ChartData::LandRegion>> m_landRegions;
+        std::vector<capnp::Orphan<ChartData::DepthArea>> m_depthAreas;
+        std::vector<capnp::Orphan<ChartData::DepthContour>> m_depthContours;
+        std::vector<capnp::Orphan<ChartData::BuiltUpArea>> m_builtUpAreas;
+        std::vector<capnp::Orphan<ChartData::BuiltUpPoint>> m_builtUpPoints;
+        std::vector<capnp::Orphan<ChartData::Sounding>> m_soundings;
+        std::vector<capnp::Orphan<ChartData::Road>> m_roads;
+        std::vector<capnp::Orphan<ChartData::Beacon>> m_beacons;
+        std::vector<capnp::Orphan<ChartData::UnderwaterRock>> m_underwaterRocks;
+        std::vector<capnp::Orphan<ChartData::BuoyLateral>> m_lateralBuoys;
+        std::vector<capnp::Orphan<ChartData::Pontoon>> m_pontoons;
+        std::vector<capnp::Orphan<ChartData::ShorelineConstruction>> m_shorelineConstructions;
+    };
 
     Chart() = delete;
     ~Chart();
@@ -34,6 +94,45 @@ public:
 
     std::unique_ptr<capnp::MallocMessageBuilder> buildClipped(ChartClipper::Config config) const;
 
+    /*!
+        Clips the chart to several tiles in one pass
+
+        Each item is visited once and written to every tile it intersects.
+        The returned messages are in the same order as the given configs.
+    */
+    std::vector<std::unique_ptr<capnp::MallocMessageBuilder>> buildClipped(std::vector<ChartClipper::Config> configs) const;
+
+    /*!
+        Returns a copy of the chart where every vertex of every polygon ring
+        and line is ranked with the tolerance at which it drops out
+
+        Tiles at any resolution are clipped from the ranked chart by setting
+        ChartClipper::Config::lineEpsilon, so a single internal chart serves
+        all zoom levels. All paths are ranked in a single batch, and borders
+        shared by several paths are ranked once.
+    */
+    static std::unique_ptr<capnp::MallocMessageBuilder> buildRanked(const ChartData::Reader &source);
+
+    /*!
+        Returns a copy of the chart without the parts in the hidden area
+
+        Polygons are cut along the hidden area, lines are cut where they
+        enter it and points within it are left out. Used to leave out what
+        charts of higher priority draw over anyway.
+    */
+    std::unique_ptr<capnp::MallocMessageBuilder> buildTrimmed(const Clipper2Lib::PathsD &hidden) const;
+
+    /*!
+        Decimal places of the hidden area and of trimmed geometry, which
+        matches the coordinate resolution of the chart format
+    */
+    static constexpr int trimPrecision = 7;
+
+    /*!
+        Returns a chart reading a copy of the message
+    */
+    static std::shared_ptr<Chart> fromMessage(capnp::MessageBuilder &message);
+
     static uint64_t typeId() { return ChartData::_capnpPrivate::typeId; }
 
     ChartData::Reader root() const
@@ -45,6 +144,11 @@ public:
     int nativeScale() const { return root().getNativeScale(); }
     std::string name() const { return root().getName(); }
     GeoRect boundingBox() const;
+
+    /*!
+        Returns the number of bytes held by the decoded message
+    */
+    size_t memoryUsage() const;
     capnp::List<ChartData::CoastLine>::Reader coastLines() const { return root().getCoastLines(); }
     capnp::List<ChartData::CoverageArea>::Reader coverage() const { return root().getCoverage(); }
     capnp::List<ChartData::LandArea>::Reader landAreas() const { return root().getLandAreas(); }
@@ -63,7 +167,14 @@ public:
 
 private:
     Chart(FILE *fd);
+    Chart(const void *mapping, size_t mappingSize, size_t dataOffset, size_t dataSize);
+    Chart(kj::Array<capnp::word> words);
+    static std::shared_ptr<Chart> openMapped(const std::string &filename);
+    static capnp::ReaderOptions readerOptions();
     void read(const std::string &filename);
-    std::unique_ptr<::capnp::PackedFdMessageReader> m_capnpReader;
+    std::unique_ptr<capnp::MessageReader> m_capnpReader;
     FILE *m_file = nullptr;
+    const void *m_mapping = nullptr;
+    size_t m_mappingSize = 0;
+    kj::Array<capnp::word> m_words;
 };
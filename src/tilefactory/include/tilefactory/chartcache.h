@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "tilefactory/chart.h"
+
+#include "tilefactory_export.h"
+
+/*!
+    Size budgeted LRU cache of opened internal charts
+
+    Unpacked internal charts are memory mapped when opened and packed ones
+    are decoded into memory. The budget counts the size of the messages, so
+    for mapped charts it bounds address space and page cache rather than
+    heap. The cache keeps recently used charts open so that tiles generated
+    in bursts for the same chart do not open the same file over and over
+    again. The cache is safe to use from several threads.
+*/
+class TILEFACTORY_EXPORT ChartCache
+{
+public:
+    ChartCache(size_t budgetInBytes);
+
+    /*!
+        Returns the chart opened from fileName, opening it on a miss
+
+        Charts are keyed by file name, and there is one native file per
+        chart.
+    */
+    std::shared_ptr<Chart> open(const std::string &fileName);
+    uint64_t hits() const { return m_hits; }
+    uint64_t misses() const { return m_misses; }
+
+private:
+    struct Entry
+    {
+        std::string fileName;
+        std::shared_ptr<Chart> chart;
+        size_t size = 0;
+    };
+
+    void evict();
+    std::list<Entry> m_entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_lookup;
+    std::mutex m_mutex;
+    size_t m_budget = 0;
+    size_t m_size = 0;
+    std::atomic<uint64_t> m_hits = 0;
+    std::atomic<uint64_t> m_misses = 0;
+};
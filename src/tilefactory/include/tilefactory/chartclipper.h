@@ -31,18 +31,49 @@ public:
         float latitudeResolution = 0;
         float longitudeResolution = 0;
         bool inflateAtChartEdges = false;
+
+        /// Tolerance in degrees. Vertices of ranked paths that drop out at it are skipped.
+        double lineEpsilon = 0;
     };
 
+    /*!
+        Clips a polygon and its holes to the tile
+
+        The tile is a rectangle which allows the main contour to be clipped
+        without general boolean operations in most cases. Holes are only
+        clipped when they cross the tile edge or touch the main contour, and
+        then together with the main contour in a single operation.
+    */
     static std::vector<Polygon> clipPolygon(const ChartData::Polygon::Reader &polygon,
                                             Config clipConfig);
-    static Clipper2Lib::Path64 toClipperPath(const capnp::List<ChartData::Position>::Reader &points,
-                                             const GeoRect &roi, double xRes, double yRes);
+
+    /*!
+        Clips a polygon using general boolean operations for both the main
+        contour and the holes of each resulting area
+
+        This is the former clipping path, kept as a reference for
+        benchmarks.
+    */
+    static std::vector<Polygon> clipPolygonGeneral(const ChartData::Polygon::Reader &polygon,
+                                                   Config clipConfig);
+    static Clipper2Lib::Path64 toClipperPath(const ChartData::Path::Reader &points,
+                                             const GeoRect &roi, double xRes, double yRes,
+                                             double epsilon = 0);
     static Line toLine(const Clipper2Lib::Path64 &path,
                        const GeoRect &roi,
                        double xRes,
                        double yRes);
 
 private:
+    struct Grid
+    {
+        GeoRect rect;
+        int xRes = 0;
+        int yRes = 0;
+    };
+
+    static Grid grid(const Config &clipConfig);
+    static Clipper2Lib::Paths64 deflateHoles(const Clipper2Lib::Paths64 &holes);
     static int inRange(double value, double min, double max, double margin);
     static Line inflateAtChartEdges(const Line &area, Config clipConfig);
     static inline Clipper2Lib::Point64 toIntPoint(const Pos &pos,
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+
+#include "chartdata.capnp.h"
+#include "tilefactory/pos.h"
+
+#include "tilefactory_export.h"
+
+/*!
+    Converts between positions in degrees and the quantized coordinates stored
+    in ChartData
+*/
+class TILEFACTORY_EXPORT Coordinates
+{
+public:
+    /*!
+        Decodes the vertices of a path while it is iterated
+
+        When a tolerance is given, vertices of a ranked path that drop out at
+        that tolerance are skipped. size() still counts all vertices.
+    */
+    class Path
+    {
+    public:
+        class Iterator
+        {
+        public:
+            Iterator(capnp::List<uint32_t>::Reader coordinates,
+                     capnp::List<float>::Reader ranks,
+                     double epsilon,
+                     unsigned int index);
+            Pos operator*() const;
+            Iterator &operator++();
+            bool operator!=(const Iterator &other) const { return m_index != other.m_index; }
+
+        private:
+            void decode();
+            void skipDropped();
+            capnp::List<uint32_t>::Reader m_coordinates;
+            capnp::List<float>::Reader m_ranks;
+            double m_epsilon = 0;
+            unsigned int m_index = 0;
+            int32_t m_lat = 0;
+            int32_t m_lon = 0;
+        };
+
+        Path(const ChartData::Path::Reader &path, double epsilon = 0);
+        unsigned int size() const { return m_coordinates.size() / 2; }
+        bool empty() const { return size() == 0; }
+        Iterator begin() const { return Iterator(m_coordinates, m_ranks, m_epsilon, 0); }
+        Iterator end() const { return Iterator(m_coordinates, m_ranks, m_epsilon, m_coordinates.size()); }
+
+    private:
+        capnp::List<uint32_t>::Reader m_coordinates;
+        capnp::List<float>::Reader m_ranks;
+        double m_epsilon = 0;
+    };
+
+    static int32_t quantize(double degrees);
+    static double dequantize(int32_t value);
+
+    static Pos toPos(const ChartData::Position::Reader &src);
+    static void fromPos(ChartData::Position::Builder dst, const Pos &src);
+    static void fromPos(ChartData::Position::Builder dst, double lat, double lon);
+
+    static std::vector<Pos> toPositions(const ChartData::Path::Reader &src);
+    static void fromPositions(ChartData::Path::Builder dst, const std::vector<Pos> &src);
+
+private:
+    static uint32_t encodeDelta(int32_t value, int32_t previous);
+    static int32_t decodeDelta(uint32_t delta, int32_t previous);
+};
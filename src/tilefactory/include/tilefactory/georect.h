@@ -35,6 +35,12 @@ public:
     bool intersects(const GeoRect &rect) const;
     GeoRect intersection(const GeoRect &rect) const;
 
+    /*!
+     *  Returns the smallest rectangle enclosing both rectangles. A null
+     *  rectangle is treated as empty.
+     */
+    GeoRect united(const GeoRect &rect) const;
+
 private:
     double m_top = 0;
     double m_bottom = 0;
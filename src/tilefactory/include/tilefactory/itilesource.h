@@ -2,6 +2,7 @@
 
 #include <optional>
 #include <string>
+#include <vector>
 
 #include "chart.h"
 #include "georect.h"
@@ -13,6 +14,46 @@ class TILEFACTORY_EXPORT ITileSource
 public:
     virtual std::shared_ptr<Chart> create(const GeoRect &boundingBox,
                                               int pixelsPerLongitude) = 0;
+
+    /*!
+        Creates tile data for several tiles at once
+
+        Sources that can produce multiple tiles from one pass over their data
+        should override this. The result has the same order as boundingBoxes.
+    */
+    virtual std::vector<std::shared_ptr<Chart>> createMany(const std::vector<GeoRect> &boundingBoxes,
+                                                           int pixelsPerLongitude)
+    {
+        std::vector<std::shared_ptr<Chart>> tiles;
+
+        for (const GeoRect &boundingBox : boundingBoxes) {
+            tiles.push_back(create(boundingBox, pixelsPerLongitude));
+        }
+
+        return tiles;
+    }
+
+    /*!
+        Returns a tile derived from a tile of this source, stored earlier
+        under key by \ref storeDerivedTile, or nullptr
+
+        The key is chosen by the caller and must identify both the tile and
+        how it was derived. Sources without a tile cache keep nothing.
+    */
+    virtual std::shared_ptr<Chart> derivedTile(const std::string &key)
+    {
+        return nullptr;
+    }
+
+    /*!
+        Stores a tile derived from a tile of this source under key and
+        returns the stored tile
+    */
+    virtual std::shared_ptr<Chart> storeDerivedTile(const std::string &key, capnp::MessageBuilder *message)
+    {
+        return Chart::fromMessage(*message);
+    }
+
     virtual GeoRect extent() const = 0;
     virtual int scale() const = 0;
 };
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <functional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "tilefactory/pos.h"
+
+#include "tilefactory_export.h"
+
+/*!
+    Simplifies lines and polygon rings in place
+
+    Coordinates are kept in a structure of arrays layout so that the distance
+    and area kernels run over contiguous memory and can be vectorized by the
+    compiler. The first and last position of every path are always kept.
+*/
+class TILEFACTORY_EXPORT LineSimplifier
+{
+public:
+    enum class Algorithm {
+        /// Removes positions closer than epsilon to the simplified line
+        DouglasPeucker,
+
+        /// Removes positions whose effective triangle area is below epsilon squared
+        Visvalingam
+    };
+
+    /*!
+        Positions of many paths
+
+        Path i occupies [offsets[i], offsets[i] + sizes[i]) in lat and lon.
+        Simplification only shrinks sizes, the offsets stay the same.
+    */
+    struct Batch
+    {
+        std::vector<double> lat;
+        std::vector<double> lon;
+        std::vector<size_t> offsets;
+        std::vector<size_t> sizes;
+
+        /// Starts a new path and returns its index
+        size_t beginPath();
+
+        /// Appends a position to the last path
+        void append(const Pos &pos);
+
+        std::vector<Pos> path(size_t index) const;
+        size_t size() const { return offsets.size(); }
+    };
+
+    /*!
+        Simplifies all paths of the batch, spread over the available cores
+    */
+    static void simplify(Batch &batch, double epsilon, Algorithm algorithm = Algorithm::DouglasPeucker);
+
+    /*!
+        Simplifies a single path and returns its new size. The kept positions
+        are moved to the front of the spans.
+    */
+    static size_t simplify(std::span<double> lat,
+                           std::span<double> lon,
+                           double epsilon,
+                           Algorithm algorithm = Algorithm::DouglasPeucker);
+
+    /*!
+        Writes the Douglas-Peucker rank of every position of the batch to
+        ranks, indexed like lat and lon
+
+        The rank is the tolerance at which a position drops out. Keeping the
+        positions ranked above epsilon gives the same path as simplifying with
+        epsilon. The first and last position of a path rank infinite.
+    */
+    static void rank(const Batch &batch, std::vector<double> &ranks);
+
+    /*!
+        Ranks the positions of a single path
+    */
+    static void rank(std::span<const double> lat,
+                     std::span<const double> lon,
+                     std::span<double> ranks);
+
+private:
+    struct Scratch
+    {
+        std::vector<unsigned char> keep;
+        std::vector<double> values;
+        std::vector<std::pair<size_t, size_t>> ranges;
+        std::vector<size_t> previous;
+        std::vector<size_t> next;
+        std::vector<std::pair<double, size_t>> heap;
+    };
+
+    static void forEachPath(size_t paths, const std::function<void(size_t path, Scratch &scratch)> &function);
+    static size_t simplify(std::span<double> lat,
+                           std::span<double> lon,
+                           double epsilon,
+                           Algorithm algorithm,
+                           Scratch &scratch);
+    static void rank(std::span<const double> lat,
+                     std::span<const double> lon,
+                     std::span<double> ranks,
+                     Scratch &scratch);
+    static size_t douglasPeucker(std::span<double> lat,
+                                 std::span<double> lon,
+                                 double epsilon,
+                                 Scratch &scratch);
+    static size_t visvalingam(std::span<double> lat,
+                              std::span<double> lon,
+                              double epsilon,
+                              Scratch &scratch);
+    static size_t compact(std::span<double> lat,
+                          std::span<double> lon,
+                          const std::vector<unsigned char> &keep);
+};
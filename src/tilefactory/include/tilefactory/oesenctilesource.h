@@ -1,17 +1,21 @@
 #pragma once
 
+#include <future>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "itilesource.h"
 #include "oesenc/chartfile.h"
+#include "tilefactory/catalog.h"
 #include "tilefactory/chart.h"
 
 #include "tilefactory_export.h"
 
-class Catalog;
+class ChartCache;
+class TileContainer;
 
 class TILEFACTORY_EXPORT OesencTileSource : public ITileSource
 {
@@ -20,30 +24,99 @@ public:
                      std::string_view name,
                      std::string_view baseTileDir);
 
+    /*!
+        Creates the source from headers already read from the catalog, without
+        opening the chart
+    */
+    OesencTileSource(Catalog *catalogue,
+                     const Catalog::ChartHeader &header,
+                     std::string_view baseTileDir);
+
     bool isValid() const;
     ~OesencTileSource();
     GeoRect extent() const override;
     int scale() const override { return m_scale; }
     std::shared_ptr<Chart> create(const GeoRect &boundingBox, int pixelsPerLongitude) override;
+    std::vector<std::shared_ptr<Chart>> createMany(const std::vector<GeoRect> &boundingBoxes,
+                                                   int pixelsPerLongitude) override;
+
+    /*!
+        Derived tiles are kept in the tile container of the chart next to
+        the tiles they are derived from
+    */
+    std::shared_ptr<Chart> derivedTile(const std::string &key) override;
+    std::shared_ptr<Chart> storeDerivedTile(const std::string &key, capnp::MessageBuilder *message) override;
+
+    /*!
+        Sets the on-disk format of internal charts. Must be called before any
+        tiles are requested. Files cached in another format are not reused.
+        Tiles are always stored unpacked in the tile container of the chart.
+    */
+    void setFileFormat(Chart::Format format);
+
+    /*!
+        Enables building deep zoom tiles from an already cached ancestor tile
+        instead of from the entire chart
+    */
+    void setCascadeEnabled(bool enabled);
+
+    /*!
+        Returns the cache of opened internal charts shared by all tile sources
+    */
+    static ChartCache &chartCache();
 
 private:
-    bool convertChartToInternalFormat(float lineEpsilon, int pixelsPerLon);
+    /*!
+        Decodes the source chart and writes it undecimated to the internal
+        format, with every vertex ranked for simplification
+
+        This is the only place where the chart is read through the catalog
+        (and thereby oexserverd). It happens at most once per chart, and the
+        result serves tiles at every resolution.
+    */
+    bool convertChartToNativeFormat();
     void readOesencMetaData(const oesenc::ChartFile *chart);
     static GeoRect fromOesencRect(const oesenc::Rect &src);
+    static ChartClipper::Config clipConfig(const GeoRect &boundingBox, int pixelsPerLongitude);
+
+    /*!
+        Returns the line simplification tolerance for a tile. Zero means that
+        the tile keeps every vertex since the tile resolution exceeds the
+        precision of the chart itself.
+    */
+    float lineEpsilon(const ChartClipper::Config &config) const;
+
+    /*!
+        Returns the closest cached ancestor tile holding undecimated data
+
+        Such a tile contains everything needed to clip any of its descendants
+        that are also built from undecimated data.
+    */
+    std::shared_ptr<Chart> cachedAncestor(const GeoRect &boundingBox, int pixelsPerLongitude) const;
+
+    TileContainer &tileContainer() const;
 
     /*!
-        Generate tile data for the given boundingBox
+        Generate tile data for the given bounding boxes
 
-        The actual ChartFile will not be opened until the first call to this function
+        Tiles are clipped from a cached ancestor tile when possible and
+        otherwise from the ranked native chart. Each source is clipped to all
+        its tiles in one pass. The actual ChartFile will not be opened until
+        the first call to this function.
     */
-    std::shared_ptr<Chart> generateTile(const GeoRect &boundingBox, int pixelsPerLongitude);
-    std::unordered_map<std::string, std::shared_ptr<std::mutex>> m_tileMutexes;
-    std::mutex m_tileMutexesMutex;
+    std::vector<std::shared_ptr<Chart>> generateTiles(const std::vector<GeoRect> &boundingBoxes,
+                                                      int pixelsPerLongitude);
+    std::unordered_map<std::string, std::shared_future<std::shared_ptr<Chart>>> m_pendingTiles;
+    std::mutex m_pendingTilesMutex;
+    mutable std::unique_ptr<TileContainer> m_tiles;
+    mutable std::once_flag m_tilesOnce;
     std::string m_tileDir;
     std::string m_name;
     bool m_valid = false;
     GeoRect m_extent;
-    std::mutex m_internalChartMutex;
+    std::mutex m_nativeChartMutex;
     Catalog *m_catalogue = nullptr;
     int m_scale = 0;
+    bool m_cascadeEnabled = true;
+    Chart::Format m_fileFormat = Chart::Format::Unpacked;
 };
@@ -1,20 +1,29 @@
 #pragma once
 
+#include <atomic>
 #include <functional>
+#include <list>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "itilesource.h"
 #include "tilefactory/georect.h"
 #include "tilefactory/pos.h"
+#include "tilefactory/tileid.h"
 
 #include "tilefactory_export.h"
 
+class ExtentTree;
+
 class TILEFACTORY_EXPORT TileFactory
 {
 public:
-    TileFactory() = default;
+    TileFactory();
+    ~TileFactory();
 
     struct Tile
     {
@@ -57,11 +66,22 @@ public:
     */
     std::vector<Tile> tiles(const Pos &center, float pixelsPerLon, int width, int height);
 
+    /*!
+        Enables adaptive tiles
+
+        Tiles whose estimated vertex count exceeds the budget are replaced by
+        their four children, which then have a higher resolution than the
+        rest of the viewport. Estimates come from the tile data returned by
+        \ref tileData, of the tile itself or of its closest ancestor. Zero
+        disables splitting, which is the default.
+    */
+    void setTileVertexBudget(size_t budget);
+
     /*!
         Removes all chart sources.
 
-        This function may block if a source is currently beeing used by another
-        thread through \ref tileData.
+        Sources currently used by another thread through \ref tileData stay
+        alive until that call returns.
     */
     void clear();
 
@@ -70,8 +90,23 @@ public:
 
         This will trigger creation of the data if it is not already cached to
         disk. Therefore the function could take some time before it returns.
+
+        The charts that contribute to a tile are remembered the first time
+        the tile is composed. Later calls only open those charts, so charts
+        hidden under better scale charts are never opened again until the
+        sources or the chart settings change.
     */
     std::vector<std::shared_ptr<Chart>> tileData(const GeoRect &rect, double pixelsPerLongitude);
+
+    /*!
+        Returns tile data for several tiles at once
+
+        Requests are grouped by chart source so that each source can produce
+        all the tiles it contributes to from one pass over its data. The
+        result has the same order as rects.
+    */
+    std::vector<std::vector<std::shared_ptr<Chart>>> tileData(const std::vector<GeoRect> &rects,
+                                                              double pixelsPerLongitude);
     std::vector<TileFactory::ChartInfo> chartInfo(const GeoRect &rect, double pixelsPerLongitude);
 
     void setUpdateCallback(std::function<void(void)> updateCallback) { m_updateCallback = updateCallback; }
@@ -86,16 +121,82 @@ public:
     std::optional<GeoRect> totalExtent();
 
 private:
+    /*!
+        Immutable snapshot of the sources
+
+        Readers load the current snapshot without locking. Writers copy it,
+        modify the copy and publish it, so a snapshot never changes once
+        published.
+    */
+    struct Sources
+    {
+        // Sorted by scale, most detailed first
+        std::vector<Source> sources;
+
+        // Extents of sources, shared by snapshots that only differ in
+        // which sources are enabled
+        std::shared_ptr<const ExtentTree> extents;
+    };
+
     std::vector<Source> sourceCandidates(const GeoRect &rect, double pixelsPerLon);
     bool chartEnabledForTile(const std::string &chart, const std::string &tileId) const;
     bool hasSource(const std::string &id);
-    static std::vector<GeoRect> tilesInViewport(const GeoRect &rect, int zoom);
+
+    /*!
+        Returns the charts that contributed to the tile the last time it was
+        composed, or nothing if the tile has no valid composition plan.
+    */
+    std::optional<std::vector<std::string>> compositionPlan(const std::string &tileId,
+                                                            uint64_t &generation);
+    void setCompositionPlan(const std::string &tileId,
+                            std::vector<std::string> charts,
+                            uint64_t generation);
+    void invalidateCompositionPlans();
+
+    /*!
+        Removes what each chart of a tile has below the coverage of the charts
+        before it. The charts are in order of priority.
+
+        Trimmed tiles are stored by the source of the chart, so a tile is
+        trimmed once per composition and later calls read it back.
+    */
+    static std::vector<std::shared_ptr<Chart>> trimOverdraw(const GeoRect &rect,
+                                                            const std::string &tileId,
+                                                            const std::vector<Source> &sources,
+                                                            const std::vector<std::shared_ptr<Chart>> &charts);
+    static std::vector<TileId> tilesInViewport(const GeoRect &rect, int zoom);
+
+    /*!
+        Appends the tile, or its descendants where the tile is too dense
+    */
+    void appendAdaptiveTile(std::vector<TileId> &tileIds, const TileId &tileId, int depth, size_t budget) const;
+    size_t vertexEstimate(const TileId &tileId) const;
+    void setVertexCount(const std::string &tileId, size_t count, uint64_t generation);
     std::function<void(void)> m_updateCallback;
     std::function<void(std::vector<GeoRect> roi)> m_chartsChangedCb;
     TileDataChangedCallback m_tileDataChangedCallback;
-    std::vector<Source> m_sources;
+    std::atomic<std::shared_ptr<const Sources>> m_sources;
+
+    // Serializes writers of m_sources
     std::mutex m_sourcesMutex;
-    std::vector<GeoRect> m_previousTileLocations;
+    std::vector<TileId> m_previousTileLocations;
     std::vector<TileFactory::Tile> m_previousTiles;
+    std::mutex m_previousTilesMutex;
     std::unordered_map<std::string, TileSettings> m_tileSettings;
+    std::unordered_map<std::string, std::vector<std::string>> m_compositionPlans;
+    uint64_t m_compositionPlansGeneration = 0;
+    std::mutex m_compositionPlansMutex;
+    std::atomic<size_t> m_tileVertexBudget = 0;
+
+    struct VertexCount
+    {
+        size_t count = 0;
+        std::list<std::string>::iterator order;
+    };
+
+    // Vertex counts of generated tiles, least recently generated first in
+    // m_vertexCountOrder
+    std::unordered_map<std::string, VertexCount> m_vertexCounts;
+    std::list<std::string> m_vertexCountOrder;
+    mutable std::mutex m_vertexCountsMutex;
 };
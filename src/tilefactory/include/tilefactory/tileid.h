@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "tilefactory/georect.h"
+#include "tilefactory/pos.h"
+
+#include "tilefactory_export.h"
+
+/*!
+    Address of a tile in the web mercator tile pyramid
+
+    Tiles are addressed by zoom level and column/row (z/x/y) where row 0 is
+    northmost. Parents, children and neighbors are found by arithmetic on the
+    address alone.
+*/
+class TILEFACTORY_EXPORT TileId
+{
+public:
+    TileId() = default;
+    TileId(int zoom, int x, int y);
+
+    /*!
+        Returns the tile at the given zoom level containing pos
+    */
+    static TileId fromPos(const Pos &pos, int zoom);
+    static std::optional<TileId> fromQuadKey(std::string_view quadKey);
+
+    int zoom() const { return m_zoom; }
+    int x() const { return m_x; }
+    int y() const { return m_y; }
+    GeoRect boundingBox() const;
+    TileId parent() const;
+    std::array<TileId, 4> children() const;
+
+    /*!
+        Returns the tile dx columns and dy rows away. Columns wrap around the
+        antimeridian while rows are clamped at the poles.
+    */
+    TileId neighbor(int dx, int dy) const;
+
+    /*!
+        Returns the quadkey of the tile. Tiles within a parent share the
+        quadkey of the parent as prefix.
+    */
+    std::string quadKey() const;
+
+    /*!
+        Returns the tile as "z-x-y" which is used as tile id throughout the
+        tilefactory
+    */
+    std::string toString() const;
+
+    bool operator==(const TileId &other) const = default;
+
+private:
+    int m_zoom = 0;
+    int m_x = 0;
+    int m_y = 0;
+};
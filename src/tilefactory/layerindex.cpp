@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "layerindex.h"
+
+namespace {
+constexpr int maxGridSize = 64;
+
+int toCell(double value, double min, double span, int cells)
+{
+    if (span <= 0) {
+        return 0;
+    }
+
+    int cell = static_cast<int>((value - min) / span * cells);
+    return std::clamp(cell, 0, cells - 1);
+}
+
+constexpr int keyBits = 16;
+constexpr uint32_t axisMax = (1u << keyBits) - 1;
+
+// Cells at this depth are returned whole instead of being split further
+constexpr int maxKeyDepth = 8;
+
+uint32_t toAxis(double value, double min, double span)
+{
+    if (span <= 0) {
+        return 0;
+    }
+
+    const double axis = std::floor((value - min) / span * axisMax);
+    return static_cast<uint32_t>(std::clamp(axis, 0.0, static_cast<double>(axisMax)));
+}
+
+uint32_t spreadBits(uint32_t value)
+{
+    value &= 0xffff;
+    value = (value | (value << 8)) & 0x00ff00ff;
+    value = (value | (value << 4)) & 0x0f0f0f0f;
+    value = (value | (value << 2)) & 0x33333333;
+    value = (value | (value << 1)) & 0x55555555;
+    return value;
+}
+
+uint32_t mortonKey(uint32_t x, uint32_t y)
+{
+    return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+uint32_t lowerBound(const capnp::List<uint32_t>::Reader &keys, uint64_t key)
+{
+    uint32_t first = 0;
+    uint32_t count = keys.size();
+
+    while (count > 0) {
+        const uint32_t step = count / 2;
+        if (keys[first + step] < key) {
+            first += step + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+
+    return first;
+}
+
+struct AxisBox
+{
+    uint32_t minX = 0;
+    uint32_t maxX = 0;
+    uint32_t minY = 0;
+    uint32_t maxY = 0;
+};
+
+/*!
+    Appends the points in the quadtree cell at x, y that may be inside box.
+    Children are visited in key order, so the appended indexes stay sorted.
+*/
+void appendPoints(const capnp::List<uint32_t>::Reader &keys,
+                  const AxisBox &box,
+                  uint32_t x,
+                  uint32_t y,
+                  int depth,
+                  std::vector<uint32_t> &result)
+{
+    const int shift = keyBits - depth;
+    const uint32_t last = (1u << shift) - 1;
+
+    if (x > box.maxX || x + last < box.minX || y > box.maxY || y + last < box.minY) {
+        return;
+    }
+
+    const uint64_t firstKey = mortonKey(x, y);
+    const uint32_t first = lowerBound(keys, firstKey);
+    const uint32_t end = lowerBound(keys, firstKey + (uint64_t(1) << (2 * shift)));
+
+    if (first == end) {
+        return;
+    }
+
+    const bool inside = x >= box.minX && x + last <= box.maxX && y >= box.minY && y + last <= box.maxY;
+
+    if (inside || depth == maxKeyDepth) {
+        for (uint32_t i = first; i < end; i++) {
+            result.push_back(i);
+        }
+        return;
+    }
+
+    const uint32_t half = 1u << (shift - 1);
+    appendPoints(keys, box, x, y, depth + 1, result);
+    appendPoints(keys, box, x + half, y, depth + 1, result);
+    appendPoints(keys, box, x, y + half, depth + 1, result);
+    appendPoints(keys, box, x + half, y + half, depth + 1, result);
+}
+}
+
+GeoRect LayerIndex::toGeoRect(const ChartData::BoundingBox::Reader &src)
+{
+    return GeoRect(src.getTop(), src.getBottom(), src.getLeft(), src.getRight());
+}
+
+void LayerIndex::fromGeoRect(ChartData::BoundingBox::Builder dst, const GeoRect &src)
+{
+    dst.setTop(src.top());
+    dst.setBottom(src.bottom());
+    dst.setLeft(src.left());
+    dst.setRight(src.right());
+}
+
+LayerIndex::CellRange LayerIndex::cellRange(const GeoRect &extent, int rows, int columns, const GeoRect &rect)
+{
+    CellRange range;
+    range.firstColumn = toCell(rect.left(), extent.left(), extent.width(), columns);
+    range.lastColumn = toCell(rect.right(), extent.left(), extent.width(), columns);
+    range.firstRow = toCell(rect.bottom(), extent.bottom(), extent.height(), rows);
+    range.lastRow = toCell(rect.top(), extent.bottom(), extent.height(), rows);
+    return range;
+}
+
+void LayerIndex::build(ChartData::GridIndex::Builder dst, const std::vector<GeoRect> &boxes)
+{
+    GeoRect extent;
+
+    for (const GeoRect &box : boxes) {
+        extent = extent.united(box);
+    }
+
+    // Aim for roughly one item per cell
+    const int gridSize = std::clamp(static_cast<int>(std::sqrt(boxes.size())), 1, maxGridSize);
+    const int rows = gridSize;
+    const int columns = gridSize;
+
+    fromGeoRect(dst.initBoundingBox(), extent);
+    dst.setRows(static_cast<uint16_t>(rows));
+    dst.setColumns(static_cast<uint16_t>(columns));
+
+    std::vector<uint32_t> counts(rows * columns + 1, 0);
+
+    for (const GeoRect &box : boxes) {
+        if (box.isNull()) {
+            continue;
+        }
+
+        CellRange range = cellRange(extent, rows, columns, box);
+        for (int row = range.firstRow; row <= range.lastRow; row++) {
+            for (int column = range.firstColumn; column <= range.lastColumn; column++) {
+                counts[row * columns + column + 1]++;
+            }
+        }
+    }
+
+    for (size_t i = 1; i < counts.size(); i++) {
+        counts[i] += counts[i - 1];
+    }
+
+    capnp::List<uint32_t>::Builder cellOffsets = dst.initCellOffsets(static_cast<unsigned int>(counts.size()));
+    for (unsigned int i = 0; i < counts.size(); i++) {
+        cellOffsets.set(i, counts[i]);
+    }
+
+    capnp::List<uint32_t>::Builder items = dst.initItems(counts.back());
+    std::vector<uint32_t> fill(counts.begin(), counts.end() - 1);
+
+    for (uint32_t item = 0; item < boxes.size(); item++) {
+        const GeoRect &box = boxes[item];
+
+        if (box.isNull()) {
+            continue;
+        }
+
+        CellRange range = cellRange(extent, rows, columns, box);
+        for (int row = range.firstRow; row <= range.lastRow; row++) {
+            for (int column = range.firstColumn; column <= range.lastColumn; column++) {
+                items.set(fill[row * columns + column]++, item);
+            }
+        }
+    }
+}
+
+std::vector<uint32_t> LayerIndex::query(const ChartData::GridIndex::Reader &index,
+                                        const GeoRect &rect)
+{
+    const GeoRect extent = toGeoRect(index.getBoundingBox());
+    const int rows = index.getRows();
+    const int columns = index.getColumns();
+
+    if (rows == 0 || columns == 0 || !extent.intersects(rect)) {
+        return {};
+    }
+
+    const capnp::List<uint32_t>::Reader cellOffsets = index.getCellOffsets();
+    const capnp::List<uint32_t>::Reader items = index.getItems();
+
+    if (cellOffsets.size() != static_cast<unsigned int>(rows * columns + 1)) {
+        return {};
+    }
+
+    std::vector<uint32_t> result;
+    CellRange range = cellRange(extent, rows, columns, rect);
+
+    for (int row = range.firstRow; row <= range.lastRow; row++) {
+        for (int column = range.firstColumn; column <= range.lastColumn; column++) {
+            const int cell = row * columns + column;
+            for (uint32_t i = cellOffsets[cell]; i < cellOffsets[cell + 1]; i++) {
+                result.push_back(items[i]);
+            }
+        }
+    }
+
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+
+    return result;
+}
+
+GeoRect LayerIndex::pointExtent(const std::vector<Pos> &positions)
+{
+    if (positions.empty()) {
+        return GeoRect();
+    }
+
+    double top = positions.front().lat();
+    double bottom = top;
+    double left = positions.front().lon();
+    double right = left;
+
+    for (const Pos &pos : positions) {
+        top = std::max(top, pos.lat());
+        bottom = std::min(bottom, pos.lat());
+        left = std::min(left, pos.lon());
+        right = std::max(right, pos.lon());
+    }
+
+    return GeoRect(top, bottom, left, right);
+}
+
+std::vector<uint32_t> LayerIndex::pointKeys(const std::vector<Pos> &positions, const GeoRect &extent)
+{
+    std::vector<uint32_t> keys;
+    keys.reserve(positions.size());
+
+    for (const Pos &pos : positions) {
+        keys.push_back(mortonKey(toAxis(pos.lon(), extent.left(), extent.width()),
+                                 toAxis(pos.lat(), extent.bottom(), extent.height())));
+    }
+
+    return keys;
+}
+
+void LayerIndex::buildPoints(ChartData::PointIndex::Builder dst,
+                             const GeoRect &extent,
+                             const std::vector<uint32_t> &keys)
+{
+    assert(std::is_sorted(keys.begin(), keys.end()));
+
+    fromGeoRect(dst.initBoundingBox(), extent);
+
+    capnp::List<uint32_t>::Builder dstKeys = dst.initKeys(static_cast<unsigned int>(keys.size()));
+    for (unsigned int i = 0; i < keys.size(); i++) {
+        dstKeys.set(i, keys[i]);
+    }
+}
+
+std::vector<uint32_t> LayerIndex::queryPoints(const ChartData::PointIndex::Reader &index,
+                                              const GeoRect &rect)
+{
+    const GeoRect extent = toGeoRect(index.getBoundingBox());
+    const capnp::List<uint32_t>::Reader keys = index.getKeys();
+
+    // The extent of a single point is empty, so GeoRect::intersects() can not be used
+    if (keys.size() == 0
+        || rect.left() > extent.right() || rect.right() < extent.left()
+        || rect.bottom() > extent.top() || rect.top() < extent.bottom()) {
+        return {};
+    }
+
+    AxisBox box;
+    box.minX = toAxis(rect.left(), extent.left(), extent.width());
+    box.maxX = toAxis(rect.right(), extent.left(), extent.width());
+    box.minY = toAxis(rect.bottom(), extent.bottom(), extent.height());
+    box.maxY = toAxis(rect.top(), extent.bottom(), extent.height());
+
+    std::vector<uint32_t> result;
+    appendPoints(keys, box, 0, 0, 0, result);
+    return result;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+
+#include "chartdata.capnp.h"
+#include "tilefactory/georect.h"
+#include "tilefactory/pos.h"
+
+/*!
+    Builds and queries the per layer grid index stored in internal charts
+
+    The index lets tile clipping visit only the items that may overlap the
+    tile instead of every item in the layer.
+*/
+class LayerIndex
+{
+public:
+    static void build(ChartData::GridIndex::Builder dst, const std::vector<GeoRect> &boxes);
+
+    /*!
+        Returns the sorted indexes of the items whose bounding box may
+        intersect the given rectangle
+    */
+    static std::vector<uint32_t> query(const ChartData::GridIndex::Reader &index,
+                                       const GeoRect &rect);
+
+    /*!
+        Returns the smallest rectangle enclosing the positions
+    */
+    static GeoRect pointExtent(const std::vector<Pos> &positions);
+
+    /*!
+        Returns the Morton key of every position within extent. Items sorted
+        by key keep nearby points next to each other.
+    */
+    static std::vector<uint32_t> pointKeys(const std::vector<Pos> &positions, const GeoRect &extent);
+
+    static void buildPoints(ChartData::PointIndex::Builder dst,
+                            const GeoRect &extent,
+                            const std::vector<uint32_t> &keys);
+
+    /*!
+        Returns the sorted indexes of the points that may be inside the given
+        rectangle. The indexes form a few contiguous runs found by binary
+        searching the keys of the quadtree cells overlapping the rectangle.
+    */
+    static std::vector<uint32_t> queryPoints(const ChartData::PointIndex::Reader &index,
+                                             const GeoRect &rect);
+
+    static GeoRect toGeoRect(const ChartData::BoundingBox::Reader &src);
+    static void fromGeoRect(ChartData::BoundingBox::Builder dst, const GeoRect &src);
+
+private:
+    struct CellRange
+    {
+        int firstRow = 0;
+        int lastRow = 0;
+        int firstColumn = 0;
+        int lastColumn = 0;
+    };
+
+    static CellRange cellRange(const GeoRect &extent, int rows, int columns, const GeoRect &rect);
+};
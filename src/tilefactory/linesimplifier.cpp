@@ -0,0 +1,344 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+#include "tilefactory/linesimplifier.h"
+#include "workerpool.h"
+
+namespace {
+constexpr size_t pathsPerChunk = 64;
+
+/*!
+    Writes the squared distance from each position to the segment from
+    (lat0, lon0) to (lat1, lon1). The projection onto the segment is clamped
+    to its ends, so positions beyond an end are measured to that end. The
+    loops have no branches so that the compiler can vectorize them.
+*/
+void segmentDistances(const double *lat, const double *lon, size_t count,
+                      double lat0, double lon0, double lat1, double lon1,
+                      double *distances)
+{
+    const double dLat = lat1 - lat0;
+    const double dLon = lon1 - lon0;
+    const double lengthSquared = dLat * dLat + dLon * dLon;
+
+    // A closed ring starts and ends at the same position. The distance is
+    // then measured to that position.
+    if (lengthSquared == 0) {
+        for (size_t i = 0; i < count; i++) {
+            const double pLat = lat[i] - lat0;
+            const double pLon = lon[i] - lon0;
+            distances[i] = pLat * pLat + pLon * pLon;
+        }
+        return;
+    }
+
+    const double inverseLengthSquared = 1.0 / lengthSquared;
+
+    for (size_t i = 0; i < count; i++) {
+        const double pLat = lat[i] - lat0;
+        const double pLon = lon[i] - lon0;
+        const double projection = (pLat * dLat + pLon * dLon) * inverseLengthSquared;
+
+        // Clamps the projection to [0, 1] with arithmetic only. Comparisons
+        // keep the compiler from vectorizing while floating point traps are
+        // honoured.
+        const double t = 0.5 * (std::abs(projection) - std::abs(projection - 1) + 1);
+        const double eLat = pLat - t * dLat;
+        const double eLon = pLon - t * dLon;
+        distances[i] = eLat * eLat + eLon * eLon;
+    }
+}
+
+double triangleArea(const double *lat, const double *lon, size_t a, size_t b, size_t c)
+{
+    return 0.5 * std::abs((lon[a] - lon[c]) * (lat[b] - lat[a]) - (lon[a] - lon[b]) * (lat[c] - lat[a]));
+}
+
+/*!
+    Writes the area of the triangle formed by each inner position and its
+    neighbours to areas[1] up to areas[count - 2]
+*/
+void triangleAreas(const double *lat, const double *lon, size_t count, double *areas)
+{
+    for (size_t i = 1; i + 1 < count; i++) {
+        areas[i] = 0.5 * std::abs((lon[i - 1] - lon[i + 1]) * (lat[i] - lat[i - 1])
+                                  - (lon[i - 1] - lon[i]) * (lat[i + 1] - lat[i - 1]));
+    }
+}
+}
+
+size_t LineSimplifier::Batch::beginPath()
+{
+    offsets.push_back(lat.size());
+    sizes.push_back(0);
+    return offsets.size() - 1;
+}
+
+void LineSimplifier::Batch::append(const Pos &pos)
+{
+    assert(!sizes.empty());
+    lat.push_back(pos.lat());
+    lon.push_back(pos.lon());
+    sizes.back()++;
+}
+
+std::vector<Pos> LineSimplifier::Batch::path(size_t index) const
+{
+    std::vector<Pos> positions;
+    positions.reserve(sizes[index]);
+
+    for (size_t i = offsets[index]; i < offsets[index] + sizes[index]; i++) {
+        positions.push_back(Pos(lat[i], lon[i]));
+    }
+
+    return positions;
+}
+
+void LineSimplifier::simplify(Batch &batch, double epsilon, Algorithm algorithm)
+{
+    forEachPath(batch.size(), [&](size_t i, Scratch &scratch) {
+        std::span<double> lat(batch.lat.data() + batch.offsets[i], batch.sizes[i]);
+        std::span<double> lon(batch.lon.data() + batch.offsets[i], batch.sizes[i]);
+        batch.sizes[i] = simplify(lat, lon, epsilon, algorithm, scratch);
+    });
+}
+
+void LineSimplifier::rank(const Batch &batch, std::vector<double> &ranks)
+{
+    ranks.assign(batch.lat.size(), std::numeric_limits<double>::infinity());
+
+    forEachPath(batch.size(), [&](size_t i, Scratch &scratch) {
+        std::span<const double> lat(batch.lat.data() + batch.offsets[i], batch.sizes[i]);
+        std::span<const double> lon(batch.lon.data() + batch.offsets[i], batch.sizes[i]);
+        rank(lat, lon, std::span<double>(ranks.data() + batch.offsets[i], batch.sizes[i]), scratch);
+    });
+}
+
+void LineSimplifier::forEachPath(size_t paths, const std::function<void(size_t path, Scratch &scratch)> &function)
+{
+    const size_t chunks = (paths + pathsPerChunk - 1) / pathsPerChunk;
+
+    WorkerPool::instance().forEach(chunks, [&](size_t chunk) {
+        Scratch scratch;
+        const size_t end = std::min((chunk + 1) * pathsPerChunk, paths);
+
+        for (size_t i = chunk * pathsPerChunk; i < end; i++) {
+            function(i, scratch);
+        }
+    });
+}
+
+size_t LineSimplifier::simplify(std::span<double> lat,
+                                std::span<double> lon,
+                                double epsilon,
+                                Algorithm algorithm)
+{
+    Scratch scratch;
+    return simplify(lat, lon, epsilon, algorithm, scratch);
+}
+
+size_t LineSimplifier::simplify(std::span<double> lat,
+                                std::span<double> lon,
+                                double epsilon,
+                                Algorithm algorithm,
+                                Scratch &scratch)
+{
+    assert(lat.size() == lon.size());
+
+    if (lat.size() < 3 || epsilon <= 0) {
+        return lat.size();
+    }
+
+    switch (algorithm) {
+    case Algorithm::DouglasPeucker:
+        return douglasPeucker(lat, lon, epsilon, scratch);
+    case Algorithm::Visvalingam:
+        return visvalingam(lat, lon, epsilon, scratch);
+    }
+
+    return lat.size();
+}
+
+void LineSimplifier::rank(std::span<const double> lat,
+                          std::span<const double> lon,
+                          std::span<double> ranks)
+{
+    Scratch scratch;
+    rank(lat, lon, ranks, scratch);
+}
+
+void LineSimplifier::rank(std::span<const double> lat,
+                          std::span<const double> lon,
+                          std::span<double> ranks,
+                          Scratch &scratch)
+{
+    assert(lat.size() == lon.size());
+    assert(lat.size() == ranks.size());
+
+    const size_t size = lat.size();
+    std::fill(ranks.begin(), ranks.end(), std::numeric_limits<double>::infinity());
+
+    if (size < 3) {
+        return;
+    }
+
+    // The same splits as douglasPeucker() but without a tolerance to stop at
+    scratch.values.resize(size);
+    scratch.ranges.clear();
+    scratch.ranges.push_back({ 0, size - 1 });
+
+    while (!scratch.ranges.empty()) {
+        const auto [first, last] = scratch.ranges.back();
+        scratch.ranges.pop_back();
+
+        if (last - first < 2) {
+            continue;
+        }
+
+        const size_t count = last - first - 1;
+        double *distances = scratch.values.data();
+        segmentDistances(lat.data() + first + 1, lon.data() + first + 1, count,
+                         lat[first], lon[first], lat[last], lon[last],
+                         distances);
+
+        const size_t farthest = std::max_element(distances, distances + count) - distances;
+        const size_t split = first + 1 + farthest;
+
+        // A position drops out together with the range it splits. The end of
+        // the range that was split last has the lower rank and bounds it.
+        ranks[split] = std::min(std::sqrt(distances[farthest]), std::min(ranks[first], ranks[last]));
+        scratch.ranges.push_back({ first, split });
+        scratch.ranges.push_back({ split, last });
+    }
+}
+
+size_t LineSimplifier::douglasPeucker(std::span<double> lat,
+                                      std::span<double> lon,
+                                      double epsilon,
+                                      Scratch &scratch)
+{
+    const size_t size = lat.size();
+
+    scratch.keep.assign(size, 0);
+    scratch.keep.front() = 1;
+    scratch.keep.back() = 1;
+    scratch.values.resize(size);
+    scratch.ranges.clear();
+    scratch.ranges.push_back({ 0, size - 1 });
+
+    while (!scratch.ranges.empty()) {
+        const auto [first, last] = scratch.ranges.back();
+        scratch.ranges.pop_back();
+
+        if (last - first < 2) {
+            continue;
+        }
+
+        const size_t count = last - first - 1;
+        double *distances = scratch.values.data();
+        segmentDistances(lat.data() + first + 1, lon.data() + first + 1, count,
+                         lat[first], lon[first], lat[last], lon[last],
+                         distances);
+
+        const size_t farthest = std::max_element(distances, distances + count) - distances;
+
+        // Compared like rank() so that a position ranked exactly at epsilon
+        // drops out here too. Squaring epsilon instead may round it either way.
+        if (std::sqrt(distances[farthest]) > epsilon) {
+            const size_t split = first + 1 + farthest;
+            scratch.keep[split] = 1;
+            scratch.ranges.push_back({ first, split });
+            scratch.ranges.push_back({ split, last });
+        }
+    }
+
+    return compact(lat, lon, scratch.keep);
+}
+
+size_t LineSimplifier::visvalingam(std::span<double> lat,
+                                   std::span<double> lon,
+                                   double epsilon,
+                                   Scratch &scratch)
+{
+    const size_t size = lat.size();
+    const double threshold = epsilon * epsilon;
+
+    std::vector<double> &areas = scratch.values;
+    areas.resize(size);
+    triangleAreas(lat.data(), lon.data(), size, areas.data());
+
+    scratch.keep.assign(size, 1);
+    scratch.previous.resize(size);
+    scratch.next.resize(size);
+    scratch.heap.clear();
+
+    for (size_t i = 0; i < size; i++) {
+        scratch.previous[i] = i - 1;
+        scratch.next[i] = i + 1;
+    }
+
+    for (size_t i = 1; i + 1 < size; i++) {
+        scratch.heap.push_back({ areas[i], i });
+    }
+
+    const auto greater = std::greater<std::pair<double, size_t>>();
+    std::make_heap(scratch.heap.begin(), scratch.heap.end(), greater);
+
+    while (!scratch.heap.empty()) {
+        std::pop_heap(scratch.heap.begin(), scratch.heap.end(), greater);
+        const auto [area, i] = scratch.heap.back();
+        scratch.heap.pop_back();
+
+        // Entries are not updated in the heap. Skip the outdated ones.
+        if (!scratch.keep[i] || area != areas[i]) {
+            continue;
+        }
+
+        if (area >= threshold) {
+            break;
+        }
+
+        scratch.keep[i] = 0;
+        const size_t previous = scratch.previous[i];
+        const size_t next = scratch.next[i];
+        scratch.next[previous] = next;
+        scratch.previous[next] = previous;
+
+        // The area of a neighbour never drops below the area just removed so
+        // that positions are removed in order of significance
+        for (size_t neighbour : { previous, next }) {
+            if (neighbour == 0 || neighbour == size - 1) {
+                continue;
+            }
+
+            areas[neighbour] = std::max(area, triangleArea(lat.data(), lon.data(),
+                                                           scratch.previous[neighbour],
+                                                           neighbour,
+                                                           scratch.next[neighbour]));
+            scratch.heap.push_back({ areas[neighbour], neighbour });
+            std::push_heap(scratch.heap.begin(), scratch.heap.end(), greater);
+        }
+    }
+
+    return compact(lat, lon, scratch.keep);
+}
+
+size_t LineSimplifier::compact(std::span<double> lat,
+                               std::span<double> lon,
+                               const std::vector<unsigned char> &keep)
+{
+    size_t kept = 0;
+
+    for (size_t i = 0; i < lat.size(); i++) {
+        if (keep[i]) {
+            lat[kept] = lat[i];
+            lon[kept] = lon[i];
+            kept++;
+        }
+    }
+
+    return kept;
+}
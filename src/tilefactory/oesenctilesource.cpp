@@ -1,24 +1,37 @@
+#include <algorithm>
 #include <chrono>
 #include <filesystem>
+#include <future>
 #include <mutex>
 #include <random>
 #include <sstream>
 #include <thread>
-
-#include <tilefactory_rust/lib.rs.h>
+#include <unordered_map>
 
 #include "filehelper.h"
+#include "tilecontainer.h"
 #include "oesenc/serverreader.h"
 #include "tilefactory/catalog.h"
+#include "tilefactory/chartcache.h"
 #include "tilefactory/chartclipper.h"
 #include "tilefactory/mercator.h"
 #include "tilefactory/oesenctilesource.h"
+#include "tilefactory/tileid.h"
+#include "tilegrid.h"
 
 using namespace std;
 
 namespace {
 constexpr int clippingMarginInPixels = 6;
-mutex catalogueMutex;
+
+// Chart features are digitized with a precision of roughly this distance
+// at the compilation scale of the chart
+constexpr double chartPrecisionInMeters = 0.05e-3;
+constexpr double metersPerDegree = 111320;
+
+// Shared by all tile sources and worker threads
+constexpr size_t chartCacheBudgetInBytes = 512 * 1024 * 1024;
+ChartCache sharedChartCache(chartCacheBudgetInBytes);
 }
 
 OesencTileSource::OesencTileSource(Catalog *catalogue, string_view name,
@@ -27,8 +40,12 @@ OesencTileSource::OesencTileSource(Catalog *catalogue, string_view name,
     , m_tileDir(FileHelper::getTileDir(string(baseTileDir), Chart::typeId()))
     , m_catalogue(catalogue)
 {
-    lock_guard guard(catalogueMutex);
     auto stream = m_catalogue->openChart(name);
+
+    if (!stream) {
+        return;
+    }
+
     oesenc::ChartFile chart = oesenc::ChartFile(*stream);
 
     if (chart.readHeaders()) {
@@ -37,6 +54,18 @@ OesencTileSource::OesencTileSource(Catalog *catalogue, string_view name,
     }
 }
 
+OesencTileSource::OesencTileSource(Catalog *catalogue,
+                                   const Catalog::ChartHeader &header,
+                                   string_view baseTileDir)
+    : m_name(header.fileName)
+    , m_tileDir(FileHelper::getTileDir(string(baseTileDir), Chart::typeId()))
+    , m_valid(header.valid)
+    , m_extent(header.extent)
+    , m_catalogue(catalogue)
+    , m_scale(header.scale)
+{
+}
+
 void OesencTileSource::readOesencMetaData(const oesenc::ChartFile *chart)
 {
     assert(chart);
@@ -49,62 +78,53 @@ GeoRect OesencTileSource::fromOesencRect(const oesenc::Rect &src)
     return GeoRect(src.top(), src.bottom(), src.left(), src.right());
 }
 
-bool OesencTileSource::convertChartToInternalFormat(float lineEpsilon, int pixelsPerLon)
+bool OesencTileSource::convertChartToNativeFormat()
 {
-    std::string decimatedFileName = FileHelper::internalChartFileName(m_tileDir,
-                                                                      m_name,
-                                                                      pixelsPerLon);
+    std::string nativeFileName = FileHelper::nativeChartFileName(m_tileDir, m_name, m_fileFormat);
 
-    const lock_guard<mutex> lock(m_internalChartMutex);
+    const lock_guard<mutex> lock(m_nativeChartMutex);
 
-    if (filesystem::exists(decimatedFileName)) {
+    if (filesystem::exists(nativeFileName)) {
         return true;
     }
 
     std::unique_ptr<capnp::MallocMessageBuilder> capnpMessage;
 
-    using Line = vector<oesenc::Position>;
-
-    oesenc::ChartFile::Config oesencConfig;
-    oesencConfig.vectorEdgeDecimator = [=](const Line &line) -> Line {
-        if (line.size() < 2) {
-            return line;
-        }
+    {
+        shared_ptr<istream> stream = m_catalogue->openChart(m_name);
 
-        ::rust::Vec<tilefactory_rust::Pos> input;
-        input.reserve(line.size());
-        for (const oesenc::Position &pos : line) {
-            input.push_back({ pos.latitude(), pos.longitude() });
+        if (!stream) {
+            return false;
         }
 
-        ::rust::Vec<tilefactory_rust::Pos> simplified = tilefactory_rust::simplify(input, lineEpsilon);
+        unique_ptr<oesenc::ChartFile> oesencChart = make_unique<oesenc::ChartFile>(*stream);
 
-        for (const oesenc::Position &pos : line) {
-            input.push_back({ pos.latitude(), pos.longitude() });
+        if (!oesencChart->read()) {
+            return false;
         }
 
-        Line simplifiedLine;
-        simplifiedLine.reserve(simplified.size());
+        // The whole chart is parsed. Give the decryption session back to the
+        // catalog before the message is built.
+        stream.reset();
 
-        for (const tilefactory_rust::Pos &pos : simplified) {
-            simplifiedLine.push_back({ pos.x, pos.y });
-        }
+        readOesencMetaData(oesencChart.get());
 
-        return simplifiedLine;
-    };
+        Chart::S57Builder builder(m_extent, m_name, m_scale);
+        for (const oesenc::S57 &object : oesencChart->s57()) {
+            builder.add(object);
+        }
 
-    lock_guard guard(catalogueMutex);
-    shared_ptr<istream> stream = m_catalogue->openChart(m_name);
-    unique_ptr<oesenc::ChartFile> oesencChart = make_unique<oesenc::ChartFile>(*stream, oesencConfig);
+        // The parsed objects are no longer needed once they are in the
+        // message. Release them before the message is ranked.
+        oesencChart.reset();
+        std::unique_ptr<capnp::MallocMessageBuilder> decodedMessage = builder.finish();
 
-    if (!oesencChart->read()) {
-        return false;
+        // Ranked once here so that tiles of any resolution are simplified
+        // while they are clipped instead of from a file per resolution
+        capnpMessage = Chart::buildRanked(decodedMessage->getRoot<ChartData>().asReader());
     }
 
-    readOesencMetaData(oesencChart.get());
-    capnpMessage = Chart::buildFromS57(oesencChart->s57(), m_extent, m_name, m_scale);
-
-    filesystem::path targetPath = decimatedFileName;
+    filesystem::path targetPath = nativeFileName;
 
     if (!filesystem::exists(targetPath.parent_path())) {
         error_code errorCode;
@@ -113,11 +133,7 @@ bool OesencTileSource::convertChartToInternalFormat(float lineEpsilon, int pixel
         }
     }
 
-    if (!Chart::write(capnpMessage.get(), decimatedFileName)) {
-        return false;
-    }
-
-    return true;
+    return Chart::write(capnpMessage.get(), nativeFileName);
 }
 
 bool OesencTileSource::isValid() const
@@ -134,104 +150,291 @@ GeoRect OesencTileSource::extent() const
     return m_extent;
 }
 
+TileContainer &OesencTileSource::tileContainer() const
+{
+    // Opened on first use since the index of every chart would otherwise be
+    // loaded at startup
+    call_once(m_tilesOnce, [this]() {
+        m_tiles = make_unique<TileContainer>((filesystem::path(m_tileDir) / m_name).string());
+    });
+
+    return *m_tiles;
+}
+
+ChartCache &OesencTileSource::chartCache()
+{
+    return sharedChartCache;
+}
+
+void OesencTileSource::setFileFormat(Chart::Format format)
+{
+    m_fileFormat = format;
+}
+
+void OesencTileSource::setCascadeEnabled(bool enabled)
+{
+    m_cascadeEnabled = enabled;
+}
+
 shared_ptr<Chart> OesencTileSource::create(const GeoRect &boundingBox,
                                            int pixelsPerLongitude)
 {
-    const string id = FileHelper::tileId(boundingBox, pixelsPerLongitude);
+    return createMany({ boundingBox }, pixelsPerLongitude).front();
+}
+
+vector<shared_ptr<Chart>> OesencTileSource::createMany(const vector<GeoRect> &boundingBoxes,
+                                                       int pixelsPerLongitude)
+{
+    vector<string> ids;
+    ids.reserve(boundingBoxes.size());
+
+    for (const GeoRect &boundingBox : boundingBoxes) {
+        ids.push_back(FileHelper::tileId(boundingBox, pixelsPerLongitude));
+    }
+
+    // Tiles already being produced for another caller are shared with that
+    // caller. The remaining ones are produced here and handed to anyone
+    // asking for them meanwhile.
+    vector<shared_future<shared_ptr<Chart>>> futures(boundingBoxes.size());
+    vector<size_t> owned;
+    vector<promise<shared_ptr<Chart>>> promises;
 
-    shared_ptr<mutex> tileMutex;
     {
-        lock_guard guard(m_tileMutexesMutex);
-        auto it = m_tileMutexes.find(id);
-        if (it == m_tileMutexes.end()) {
-            m_tileMutexes[id] = make_shared<mutex>();
+        lock_guard guard(m_pendingTilesMutex);
+        for (size_t i = 0; i < boundingBoxes.size(); i++) {
+            auto it = m_pendingTiles.find(ids[i]);
+            if (it != m_pendingTiles.end()) {
+                futures[i] = it->second;
+                continue;
+            }
+
+            promises.emplace_back();
+            futures[i] = promises.back().get_future().share();
+            m_pendingTiles[ids[i]] = futures[i];
+            owned.push_back(i);
         }
-        tileMutex = m_tileMutexes[id];
     }
 
-    lock_guard tileGuard(*tileMutex.get());
-    string tilefile = FileHelper::tileFileName(m_tileDir, m_name, id);
+    vector<shared_ptr<Chart>> producedTiles(owned.size());
+    exception_ptr error;
+
+    try {
+        vector<size_t> missing;
+
+        for (size_t j = 0; j < owned.size(); j++) {
+            const string &id = ids[owned[j]];
+
+            if (tileContainer().contains(id)) {
+                producedTiles[j] = tileContainer().read(id);
 
-    if (filesystem::exists(tilefile)) {
-        shared_ptr<Chart> tile = Chart::open(tilefile);
+                if (!producedTiles[j]) {
+                    cerr << "Failed to create chart from tile " << id << " of " << m_name << endl;
+                }
+            }
+
+            // Tiles that could not be read back are generated again
+            if (!producedTiles[j]) {
+                missing.push_back(j);
+            }
+        }
+
+        if (!missing.empty()) {
+            vector<GeoRect> missingBoxes;
+            for (size_t j : missing) {
+                missingBoxes.push_back(boundingBoxes[owned[j]]);
+            }
+
+            vector<shared_ptr<Chart>> generated = generateTiles(missingBoxes, pixelsPerLongitude);
+
+            for (size_t k = 0; k < generated.size(); k++) {
+                producedTiles[missing[k]] = generated[k];
+            }
+        }
+    } catch (...) {
+        // Waiting callers must not be left hanging
+        error = current_exception();
+    }
 
-        if (!tile) {
-            cerr << "Failed to create chart from: " << tilefile << endl;
-            return {};
+    {
+        lock_guard guard(m_pendingTilesMutex);
+        for (size_t j = 0; j < owned.size(); j++) {
+            if (error) {
+                promises[j].set_exception(error);
+            } else {
+                promises[j].set_value(producedTiles[j]);
+            }
+            m_pendingTiles.erase(ids[owned[j]]);
         }
+    }
+
+    if (error) {
+        rethrow_exception(error);
+    }
+
+    // Tiles owned by other callers are waited for only after all tiles owned
+    // here are fulfilled so that overlapping batches cannot deadlock
+    vector<shared_ptr<Chart>> tiles;
+    tiles.reserve(futures.size());
+
+    for (const shared_future<shared_ptr<Chart>> &future : futures) {
+        tiles.push_back(future.get());
+    }
+
+    return tiles;
+}
+
+shared_ptr<Chart> OesencTileSource::derivedTile(const string &key)
+{
+    if (!tileContainer().contains(key)) {
+        return {};
+    }
+
+    return tileContainer().read(key);
+}
 
-        lock_guard guard(m_tileMutexesMutex);
-        m_tileMutexes.erase(id);
-        return tile;
+shared_ptr<Chart> OesencTileSource::storeDerivedTile(const string &key, capnp::MessageBuilder *message)
+{
+    if (!tileContainer().write(key, message)) {
+        cerr << "Failed to write tile " << key << " of " << m_name << endl;
+        return Chart::fromMessage(*message);
     }
 
-    auto tile = generateTile(boundingBox, pixelsPerLongitude);
-    lock_guard guard(m_tileMutexesMutex);
-    m_tileMutexes.erase(id);
-    return tile;
+    return tileContainer().read(key);
 }
 
-shared_ptr<Chart> OesencTileSource::generateTile(const GeoRect &boundingBox,
-                                                 int pixelsPerLongitude)
+ChartClipper::Config OesencTileSource::clipConfig(const GeoRect &boundingBox,
+                                                  int pixelsPerLongitude)
 {
-    double longitudeMargin = Mercator::mercatorWidthInverse(boundingBox.left(),
+    ChartClipper::Config config;
+    config.box = boundingBox;
+    config.maxPixelsPerLongitude = pixelsPerLongitude;
+
+    config.longitudeMargin = Mercator::mercatorWidthInverse(boundingBox.left(),
                                                             clippingMarginInPixels,
                                                             pixelsPerLongitude)
         - boundingBox.left();
-    double latitudeMargin = boundingBox.top()
+    config.latitudeMargin = boundingBox.top()
         - Mercator::mercatorHeightInverse(boundingBox.top(),
                                           clippingMarginInPixels,
                                           pixelsPerLongitude);
 
-    double latitudeResolution = boundingBox.top()
+    config.latitudeResolution = boundingBox.top()
         - Mercator::mercatorHeightInverse(boundingBox.top(),
                                           2,
                                           pixelsPerLongitude);
-    double longitudeResolution = Mercator::mercatorWidthInverse(boundingBox.left(),
+    config.longitudeResolution = Mercator::mercatorWidthInverse(boundingBox.left(),
                                                                 2,
                                                                 pixelsPerLongitude)
         - boundingBox.left();
 
-    string internalChartFileName = FileHelper::internalChartFileName(m_tileDir,
-                                                                     m_name,
-                                                                     pixelsPerLongitude);
+    return config;
+}
+
+float OesencTileSource::lineEpsilon(const ChartClipper::Config &config) const
+{
+    float epsilon = 2 * min(config.longitudeResolution, config.latitudeResolution);
+
+    if (epsilon < m_scale * chartPrecisionInMeters / metersPerDegree) {
+        return 0;
+    }
+
+    return epsilon;
+}
+
+shared_ptr<Chart> OesencTileSource::cachedAncestor(const GeoRect &boundingBox,
+                                                   int pixelsPerLongitude) const
+{
+    const Pos center((boundingBox.top() + boundingBox.bottom()) / 2,
+                     (boundingBox.left() + boundingBox.right()) / 2);
+    TileId tileId = TileId::fromPos(center, TileGrid::zoom(pixelsPerLongitude));
+
+    while (tileId.zoom() > 0) {
+        tileId = tileId.parent();
+        const int ancestorPixelsPerLon = TileGrid::pixelsPerLon(tileId.zoom());
+
+        // Tiles further up are decimated and lack detail needed here
+        if (lineEpsilon(clipConfig(tileId.boundingBox(), ancestorPixelsPerLon)) > 0) {
+            break;
+        }
 
-    if (!filesystem::exists(internalChartFileName)) {
-        float epsilon = 2 * min(longitudeResolution, latitudeResolution);
-        if (!convertChartToInternalFormat(epsilon, pixelsPerLongitude)) {
-            cerr << "Failed to convert chart to internal format" << endl;
-            return {};
+        const string id = tileId.toString();
+
+        if (!tileContainer().contains(id)) {
+            continue;
+        }
+
+        shared_ptr<Chart> ancestor = tileContainer().read(id);
+
+        if (ancestor && ancestor->root().getLineEpsilon() == 0) {
+            return ancestor;
         }
     }
 
-    shared_ptr<Chart> entireChart = Chart::open(internalChartFileName);
+    return {};
+}
 
-    if (!entireChart) {
-        cerr << "Failed to open " << internalChartFileName << endl;
-        return {};
+vector<shared_ptr<Chart>> OesencTileSource::generateTiles(const vector<GeoRect> &boundingBoxes,
+                                                          int pixelsPerLongitude)
+{
+    vector<shared_ptr<Chart>> tiles(boundingBoxes.size());
+    vector<ChartClipper::Config> clipConfigs;
+    vector<shared_ptr<Chart>> sourceCharts(boundingBoxes.size());
+    shared_ptr<Chart> nativeChart;
+
+    for (size_t i = 0; i < boundingBoxes.size(); i++) {
+        clipConfigs.push_back(clipConfig(boundingBoxes[i], pixelsPerLongitude));
+        clipConfigs.back().lineEpsilon = lineEpsilon(clipConfigs.back());
+
+        if (clipConfigs.back().lineEpsilon == 0 && m_cascadeEnabled) {
+            sourceCharts[i] = cachedAncestor(boundingBoxes[i], pixelsPerLongitude);
+            if (sourceCharts[i]) {
+                continue;
+            }
+        }
+
+        if (!nativeChart && convertChartToNativeFormat()) {
+            string nativeFileName = FileHelper::nativeChartFileName(m_tileDir, m_name, m_fileFormat);
+            nativeChart = sharedChartCache.open(nativeFileName);
+            if (!nativeChart) {
+                cerr << "Failed to open " << nativeFileName << endl;
+            }
+        }
+
+        sourceCharts[i] = nativeChart;
+    }
+
+    // Clip all tiles sharing the same source chart in one pass
+    unordered_map<const Chart *, vector<size_t>> tilesBySource;
+    for (size_t i = 0; i < boundingBoxes.size(); i++) {
+        if (sourceCharts[i]) {
+            tilesBySource[sourceCharts[i].get()].push_back(i);
+        }
     }
 
-    assert(entireChart->nativeScale() != 0);
+    for (const auto &[sourceChart, indexes] : tilesBySource) {
+        assert(sourceChart->nativeScale() != 0);
+
+        vector<ChartClipper::Config> configs;
+        for (size_t i : indexes) {
+            configs.push_back(clipConfigs[i]);
+        }
 
-    string id = FileHelper::tileId(boundingBox, pixelsPerLongitude);
-    string tileFile = FileHelper::tileFileName(m_tileDir, m_name, id);
+        vector<unique_ptr<capnp::MallocMessageBuilder>> clippedCharts = sourceChart->buildClipped(configs);
 
-    ChartClipper::Config clipConfig;
-    clipConfig.box = boundingBox;
-    clipConfig.latitudeMargin = latitudeMargin;
-    clipConfig.longitudeMargin = longitudeMargin;
-    clipConfig.longitudeResolution = longitudeResolution;
-    clipConfig.latitudeResolution = latitudeResolution;
-    clipConfig.maxPixelsPerLongitude = pixelsPerLongitude;
+        assert(clippedCharts.size() == indexes.size());
 
-    unique_ptr<capnp::MallocMessageBuilder> clippedChart = entireChart->buildClipped(clipConfig);
+        for (size_t j = 0; j < indexes.size(); j++) {
+            const size_t i = indexes[j];
+            string id = FileHelper::tileId(boundingBoxes[i], pixelsPerLongitude);
 
-    assert(clippedChart);
+            if (!tileContainer().write(id, clippedCharts[j].get())) {
+                cerr << "Failed to write tile " << id << " of " << m_name << endl;
+                continue;
+            }
 
-    if (!Chart::write(clippedChart.get(), tileFile)) {
-        cerr << "Failed to write " << tileFile << endl;
-        return {};
+            tiles[i] = tileContainer().read(id);
+        }
     }
 
-    return Chart::open(tileFile);
+    return tiles;
 }
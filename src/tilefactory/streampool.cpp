@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <cassert>
+
+#include "streampool.h"
+
+StreamPool::StreamPool(std::vector<Session> sessions)
+    : m_sessions(std::move(sessions))
+    , m_state(std::make_shared<State>())
+{
+    m_state->busy.resize(m_sessions.size(), false);
+}
+
+size_t StreamPool::State::checkout()
+{
+    std::unique_lock lock(mutex);
+    const uint64_t ticket = nextTicket++;
+
+    // Only the oldest waiter may take a free session, so that a caller is
+    // never overtaken by callers that asked later
+    released.wait(lock, [this, ticket]() {
+        return ticket == servedTicket && std::find(busy.begin(), busy.end(), false) != busy.end();
+    });
+
+    const size_t session = std::distance(busy.begin(), std::find(busy.begin(), busy.end(), false));
+    busy[session] = true;
+    servedTicket++;
+
+    lock.unlock();
+
+    // The next waiter may be able to take another free session
+    released.notify_all();
+    return session;
+}
+
+void StreamPool::State::checkin(size_t session)
+{
+    {
+        std::lock_guard lock(mutex);
+        assert(busy[session]);
+        busy[session] = false;
+    }
+    released.notify_all();
+}
+
+std::shared_ptr<std::istream> StreamPool::open(const std::filesystem::path &file)
+{
+    if (m_sessions.empty()) {
+        return nullptr;
+    }
+
+    const size_t session = m_state->checkout();
+    std::shared_ptr<std::istream> stream;
+
+    try {
+        stream = m_sessions[session](file);
+    } catch (...) {
+        m_state->checkin(session);
+        throw;
+    }
+
+    if (!stream) {
+        m_state->checkin(session);
+        return nullptr;
+    }
+
+    // The returned pointer shares ownership of the stream and gives the
+    // session back once the caller is done with it
+    std::shared_ptr<State> state = m_state;
+    return std::shared_ptr<std::istream>(stream.get(), [stream, state, session](std::istream *) mutable {
+        stream.reset();
+        state->checkin(session);
+    });
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*!
+    Hands out chart streams from a fixed set of decryption sessions
+
+    Each session serves one stream at a time. A session is checked out when a
+    stream is opened and returned to the pool when the last reference to the
+    stream is released. Callers waiting for a session are served in the
+    order they asked.
+*/
+class StreamPool
+{
+public:
+    using Session = std::function<std::shared_ptr<std::istream>(const std::filesystem::path &file)>;
+
+    explicit StreamPool(std::vector<Session> sessions);
+
+    /*!
+        Opens the file through the next free session. Blocks until a session
+        is free.
+    */
+    std::shared_ptr<std::istream> open(const std::filesystem::path &file);
+    size_t size() const { return m_sessions.size(); }
+
+private:
+    // Shared with the open streams, which may outlive the pool
+    struct State
+    {
+        std::mutex mutex;
+        std::condition_variable released;
+        std::vector<bool> busy;
+        uint64_t nextTicket = 0;
+        uint64_t servedTicket = 0;
+
+        size_t checkout();
+        void checkin(size_t session);
+    };
+
+    std::vector<Session> m_sessions;
+    std::shared_ptr<State> m_state;
+};
@@ -0,0 +1,134 @@
+#include <cmath>
+
+#include <capnp/message.h>
+#include <gtest/gtest.h>
+
+#include "tilefactory/chart.h"
+#include "tilefactory/coordinates.h"
+
+namespace {
+std::vector<Pos> rectangle(double top, double bottom, double left, double right)
+{
+    return { Pos(bottom, left), Pos(bottom, right), Pos(top, right), Pos(top, left), Pos(bottom, left) };
+}
+
+double area(const std::vector<Pos> &ring)
+{
+    double sum = 0;
+    for (size_t i = 0; i < ring.size(); i++) {
+        const Pos &a = ring[i];
+        const Pos &b = ring[(i + 1) % ring.size()];
+        sum += a.lon() * b.lat() - b.lon() * a.lat();
+    }
+    return std::abs(sum) / 2;
+}
+
+double area(const ChartData::DepthArea::Reader &depthArea)
+{
+    double sum = 0;
+    for (const ChartData::Polygon::Reader &polygon : depthArea.getPolygons()) {
+        sum += area(Coordinates::toPositions(polygon.getMain()));
+        for (const ChartData::Path::Reader &hole : polygon.getHoles()) {
+            sum -= area(Coordinates::toPositions(hole));
+        }
+    }
+    return sum;
+}
+
+void setDepthArea(ChartData::DepthArea::Builder dst, float depth, const std::vector<Pos> &main)
+{
+    dst.setDepth(depth);
+    Coordinates::fromPositions(dst.initPolygons(1)[0].initMain(), main);
+}
+
+void setDepthContour(ChartData::DepthContour::Builder dst, const std::vector<Pos> &line)
+{
+    Coordinates::fromPositions(dst.initLines(1)[0].initPositions(), line);
+}
+
+void setSounding(ChartData::Sounding::Builder dst, float depth, const Pos &pos)
+{
+    dst.setDepth(depth);
+    Coordinates::fromPos(dst.initPosition(), pos);
+}
+
+/*
+    A chart with items partly inside, entirely inside and entirely outside
+    of hidden. None of the items have bounding boxes, like the items of a
+    clipped tile.
+*/
+std::shared_ptr<Chart> chart()
+{
+    capnp::MallocMessageBuilder message;
+    ChartData::Builder root = message.initRoot<ChartData>();
+
+    capnp::List<ChartData::DepthArea>::Builder depthAreas = root.initDepthAreas(3);
+    setDepthArea(depthAreas[0], 5, rectangle(60, 59, 10, 12));
+    setDepthArea(depthAreas[1], 10, rectangle(60.3, 60.1, 11.5, 12.5));
+    setDepthArea(depthAreas[2], 20, rectangle(58.9, 58.5, 10, 11));
+
+    capnp::List<ChartData::DepthContour>::Builder depthContours = root.initDepthContours(3);
+    setDepthContour(depthContours[0], { Pos(59.7, 10), Pos(59.7, 12) });
+    setDepthContour(depthContours[1], { Pos(60.2, 11.5), Pos(60.2, 12.5) });
+    setDepthContour(depthContours[2], { Pos(59.2, 10), Pos(59.2, 12) });
+
+    capnp::List<ChartData::Sounding>::Builder soundings = root.initSoundings(3);
+    setSounding(soundings[0], 1, Pos(59.7, 11.5));
+    setSounding(soundings[1], 2, Pos(59.2, 11.5));
+    setSounding(soundings[2], 3, Pos(59.7, 10.5));
+
+    return Chart::fromMessage(message);
+}
+
+// Latitudes 59.5 to 60.5 and longitudes 11 to 13
+const Clipper2Lib::PathsD hidden = { { { 11, 59.5 }, { 13, 59.5 }, { 13, 60.5 }, { 11, 60.5 } } };
+}
+
+TEST(ChartTest, TrimmedPolygonsAreCutAlongHiddenArea)
+{
+    std::unique_ptr<capnp::MallocMessageBuilder> message = chart()->buildTrimmed(hidden);
+    const std::shared_ptr<Chart> trimmed = Chart::fromMessage(*message);
+
+    // The area hidden entirely is left out, and the others keep their depth
+    ASSERT_EQ(trimmed->depthAreas().size(), 2u);
+    EXPECT_EQ(trimmed->depthAreas()[0].getDepth(), 5);
+    EXPECT_EQ(trimmed->depthAreas()[1].getDepth(), 20);
+
+    // One degree by half a degree is cut off
+    EXPECT_NEAR(area(trimmed->depthAreas()[0]), 1.5, 1e-6);
+    EXPECT_NEAR(area(trimmed->depthAreas()[1]), 0.4, 1e-6);
+}
+
+TEST(ChartTest, TrimmedLinesAreCutWhereTheyEnterHiddenArea)
+{
+    std::unique_ptr<capnp::MallocMessageBuilder> message = chart()->buildTrimmed(hidden);
+    const std::shared_ptr<Chart> trimmed = Chart::fromMessage(*message);
+
+    ASSERT_EQ(trimmed->depthContours().size(), 2u);
+
+    const capnp::List<ChartData::Line>::Reader cut = trimmed->depthContours()[0].getLines();
+    ASSERT_EQ(cut.size(), 1u);
+    const std::vector<Pos> line = Coordinates::toPositions(cut[0].getPositions());
+    ASSERT_EQ(line.size(), 2u);
+
+    const double west = std::min(line[0].lon(), line[1].lon());
+    const double east = std::max(line[0].lon(), line[1].lon());
+    EXPECT_NEAR(west, 10, 1e-6);
+    EXPECT_NEAR(east, 11, 1e-6);
+    EXPECT_NEAR(line[0].lat(), 59.7, 1e-6);
+    EXPECT_NEAR(line[1].lat(), 59.7, 1e-6);
+
+    // The line outside is kept as it is
+    EXPECT_EQ(Coordinates::toPositions(trimmed->depthContours()[1].getLines()[0].getPositions()),
+              Coordinates::toPositions(chart()->depthContours()[2].getLines()[0].getPositions()));
+}
+
+TEST(ChartTest, TrimmedPointsInsideHiddenAreaAreLeftOut)
+{
+    std::unique_ptr<capnp::MallocMessageBuilder> message = chart()->buildTrimmed(hidden);
+    const std::shared_ptr<Chart> trimmed = Chart::fromMessage(*message);
+
+    ASSERT_EQ(trimmed->soundings().size(), 2u);
+    EXPECT_EQ(trimmed->soundings()[0].getDepth(), 2);
+    EXPECT_EQ(trimmed->soundings()[1].getDepth(), 3);
+}
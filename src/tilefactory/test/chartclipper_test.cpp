@@ -0,0 +1,171 @@
+#include <cmath>
+#include <numbers>
+#include <random>
+
+#include <capnp/message.h>
+#include <gtest/gtest.h>
+
+#include "tilefactory/chartclipper.h"
+#include "tilefactory/coordinates.h"
+
+namespace {
+constexpr int tileSize = 256;
+
+const GeoRect extent(60, 59, 10, 12);
+const Pos center(59.5, 11);
+
+// A ring around center with a random radius at each of count angles
+std::vector<Pos> randomRing(std::mt19937 &random, const Pos &center, double minRadius, double maxRadius, int count)
+{
+    std::uniform_real_distribution<double> radius(minRadius, maxRadius);
+    std::vector<Pos> ring;
+
+    for (int i = 0; i < count; i++) {
+        const double angle = 2 * std::numbers::pi * i / count;
+        const double r = radius(random);
+        ring.emplace_back(center.lat() + r * std::sin(angle), center.lon() + 2 * r * std::cos(angle));
+    }
+    ring.push_back(ring.front());
+
+    return ring;
+}
+
+double area(const ChartClipper::Line &line)
+{
+    double sum = 0;
+    for (size_t i = 0; i < line.size(); i++) {
+        const Pos &a = line[i];
+        const Pos &b = line[(i + 1) % line.size()];
+        sum += a.lon() * b.lat() - b.lon() * a.lat();
+    }
+    return std::abs(sum) / 2;
+}
+
+double area(const std::vector<ChartClipper::Polygon> &polygons)
+{
+    double sum = 0;
+    for (const ChartClipper::Polygon &polygon : polygons) {
+        sum += area(polygon.main);
+        for (const ChartClipper::Line &hole : polygon.holes) {
+            sum -= area(hole);
+        }
+    }
+    return sum;
+}
+
+class PolygonMessage
+{
+public:
+    PolygonMessage(const std::vector<Pos> &main, const std::vector<std::vector<Pos>> &holes)
+    {
+        ChartData::Polygon::Builder polygon = m_message.initRoot<ChartData::Polygon>();
+        Coordinates::fromPositions(polygon.initMain(), main);
+
+        capnp::List<ChartData::Path>::Builder dstHoles = polygon.initHoles(static_cast<unsigned int>(holes.size()));
+        for (unsigned int i = 0; i < holes.size(); i++) {
+            Coordinates::fromPositions(dstHoles[i], holes[i]);
+        }
+    }
+
+    ChartData::Polygon::Reader reader() { return m_message.getRoot<ChartData::Polygon>().asReader(); }
+
+private:
+    capnp::MallocMessageBuilder m_message;
+};
+
+std::vector<ChartClipper::Config> tileConfigs(int tilesPerSide)
+{
+    std::vector<ChartClipper::Config> configs;
+    const double width = extent.width() / tilesPerSide;
+    const double height = extent.height() / tilesPerSide;
+
+    for (int row = 0; row < tilesPerSide; row++) {
+        for (int column = 0; column < tilesPerSide; column++) {
+            ChartClipper::Config config;
+            config.box = GeoRect(extent.top() - row * height,
+                                 extent.top() - (row + 1) * height,
+                                 extent.left() + column * width,
+                                 extent.left() + (column + 1) * width);
+            config.chartBoundingBox = extent;
+            config.longitudeResolution = width / tileSize;
+            config.latitudeResolution = height / tileSize;
+            config.longitudeMargin = 6 * config.longitudeResolution;
+            config.latitudeMargin = 6 * config.latitudeResolution;
+            configs.push_back(config);
+        }
+    }
+
+    return configs;
+}
+
+void expectSameArea(PolygonMessage &polygon)
+{
+    // From a single tile holding the whole polygon to tiles smaller than
+    // the holes
+    for (int tilesPerSide : { 1, 3, 8, 20 }) {
+        for (const ChartClipper::Config &config : tileConfigs(tilesPerSide)) {
+            const double expected = area(ChartClipper::clipPolygonGeneral(polygon.reader(), config));
+            const double actual = area(ChartClipper::clipPolygon(polygon.reader(), config));
+
+            // Holes are deflated by one grid unit, which is half a pixel, but
+            // not where they join the main contour
+            const double tolerance = 0.02 * config.box.width() * config.box.height();
+            EXPECT_NEAR(actual, expected, tolerance) << tilesPerSide << " tiles per side";
+        }
+    }
+}
+}
+
+TEST(ChartClipperTest, SameAreaAsGeneralClipping)
+{
+    std::mt19937 random(1);
+
+    for (int i = 0; i < 5; i++) {
+        const std::vector<Pos> main = randomRing(random, center, 0.35, 0.45, 60);
+
+        // Holes around the center, apart from each other
+        std::vector<std::vector<Pos>> holes;
+        for (int j = 0; j < 6; j++) {
+            const double angle = 2 * std::numbers::pi * j / 6;
+            const Pos holeCenter(center.lat() + 0.18 * std::sin(angle), center.lon() + 0.36 * std::cos(angle));
+            holes.push_back(randomRing(random, holeCenter, 0.03, 0.07, 12));
+        }
+
+        PolygonMessage polygon(main, holes);
+        expectSameArea(polygon);
+    }
+}
+
+TEST(ChartClipperTest, SameAreaWithHoleTouchingMainContour)
+{
+    std::mt19937 random(2);
+
+    std::vector<Pos> main = randomRing(random, center, 0.35, 0.45, 60);
+
+    // A hole sharing a position with the main contour, and one with an
+    // edge along it
+    const std::vector<Pos> touching = { main[0], Pos(main[0].lat() + 0.05, main[0].lon() - 0.2),
+                                        Pos(main[0].lat() - 0.05, main[0].lon() - 0.2), main[0] };
+    const std::vector<Pos> alongEdge = { main[15], main[16], Pos(center.lat() + 0.2, center.lon()), main[15] };
+    const std::vector<Pos> inside = randomRing(random, Pos(center.lat() - 0.15, center.lon()), 0.03, 0.07, 12);
+
+    PolygonMessage polygon(main, { touching, alongEdge, inside });
+    expectSameArea(polygon);
+}
+
+TEST(ChartClipperTest, RepeatedPositionsAreRemoved)
+{
+    std::vector<Pos> ring = { Pos(59.2, 10.5), Pos(59.2, 10.5), Pos(59.2, 11.5), Pos(59.8, 11.5),
+                              Pos(59.8, 11.5), Pos(59.8, 10.5), Pos(59.2, 10.5) };
+    PolygonMessage polygon(ring, {});
+
+    const ChartClipper::Config config = tileConfigs(1).front();
+    const std::vector<ChartClipper::Polygon> clipped = ChartClipper::clipPolygon(polygon.reader(), config);
+    ASSERT_EQ(clipped.size(), 1u);
+    EXPECT_EQ(clipped.front().main.size(), 4u);
+
+    // A ring of one position collapses
+    PolygonMessage collapsed({ Pos(59.5, 11), Pos(59.5, 11), Pos(59.5, 11) }, {});
+    EXPECT_TRUE(ChartClipper::clipPolygon(collapsed.reader(), config).empty());
+    EXPECT_TRUE(ChartClipper::clipPolygonGeneral(collapsed.reader(), config).empty());
+}
@@ -0,0 +1,180 @@
+#include <limits>
+#include <random>
+
+#include <capnp/message.h>
+#include <gtest/gtest.h>
+
+#include "tilefactory/coordinates.h"
+
+namespace {
+constexpr int32_t int32Min = std::numeric_limits<int32_t>::min();
+constexpr int32_t int32Max = std::numeric_limits<int32_t>::max();
+
+class PathMessage
+{
+public:
+    PathMessage(const std::vector<Pos> &positions, const std::vector<float> &ranks = {})
+    {
+        ChartData::Path::Builder path = m_message.initRoot<ChartData::Path>();
+        Coordinates::fromPositions(path, positions);
+
+        if (!ranks.empty()) {
+            capnp::List<float>::Builder dstRanks = path.initRanks(static_cast<unsigned int>(ranks.size()));
+            for (unsigned int i = 0; i < ranks.size(); i++) {
+                dstRanks.set(i, ranks[i]);
+            }
+        }
+    }
+
+    ChartData::Path::Reader reader() { return m_message.getRoot<ChartData::Path>().asReader(); }
+
+    std::vector<Pos> positions(double epsilon)
+    {
+        std::vector<Pos> positions;
+        for (const Pos &pos : Coordinates::Path(reader(), epsilon)) {
+            positions.push_back(pos);
+        }
+        return positions;
+    }
+
+private:
+    capnp::MallocMessageBuilder m_message;
+};
+
+Pos quantized(const Pos &pos)
+{
+    return Pos(Coordinates::dequantize(Coordinates::quantize(pos.lat())),
+               Coordinates::dequantize(Coordinates::quantize(pos.lon())));
+}
+
+Pos fromUnits(int32_t lat, int32_t lon)
+{
+    return Pos(Coordinates::dequantize(lat), Coordinates::dequantize(lon));
+}
+}
+
+TEST(CoordinatesTest, QuantizeRoundTrip)
+{
+    for (int32_t value : { int32Min, int32Min + 1, -1, 0, 1, 1800000000, int32Max - 1, int32Max }) {
+        EXPECT_EQ(Coordinates::quantize(Coordinates::dequantize(value)), value);
+    }
+
+    EXPECT_EQ(Coordinates::quantize(180), 1800000000);
+    EXPECT_EQ(Coordinates::quantize(-180), -1800000000);
+    EXPECT_EQ(Coordinates::quantize(0.5e-7 + 1e-12), 1);
+    EXPECT_EQ(Coordinates::quantize(1000), int32Max);
+    EXPECT_EQ(Coordinates::quantize(-1000), int32Min);
+}
+
+TEST(CoordinatesTest, PathRoundTrip)
+{
+    std::mt19937 random(1);
+    std::uniform_real_distribution<double> lat(-90, 90);
+    std::uniform_real_distribution<double> lon(-180, 180);
+
+    std::vector<Pos> positions;
+    std::vector<Pos> expected;
+    for (int i = 0; i < 1000; i++) {
+        positions.emplace_back(lat(random), lon(random));
+        expected.push_back(quantized(positions.back()));
+    }
+
+    PathMessage path(positions);
+    EXPECT_EQ(Coordinates::Path(path.reader()).size(), positions.size());
+    EXPECT_EQ(Coordinates::toPositions(path.reader()), expected);
+
+    for (size_t i = 0; i < positions.size(); i++) {
+        EXPECT_NEAR(expected[i].lat(), positions[i].lat(), 0.5e-7);
+        EXPECT_NEAR(expected[i].lon(), positions[i].lon(), 0.5e-7);
+    }
+}
+
+TEST(CoordinatesTest, PathRoundTripAtInt32Extremes)
+{
+    // Steps between the extremes wrap around in the deltas
+    const std::vector<Pos> positions = {
+        fromUnits(int32Min, int32Max),
+        fromUnits(int32Max, int32Min),
+        fromUnits(int32Max, int32Max),
+        fromUnits(int32Min, int32Min),
+        fromUnits(0, int32Min),
+        fromUnits(int32Max, 0),
+        fromUnits(-1, 1),
+    };
+
+    PathMessage path(positions);
+    EXPECT_EQ(Coordinates::toPositions(path.reader()), positions);
+}
+
+TEST(CoordinatesTest, ShortStepsEncodeToSmallValues)
+{
+    const std::vector<Pos> positions = {
+        fromUnits(5, -5),
+        fromUnits(6, -6),
+        fromUnits(6, -4),
+        fromUnits(int32Max, int32Min),
+        fromUnits(int32Min, int32Max),
+    };
+
+    PathMessage path(positions);
+    const capnp::List<uint32_t>::Reader coordinates = path.reader().getCoordinates();
+    ASSERT_EQ(coordinates.size(), 10u);
+
+    // Zigzag encoding maps 0, -1, 1, -2, 2 to 0, 1, 2, 3, 4
+    EXPECT_EQ(coordinates[0], 10u);
+    EXPECT_EQ(coordinates[1], 9u);
+    EXPECT_EQ(coordinates[2], 2u);
+    EXPECT_EQ(coordinates[3], 1u);
+    EXPECT_EQ(coordinates[4], 0u);
+    EXPECT_EQ(coordinates[5], 4u);
+
+    // The largest steps wrap around to a step of one unit
+    EXPECT_EQ(coordinates[8], 2u);
+    EXPECT_EQ(coordinates[9], 1u);
+}
+
+TEST(CoordinatesTest, EpsilonSkipsDroppedPositions)
+{
+    const float infinite = std::numeric_limits<float>::infinity();
+    const std::vector<Pos> positions = {
+        fromUnits(0, 0),
+        fromUnits(1, 10),
+        fromUnits(2, 20),
+        fromUnits(3, 30),
+        fromUnits(4, 40),
+        fromUnits(5, 50),
+    };
+
+    PathMessage path(positions, { infinite, 0.25f, 0.5f, 0.75f, 0.125f, infinite });
+
+    EXPECT_EQ(path.positions(0), positions);
+    EXPECT_EQ(path.positions(0.1), positions);
+
+    // Positions ranked exactly at epsilon drop out
+    EXPECT_EQ(path.positions(0.25), (std::vector<Pos> { positions[0], positions[2], positions[3], positions[5] }));
+    EXPECT_EQ(path.positions(0.5), (std::vector<Pos> { positions[0], positions[3], positions[5] }));
+    EXPECT_EQ(path.positions(1), (std::vector<Pos> { positions[0], positions[5] }));
+
+    // Ranks are stored as floats, so an epsilon converted from a float rank
+    // drops that position too
+    PathMessage decimal(positions, { infinite, 1e-4f, 1e-4f, 2e-4f, 1e-4f, infinite });
+    EXPECT_EQ(decimal.positions(static_cast<double>(1e-4f)), (std::vector<Pos> { positions[0], positions[3], positions[5] }));
+
+    // size() still counts all positions
+    EXPECT_EQ(Coordinates::Path(path.reader(), 1).size(), positions.size());
+}
+
+TEST(CoordinatesTest, EpsilonCanSkipEveryPosition)
+{
+    const std::vector<Pos> positions = { fromUnits(0, 0), fromUnits(1, 1), fromUnits(2, 2) };
+
+    PathMessage allDropped(positions, { 0.5f, 0.5f, 0.5f });
+    EXPECT_TRUE(allDropped.positions(1).empty());
+
+    PathMessage unranked(positions);
+    EXPECT_EQ(unranked.positions(1), positions);
+
+    PathMessage empty({});
+    EXPECT_TRUE(empty.positions(1).empty());
+    EXPECT_TRUE(Coordinates::Path(empty.reader()).empty());
+}
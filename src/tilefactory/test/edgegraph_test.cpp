@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "edgegraph.h"
+
+namespace {
+LineSimplifier::Batch batch(const std::vector<std::vector<Pos>> &paths)
+{
+    LineSimplifier::Batch batch;
+    for (const std::vector<Pos> &path : paths) {
+        batch.beginPath();
+        for (const Pos &pos : path) {
+            batch.append(pos);
+        }
+    }
+    return batch;
+}
+
+bool contains(const std::vector<Pos> &path, const Pos &pos)
+{
+    return std::find(path.begin(), path.end(), pos) != path.end();
+}
+
+// Tells whether two closed paths have the same positions in the same order,
+// starting anywhere
+bool sameRing(const std::vector<Pos> &a, const std::vector<Pos> &b)
+{
+    if (a.size() != b.size() || a.empty() || a.front() != a.back() || b.front() != b.back()) {
+        return false;
+    }
+
+    const size_t count = a.size() - 1;
+    for (size_t shift = 0; shift < count; shift++) {
+        bool equal = true;
+        for (size_t i = 0; i < count && equal; i++) {
+            equal = a[i] == b[(i + shift) % count];
+        }
+        if (equal) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Positions of path i ranked above epsilon
+std::vector<Pos> rankedAbove(const LineSimplifier::Batch &batch, const std::vector<double> &ranks, size_t i, double epsilon)
+{
+    std::vector<Pos> path;
+    for (size_t j = batch.offsets[i]; j < batch.offsets[i] + batch.sizes[i]; j++) {
+        if (ranks[j] > epsilon) {
+            path.emplace_back(batch.lat[j], batch.lon[j]);
+        }
+    }
+    return path;
+}
+
+// A wiggly border from a to b
+std::vector<Pos> randomBorder(std::mt19937 &random, const Pos &a, const Pos &b)
+{
+    std::normal_distribution<double> offset(0, 0.02);
+    std::vector<Pos> border = { a };
+
+    for (int i = 1; i < 20; i++) {
+        const double t = i / 20.;
+        border.emplace_back(a.lat() + t * (b.lat() - a.lat()) + offset(random),
+                            a.lon() + t * (b.lon() - a.lon()) + offset(random));
+    }
+
+    border.push_back(b);
+    return border;
+}
+
+void appendBorder(std::vector<Pos> &ring, const std::vector<Pos> &border, bool reversed)
+{
+    const std::vector<Pos> positions = reversed ? std::vector<Pos>(border.rbegin(), border.rend()) : border;
+    ring.insert(ring.end(), positions.begin() + (ring.empty() ? 0 : 1), positions.end());
+}
+
+/*
+    Cells of a grid whose borders are random walks between the grid corners.
+    Every inner border is shared by two cells.
+*/
+struct Cells
+{
+    static constexpr int size = 3;
+
+    Cells(std::mt19937 &random)
+    {
+        for (int row = 0; row <= size; row++) {
+            for (int column = 0; column <= size; column++) {
+                if (column < size) {
+                    horizontal[row][column] = randomBorder(random, Pos(row, column), Pos(row, column + 1));
+                }
+                if (row < size) {
+                    vertical[row][column] = randomBorder(random, Pos(row, column), Pos(row + 1, column));
+                }
+            }
+        }
+
+        for (int row = 0; row < size; row++) {
+            for (int column = 0; column < size; column++) {
+                std::vector<Pos> ring;
+                appendBorder(ring, horizontal[row][column], false);
+                appendBorder(ring, vertical[row][column + 1], false);
+                appendBorder(ring, horizontal[row + 1][column], true);
+                appendBorder(ring, vertical[row][column], true);
+                rings.push_back(ring);
+            }
+        }
+    }
+
+    std::vector<Pos> horizontal[size + 1][size];
+    std::vector<Pos> vertical[size][size + 1];
+    std::vector<std::vector<Pos>> rings;
+};
+
+// Squares sharing the border at latitude 1, walked in opposite directions
+const std::vector<Pos> south = { Pos(0, 0), Pos(0, 1), Pos(1, 1), Pos(1.1, 0.5), Pos(1, 0), Pos(0, 0) };
+const std::vector<Pos> north = { Pos(1, 0), Pos(1.1, 0.5), Pos(1, 1), Pos(2, 1), Pos(2, 0), Pos(1, 0) };
+}
+
+TEST(EdgeGraphTest, SharedBorderInOppositeDirectionsIsOneEdge)
+{
+    const EdgeGraph graph(batch({ south, north }));
+
+    // The shared border and the rest of each square
+    EXPECT_EQ(graph.edgeCount(), 3u);
+}
+
+TEST(EdgeGraphTest, SharedBorderIsSimplifiedAlike)
+{
+    const EdgeGraph graph(batch({ south, north }));
+
+    for (double epsilon : { 0.05, 0.2 }) {
+        const LineSimplifier::Batch simplified = graph.simplify(epsilon, LineSimplifier::Algorithm::DouglasPeucker);
+        const std::vector<Pos> southPath = simplified.path(0);
+        const std::vector<Pos> northPath = simplified.path(1);
+
+        EXPECT_EQ(contains(southPath, Pos(1.1, 0.5)), contains(northPath, Pos(1.1, 0.5))) << epsilon;
+        EXPECT_EQ(contains(southPath, Pos(1.1, 0.5)), epsilon < 0.1) << epsilon;
+
+        // Junctions are kept
+        for (const std::vector<Pos> &path : { southPath, northPath }) {
+            EXPECT_TRUE(contains(path, Pos(1, 0)));
+            EXPECT_TRUE(contains(path, Pos(1, 1)));
+        }
+    }
+}
+
+TEST(EdgeGraphTest, RingWithoutJunctionIsOneEdge)
+{
+    const std::vector<Pos> ring = { Pos(0, 0), Pos(0, 1), Pos(1, 1), Pos(1, 0), Pos(0, 0) };
+    const EdgeGraph graph(batch({ ring }));
+
+    EXPECT_EQ(graph.edgeCount(), 1u);
+
+    const LineSimplifier::Batch rebuilt = graph.simplify(0, LineSimplifier::Algorithm::DouglasPeucker);
+    ASSERT_EQ(rebuilt.size(), 1u);
+    EXPECT_TRUE(sameRing(rebuilt.path(0), ring));
+}
+
+TEST(EdgeGraphTest, EqualRingsWithOtherStartOrDirectionAreOneEdge)
+{
+    const std::vector<Pos> ring = { Pos(0, 0), Pos(0, 1), Pos(1, 1), Pos(1, 0), Pos(0, 0) };
+    const std::vector<Pos> rotated = { Pos(1, 1), Pos(1, 0), Pos(0, 0), Pos(0, 1), Pos(1, 1) };
+    const std::vector<Pos> reversed(ring.rbegin(), ring.rend());
+    const EdgeGraph graph(batch({ ring, rotated, reversed }));
+
+    EXPECT_EQ(graph.edgeCount(), 1u);
+
+    const LineSimplifier::Batch rebuilt = graph.simplify(0, LineSimplifier::Algorithm::DouglasPeucker);
+    ASSERT_EQ(rebuilt.size(), 3u);
+    EXPECT_TRUE(sameRing(rebuilt.path(0), ring));
+    EXPECT_TRUE(sameRing(rebuilt.path(1), rotated));
+    EXPECT_TRUE(sameRing(rebuilt.path(2), reversed));
+}
+
+TEST(EdgeGraphTest, OpenPathEndingOnInteriorVertexSplitsIt)
+{
+    const std::vector<Pos> line = { Pos(0, 0), Pos(0, 1), Pos(0, 2), Pos(0, 3) };
+    const std::vector<Pos> branch = { Pos(2, 2), Pos(1, 2), Pos(0, 2) };
+    const EdgeGraph graph(batch({ line, branch }));
+
+    // The line splits where the branch ends
+    EXPECT_EQ(graph.edgeCount(), 3u);
+
+    // All positions of the line are on one straight line, but the one where
+    // the branch ends is a junction and stays
+    const LineSimplifier::Batch simplified = graph.simplify(1, LineSimplifier::Algorithm::DouglasPeucker);
+    EXPECT_EQ(simplified.path(0), (std::vector<Pos> { Pos(0, 0), Pos(0, 2), Pos(0, 3) }));
+    EXPECT_EQ(simplified.path(1), (std::vector<Pos> { Pos(2, 2), Pos(0, 2) }));
+}
+
+TEST(EdgeGraphTest, ZeroEpsilonRebuildsInput)
+{
+    const std::vector<std::vector<Pos>> paths = {
+        south,
+        north,
+        { Pos(0, 0), Pos(0, 1), Pos(0, 2), Pos(0, 3) },
+        { Pos(2, 2), Pos(1, 2), Pos(0, 2) },
+        {},
+        { Pos(5, 5) },
+        { Pos(-1, -1), Pos(-1, 0) },
+        { Pos(0, 0), Pos(-1, 0), Pos(-1, -1), Pos(0, 0) },
+    };
+
+    for (LineSimplifier::Algorithm algorithm : { LineSimplifier::Algorithm::DouglasPeucker,
+                                                 LineSimplifier::Algorithm::Visvalingam }) {
+        const EdgeGraph graph(batch(paths));
+        const LineSimplifier::Batch rebuilt = graph.simplify(0, algorithm);
+        ASSERT_EQ(rebuilt.size(), paths.size());
+
+        for (size_t i = 0; i < paths.size(); i++) {
+            const std::vector<Pos> path = rebuilt.path(i);
+            const bool closed = paths[i].size() >= 4 && paths[i].front() == paths[i].back();
+
+            if (closed) {
+                EXPECT_TRUE(sameRing(path, paths[i])) << i;
+            } else {
+                EXPECT_EQ(path, paths[i]) << i;
+            }
+        }
+    }
+}
+
+TEST(EdgeGraphTest, RanksFollowRebuiltPaths)
+{
+    const EdgeGraph graph(batch({ south, north }));
+
+    std::vector<double> ranks;
+    const LineSimplifier::Batch ranked = graph.rank(ranks);
+    ASSERT_EQ(ranks.size(), ranked.lat.size());
+
+    for (size_t i = 0; i < ranks.size(); i++) {
+        const Pos pos(ranked.lat[i], ranked.lon[i]);
+        if (pos == Pos(1, 0) || pos == Pos(1, 1)) {
+            EXPECT_TRUE(std::isinf(ranks[i])) << pos;
+        }
+        if (pos == Pos(1.1, 0.5)) {
+            EXPECT_NEAR(ranks[i], 0.1, 1e-9);
+        }
+    }
+}
+
+TEST(EdgeGraphTest, RanksGiveSimplifiedPathsAtAnyEpsilon)
+{
+    std::mt19937 random(1);
+    const Cells cells(random);
+    const EdgeGraph graph(batch(cells.rings));
+
+    std::vector<double> ranks;
+    const LineSimplifier::Batch ranked = graph.rank(ranks);
+    ASSERT_EQ(ranked.size(), cells.rings.size());
+
+    for (double epsilon : { 1e-3, 0.01, 0.03, 0.1, 1. }) {
+        const LineSimplifier::Batch simplified = graph.simplify(epsilon, LineSimplifier::Algorithm::DouglasPeucker);
+
+        for (size_t i = 0; i < ranked.size(); i++) {
+            EXPECT_EQ(rankedAbove(ranked, ranks, i, epsilon), simplified.path(i)) << "path " << i << ", epsilon " << epsilon;
+        }
+    }
+}
+
+TEST(EdgeGraphTest, RankedNeighboursMeetAtAnyEpsilon)
+{
+    std::mt19937 random(2);
+    const Cells cells(random);
+    const EdgeGraph graph(batch(cells.rings));
+
+    std::vector<double> ranks;
+    const LineSimplifier::Batch ranked = graph.rank(ranks);
+
+    for (double epsilon : { 1e-3, 0.01, 0.03, 0.1, 1. }) {
+        std::vector<std::vector<Pos>> rings;
+        for (size_t i = 0; i < ranked.size(); i++) {
+            rings.push_back(rankedAbove(ranked, ranks, i, epsilon));
+        }
+
+        // Cells on either side of an inner border keep the same positions of
+        // it, and always its ends
+        for (int row = 0; row < Cells::size; row++) {
+            for (int column = 0; column < Cells::size; column++) {
+                const std::vector<Pos> &cell = rings[row * Cells::size + column];
+
+                if (row > 0) {
+                    const std::vector<Pos> &below = rings[(row - 1) * Cells::size + column];
+                    for (const Pos &pos : cells.horizontal[row][column]) {
+                        EXPECT_EQ(contains(cell, pos), contains(below, pos)) << pos << ", epsilon " << epsilon;
+                    }
+                    EXPECT_TRUE(contains(cell, Pos(row, column)));
+                    EXPECT_TRUE(contains(cell, Pos(row, column + 1)));
+                }
+
+                if (column > 0) {
+                    const std::vector<Pos> &left = rings[row * Cells::size + column - 1];
+                    for (const Pos &pos : cells.vertical[row][column]) {
+                        EXPECT_EQ(contains(cell, pos), contains(left, pos)) << pos << ", epsilon " << epsilon;
+                    }
+                    EXPECT_TRUE(contains(cell, Pos(row, column)));
+                    EXPECT_TRUE(contains(cell, Pos(row + 1, column)));
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,119 @@
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "extenttree.h"
+
+namespace {
+GeoRect randomRect(std::mt19937 &random, double maxSize)
+{
+    std::uniform_real_distribution<double> lat(-80, 80);
+    std::uniform_real_distribution<double> lon(-180, 180);
+    std::uniform_real_distribution<double> size(0, maxSize);
+
+    const double bottom = lat(random);
+    const double left = lon(random);
+    return GeoRect(bottom + size(random), bottom, left, left + size(random));
+}
+
+std::vector<uint32_t> scan(const std::vector<GeoRect> &extents, const GeoRect &rect)
+{
+    std::vector<uint32_t> result;
+    for (uint32_t i = 0; i < extents.size(); i++) {
+        if (extents[i].intersects(rect)) {
+            result.push_back(i);
+        }
+    }
+    return result;
+}
+}
+
+TEST(ExtentTreeTest, EmptyTree)
+{
+    const ExtentTree tree;
+
+    EXPECT_TRUE(tree.empty());
+    EXPECT_TRUE(tree.bounds().isNull());
+    EXPECT_TRUE(tree.query(GeoRect(10, -10, -10, 10)).empty());
+    EXPECT_FALSE(tree.intersects(GeoRect(10, -10, -10, 10)));
+    EXPECT_TRUE(ExtentTree(std::vector<GeoRect>()).empty());
+}
+
+// Sizes around the node capacity of 16, and beyond 16 x 16 so that the tree
+// has more than two levels
+TEST(ExtentTreeTest, QueryMatchesScan)
+{
+    std::mt19937 random(1);
+
+    for (size_t count : { 1, 15, 16, 17, 255, 256, 257, 5000 }) {
+        std::vector<GeoRect> extents;
+        for (size_t i = 0; i < count; i++) {
+            extents.push_back(randomRect(random, 10));
+        }
+
+        const ExtentTree tree(extents);
+        ASSERT_FALSE(tree.empty());
+
+        for (int i = 0; i < 500; i++) {
+            const GeoRect rect = randomRect(random, i % 2 == 0 ? 1 : 40);
+            const std::vector<uint32_t> expected = scan(extents, rect);
+
+            EXPECT_EQ(tree.query(rect), expected) << count << " extents";
+            EXPECT_EQ(tree.intersects(rect), !expected.empty()) << count << " extents";
+        }
+    }
+}
+
+TEST(ExtentTreeTest, QueryMatchesScanForTouchingAndDegenerateRects)
+{
+    std::mt19937 random(2);
+    std::vector<GeoRect> extents;
+
+    // A grid of touching cells, some of them squashed to lines
+    for (int lat = 0; lat < 30; lat++) {
+        for (int lon = 0; lon < 30; lon++) {
+            if ((lat + lon) % 7 == 0) {
+                extents.emplace_back(lat, lat, lon, lon + 1);
+            } else {
+                extents.emplace_back(lat + 1, lat, lon, lon + 1);
+            }
+        }
+    }
+
+    const ExtentTree tree(extents);
+
+    for (int i = 0; i < 500; i++) {
+        // Rects on the cell borders
+        std::uniform_int_distribution<int> coordinate(-1, 31);
+        const int lat = coordinate(random);
+        const int lon = coordinate(random);
+
+        for (const GeoRect &rect : { GeoRect(lat, lat, lon, lon),
+                                     GeoRect(lat + 2, lat, lon, lon),
+                                     GeoRect(lat, lat, lon, lon + 3) }) {
+            const std::vector<uint32_t> expected = scan(extents, rect);
+            EXPECT_EQ(tree.query(rect), expected);
+            EXPECT_EQ(tree.intersects(rect), !expected.empty());
+        }
+    }
+}
+
+TEST(ExtentTreeTest, BoundsEncloseAllExtents)
+{
+    std::mt19937 random(3);
+
+    for (size_t count : { 1, 17, 300 }) {
+        std::vector<GeoRect> extents;
+        GeoRect expected;
+        for (size_t i = 0; i < count; i++) {
+            extents.push_back(randomRect(random, 10));
+            expected = expected.united(extents.back());
+        }
+
+        const GeoRect bounds = ExtentTree(extents).bounds();
+        EXPECT_EQ(bounds.top(), expected.top());
+        EXPECT_EQ(bounds.bottom(), expected.bottom());
+        EXPECT_EQ(bounds.left(), expected.left());
+        EXPECT_EQ(bounds.right(), expected.right());
+    }
+}
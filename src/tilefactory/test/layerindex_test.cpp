@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <functional>
+#include <random>
+
+#include <capnp/message.h>
+#include <gtest/gtest.h>
+
+#include "layerindex.h"
+
+namespace {
+GeoRect randomRect(std::mt19937 &random, const GeoRect &area, double maxSize)
+{
+    std::uniform_real_distribution<double> lat(area.bottom(), area.top());
+    std::uniform_real_distribution<double> lon(area.left(), area.right());
+    std::uniform_real_distribution<double> size(0, maxSize);
+
+    const double bottom = lat(random);
+    const double left = lon(random);
+    return GeoRect(bottom + size(random), bottom, left, left + size(random));
+}
+
+GeoRect expanded(const GeoRect &rect, double lat, double lon)
+{
+    return GeoRect(rect.top() + lat, rect.bottom() - lat, rect.left() - lon, rect.right() + lon);
+}
+
+bool isSortedAndUnique(const std::vector<uint32_t> &items)
+{
+    return std::adjacent_find(items.begin(), items.end(), std::greater_equal<uint32_t>()) == items.end();
+}
+
+bool containsPoint(const GeoRect &rect, const Pos &pos)
+{
+    return pos.lat() >= rect.bottom() && pos.lat() <= rect.top()
+        && pos.lon() >= rect.left() && pos.lon() <= rect.right();
+}
+
+class GridIndex
+{
+public:
+    explicit GridIndex(const std::vector<GeoRect> &boxes)
+        : m_boxes(boxes)
+    {
+        LayerIndex::build(m_message.initRoot<ChartData::GridIndex>(), boxes);
+    }
+
+    std::vector<uint32_t> query(const GeoRect &rect)
+    {
+        return LayerIndex::query(m_message.getRoot<ChartData::GridIndex>().asReader(), rect);
+    }
+
+    /*!
+        Compares the query with a linear scan. Every box intersecting rect
+        must be found, and every box found must be within one grid cell of
+        rect.
+    */
+    void expectMatchesScan(const GeoRect &rect)
+    {
+        const std::vector<uint32_t> items = query(rect);
+        EXPECT_TRUE(isSortedAndUnique(items));
+
+        const ChartData::GridIndex::Reader index = m_message.getRoot<ChartData::GridIndex>().asReader();
+        const GeoRect extent = LayerIndex::toGeoRect(index.getBoundingBox());
+        const GeoRect near = expanded(rect, extent.height() / index.getRows(), extent.width() / index.getColumns());
+
+        for (uint32_t item = 0; item < m_boxes.size(); item++) {
+            const bool found = std::binary_search(items.begin(), items.end(), item);
+
+            if (m_boxes[item].intersects(rect)) {
+                EXPECT_TRUE(found) << "item " << item;
+            }
+            if (found) {
+                EXPECT_TRUE(m_boxes[item].intersects(near)) << "item " << item;
+            }
+        }
+    }
+
+private:
+    capnp::MallocMessageBuilder m_message;
+    std::vector<GeoRect> m_boxes;
+};
+
+class PointIndex
+{
+public:
+    explicit PointIndex(std::vector<Pos> positions)
+    {
+        m_extent = LayerIndex::pointExtent(positions);
+        std::vector<uint32_t> keys = LayerIndex::pointKeys(positions, m_extent);
+
+        // Items are stored in key order
+        std::vector<size_t> order(positions.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&keys](size_t a, size_t b) {
+            return keys[a] < keys[b];
+        });
+
+        std::vector<uint32_t> sortedKeys;
+        for (size_t i : order) {
+            m_positions.push_back(positions[i]);
+            sortedKeys.push_back(keys[i]);
+        }
+
+        LayerIndex::buildPoints(m_message.initRoot<ChartData::PointIndex>(), m_extent, sortedKeys);
+    }
+
+    std::vector<uint32_t> query(const GeoRect &rect)
+    {
+        return LayerIndex::queryPoints(m_message.getRoot<ChartData::PointIndex>().asReader(), rect);
+    }
+
+    /*!
+        Compares the query with a linear scan. Every point inside rect must
+        be found, and every point found must be within one quadtree cell at
+        the deepest level searched of rect.
+    */
+    void expectMatchesScan(const GeoRect &rect)
+    {
+        const std::vector<uint32_t> items = query(rect);
+        EXPECT_TRUE(isSortedAndUnique(items));
+
+        const GeoRect near = expanded(rect, m_extent.height() / 256, m_extent.width() / 256);
+
+        for (uint32_t item = 0; item < m_positions.size(); item++) {
+            const bool found = std::binary_search(items.begin(), items.end(), item);
+
+            if (containsPoint(rect, m_positions[item])) {
+                EXPECT_TRUE(found) << "item " << item;
+            }
+            if (found) {
+                EXPECT_TRUE(containsPoint(near, m_positions[item])) << "item " << item;
+            }
+        }
+    }
+
+    const GeoRect &extent() const { return m_extent; }
+
+private:
+    capnp::MallocMessageBuilder m_message;
+    std::vector<Pos> m_positions;
+    GeoRect m_extent;
+};
+
+const GeoRect area(60, 59, 10, 12);
+}
+
+TEST(LayerIndexTest, QueryMatchesScanOfRandomBoxes)
+{
+    std::mt19937 random(1);
+
+    for (size_t count : { 1, 10, 1000, 10000 }) {
+        std::vector<GeoRect> boxes;
+        for (size_t i = 0; i < count; i++) {
+            boxes.push_back(randomRect(random, area, 0.05));
+        }
+
+        GridIndex index(boxes);
+        for (int i = 0; i < 200; i++) {
+            index.expectMatchesScan(randomRect(random, area, 0.5));
+        }
+    }
+}
+
+TEST(LayerIndexTest, QueryFindsZeroHeightBoxes)
+{
+    std::mt19937 random(2);
+    std::vector<GeoRect> boxes;
+
+    // Horizontal and vertical lines, some of them on the edge of the extent
+    for (int i = 0; i < 500; i++) {
+        GeoRect box = randomRect(random, area, 0.05);
+        if (i % 2 == 0) {
+            boxes.emplace_back(box.bottom(), box.bottom(), box.left(), box.right());
+        } else {
+            boxes.emplace_back(box.top(), box.bottom(), box.left(), box.left());
+        }
+    }
+    boxes.emplace_back(area.top(), area.top(), area.left(), area.right());
+    boxes.emplace_back(area.bottom(), area.bottom(), area.left(), area.right());
+
+    GridIndex index(boxes);
+    for (int i = 0; i < 200; i++) {
+        index.expectMatchesScan(randomRect(random, area, 0.5));
+
+        // Zero-height and zero-width query rects
+        const GeoRect rect = randomRect(random, area, 0.5);
+        index.expectMatchesScan(GeoRect(rect.bottom(), rect.bottom(), rect.left(), rect.right()));
+        index.expectMatchesScan(GeoRect(rect.top(), rect.bottom(), rect.left(), rect.left()));
+    }
+
+    index.expectMatchesScan(GeoRect(area.top(), area.top(), area.left(), area.right()));
+    index.expectMatchesScan(GeoRect(area.bottom(), area.bottom(), area.left(), area.left()));
+}
+
+TEST(LayerIndexTest, QueryOfSinglePointExtent)
+{
+    const GeoRect point(59.5, 59.5, 11, 11);
+    GridIndex index({ point, point });
+
+    EXPECT_EQ(index.query(point), (std::vector<uint32_t> { 0, 1 }));
+    EXPECT_EQ(index.query(area), (std::vector<uint32_t> { 0, 1 }));
+    EXPECT_TRUE(index.query(GeoRect(59.4, 59.3, 11, 11)).empty());
+}
+
+TEST(LayerIndexTest, QueryOutsideExtentIsEmpty)
+{
+    std::mt19937 random(3);
+    std::vector<GeoRect> boxes;
+    for (int i = 0; i < 100; i++) {
+        boxes.push_back(randomRect(random, area, 0.05));
+    }
+
+    GridIndex index(boxes);
+    EXPECT_TRUE(index.query(GeoRect(70, 65, 10, 12)).empty());
+    EXPECT_TRUE(index.query(GeoRect(58, 50, 10, 12)).empty());
+    EXPECT_TRUE(index.query(GeoRect(60, 59, 0, 5)).empty());
+    EXPECT_TRUE(index.query(GeoRect(60, 59, 13, 14)).empty());
+}
+
+TEST(LayerIndexTest, QueryPointsMatchesScanOfRandomPoints)
+{
+    std::mt19937 random(4);
+    std::uniform_real_distribution<double> lat(area.bottom(), area.top());
+    std::uniform_real_distribution<double> lon(area.left(), area.right());
+
+    for (size_t count : { 1, 10, 1000, 10000 }) {
+        std::vector<Pos> positions;
+        for (size_t i = 0; i < count; i++) {
+            positions.emplace_back(lat(random), lon(random));
+        }
+
+        PointIndex index(positions);
+        for (int i = 0; i < 200; i++) {
+            index.expectMatchesScan(randomRect(random, area, 0.5));
+            index.expectMatchesScan(randomRect(random, area, 0.01));
+        }
+
+        // Rects touching the edges of the extent
+        const GeoRect &extent = index.extent();
+        index.expectMatchesScan(extent);
+        index.expectMatchesScan(GeoRect(extent.top(), extent.top(), extent.left(), extent.right()));
+        index.expectMatchesScan(GeoRect(extent.top(), extent.bottom(), extent.right(), extent.right()));
+    }
+}
+
+TEST(LayerIndexTest, QueryPointsOfSinglePointExtent)
+{
+    PointIndex index({ Pos(59.5, 11), Pos(59.5, 11), Pos(59.5, 11) });
+
+    EXPECT_EQ(index.query(GeoRect(59.5, 59.5, 11, 11)), (std::vector<uint32_t> { 0, 1, 2 }));
+    EXPECT_EQ(index.query(area), (std::vector<uint32_t> { 0, 1, 2 }));
+    EXPECT_TRUE(index.query(GeoRect(59.4, 59.3, 10, 12)).empty());
+    EXPECT_TRUE(index.query(GeoRect(60, 59, 11.1, 12)).empty());
+}
+
+TEST(LayerIndexTest, QueryPointsWithZeroHeightRect)
+{
+    std::mt19937 random(5);
+    std::uniform_real_distribution<double> lon(area.left(), area.right());
+
+    // Points on a few parallels, queried along them
+    std::vector<Pos> positions;
+    for (int i = 0; i < 1000; i++) {
+        positions.emplace_back(59 + (i % 5) * 0.25, lon(random));
+    }
+
+    PointIndex index(positions);
+    for (int i = 0; i < 5; i++) {
+        const double latitude = 59 + i * 0.25;
+        index.expectMatchesScan(GeoRect(latitude, latitude, 10.5, 11.5));
+        index.expectMatchesScan(GeoRect(latitude, latitude, 10, 12));
+    }
+}
+
+TEST(LayerIndexTest, QueryPointsOutsideExtentIsEmpty)
+{
+    PointIndex index({ Pos(59, 10), Pos(60, 12), Pos(59.5, 11) });
+
+    EXPECT_TRUE(index.query(GeoRect(70, 65, 10, 12)).empty());
+    EXPECT_TRUE(index.query(GeoRect(58, 50, 10, 12)).empty());
+    EXPECT_TRUE(index.query(GeoRect(60, 59, 0, 5)).empty());
+    EXPECT_TRUE(index.query(GeoRect(60, 59, 13, 14)).empty());
+}
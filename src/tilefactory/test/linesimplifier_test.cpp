@@ -0,0 +1,340 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "tilefactory/linesimplifier.h"
+
+namespace {
+using Algorithm = LineSimplifier::Algorithm;
+
+std::vector<Pos> randomWalk(std::mt19937 &random, size_t size)
+{
+    std::normal_distribution<double> step(0, 1e-3);
+    std::vector<Pos> path;
+    double lat = 59;
+    double lon = 10;
+
+    for (size_t i = 0; i < size; i++) {
+        lat += step(random);
+        lon += step(random);
+        path.emplace_back(lat, lon);
+    }
+
+    return path;
+}
+
+double segmentDistance(const Pos &pos, const Pos &a, const Pos &b)
+{
+    const double dLat = b.lat() - a.lat();
+    const double dLon = b.lon() - a.lon();
+    const double lengthSquared = dLat * dLat + dLon * dLon;
+    double t = 0;
+
+    if (lengthSquared > 0) {
+        t = std::clamp(((pos.lat() - a.lat()) * dLat + (pos.lon() - a.lon()) * dLon) / lengthSquared, 0.0, 1.0);
+    }
+
+    return std::hypot(pos.lat() - a.lat() - t * dLat, pos.lon() - a.lon() - t * dLon);
+}
+
+void douglasPeuckerReference(const std::vector<Pos> &path, size_t first, size_t last, double epsilon, std::vector<bool> &keep)
+{
+    size_t farthest = first;
+    double maxDistance = 0;
+
+    for (size_t i = first + 1; i < last; i++) {
+        const double distance = segmentDistance(path[i], path[first], path[last]);
+        if (distance > maxDistance) {
+            maxDistance = distance;
+            farthest = i;
+        }
+    }
+
+    if (farthest != first && maxDistance > epsilon) {
+        keep[farthest] = true;
+        douglasPeuckerReference(path, first, farthest, epsilon, keep);
+        douglasPeuckerReference(path, farthest, last, epsilon, keep);
+    }
+}
+
+// Recursive Douglas-Peucker without any of the optimizations
+std::vector<Pos> douglasPeuckerReference(const std::vector<Pos> &path, double epsilon)
+{
+    if (path.size() < 3) {
+        return path;
+    }
+
+    std::vector<bool> keep(path.size(), false);
+    keep.front() = true;
+    keep.back() = true;
+    douglasPeuckerReference(path, 0, path.size() - 1, epsilon, keep);
+
+    std::vector<Pos> simplified;
+    for (size_t i = 0; i < path.size(); i++) {
+        if (keep[i]) {
+            simplified.push_back(path[i]);
+        }
+    }
+    return simplified;
+}
+
+double triangleArea(const Pos &a, const Pos &b, const Pos &c)
+{
+    return 0.5 * std::abs((a.lon() - c.lon()) * (b.lat() - a.lat()) - (a.lon() - b.lon()) * (c.lat() - a.lat()));
+}
+
+// Visvalingam by scanning for the smallest area after every removal
+std::vector<Pos> visvalingamReference(const std::vector<Pos> &path, double epsilon)
+{
+    if (path.size() < 3) {
+        return path;
+    }
+
+    std::vector<Pos> kept = path;
+    std::vector<double> areas(path.size(), 0);
+    for (size_t i = 1; i + 1 < kept.size(); i++) {
+        areas[i] = triangleArea(kept[i - 1], kept[i], kept[i + 1]);
+    }
+
+    while (kept.size() > 2) {
+        const size_t smallest = std::min_element(areas.begin() + 1, areas.end() - 1) - areas.begin();
+        const double area = areas[smallest];
+
+        if (area >= epsilon * epsilon) {
+            break;
+        }
+
+        kept.erase(kept.begin() + smallest);
+        areas.erase(areas.begin() + smallest);
+
+        // An area never drops below the one just removed
+        for (size_t neighbour : { smallest - 1, smallest }) {
+            if (neighbour > 0 && neighbour + 1 < kept.size()) {
+                areas[neighbour] = std::max(area, triangleArea(kept[neighbour - 1], kept[neighbour], kept[neighbour + 1]));
+            }
+        }
+    }
+
+    return kept;
+}
+
+bool contains(const std::vector<Pos> &path, const Pos &pos)
+{
+    return std::find(path.begin(), path.end(), pos) != path.end();
+}
+
+// Positions of path i ranked above epsilon
+std::vector<Pos> rankedAbove(const LineSimplifier::Batch &batch, const std::vector<double> &ranks, size_t i, double epsilon)
+{
+    std::vector<Pos> path;
+    for (size_t j = batch.offsets[i]; j < batch.offsets[i] + batch.sizes[i]; j++) {
+        if (ranks[j] > epsilon) {
+            path.emplace_back(batch.lat[j], batch.lon[j]);
+        }
+    }
+    return path;
+}
+
+std::vector<Pos> simplified(std::vector<Pos> path, double epsilon, Algorithm algorithm)
+{
+    std::vector<double> lat;
+    std::vector<double> lon;
+    for (const Pos &pos : path) {
+        lat.push_back(pos.lat());
+        lon.push_back(pos.lon());
+    }
+
+    const size_t size = LineSimplifier::simplify(lat, lon, epsilon, algorithm);
+
+    std::vector<Pos> result;
+    for (size_t i = 0; i < size; i++) {
+        result.emplace_back(lat[i], lon[i]);
+    }
+    return result;
+}
+}
+
+TEST(LineSimplifierTest, DouglasPeuckerMatchesReference)
+{
+    std::mt19937 random(1);
+
+    for (size_t size : { 3, 4, 10, 100, 1000 }) {
+        for (double epsilon : { 1e-5, 1e-4, 1e-3, 1e-2 }) {
+            const std::vector<Pos> path = randomWalk(random, size);
+            EXPECT_EQ(simplified(path, epsilon, Algorithm::DouglasPeucker), douglasPeuckerReference(path, epsilon))
+                << size << " positions, epsilon " << epsilon;
+        }
+    }
+}
+
+TEST(LineSimplifierTest, VisvalingamMatchesReference)
+{
+    std::mt19937 random(2);
+
+    for (size_t size : { 3, 4, 10, 100, 1000 }) {
+        for (double epsilon : { 1e-5, 1e-4, 1e-3, 1e-2 }) {
+            const std::vector<Pos> path = randomWalk(random, size);
+            EXPECT_EQ(simplified(path, epsilon, Algorithm::Visvalingam), visvalingamReference(path, epsilon))
+                << size << " positions, epsilon " << epsilon;
+        }
+    }
+}
+
+TEST(LineSimplifierTest, BatchMatchesReference)
+{
+    std::mt19937 random(3);
+    constexpr double epsilon = 1e-3;
+
+    // More paths than fit in one chunk of the worker pool
+    std::vector<std::vector<Pos>> paths;
+    LineSimplifier::Batch batch;
+
+    for (size_t i = 0; i < 300; i++) {
+        paths.push_back(randomWalk(random, i % 50));
+        batch.beginPath();
+        for (const Pos &pos : paths.back()) {
+            batch.append(pos);
+        }
+    }
+
+    for (Algorithm algorithm : { Algorithm::DouglasPeucker, Algorithm::Visvalingam }) {
+        LineSimplifier::Batch simplifiedBatch = batch;
+        LineSimplifier::simplify(simplifiedBatch, epsilon, algorithm);
+        ASSERT_EQ(simplifiedBatch.size(), paths.size());
+
+        for (size_t i = 0; i < paths.size(); i++) {
+            const std::vector<Pos> expected = algorithm == Algorithm::DouglasPeucker
+                ? douglasPeuckerReference(paths[i], epsilon)
+                : visvalingamReference(paths[i], epsilon);
+            EXPECT_EQ(simplifiedBatch.path(i), expected) << i;
+        }
+    }
+}
+
+TEST(LineSimplifierTest, EndPointsAreKept)
+{
+    std::mt19937 random(4);
+
+    for (Algorithm algorithm : { Algorithm::DouglasPeucker, Algorithm::Visvalingam }) {
+        for (size_t size : { 2, 3, 50 }) {
+            const std::vector<Pos> path = randomWalk(random, size);
+            const std::vector<Pos> result = simplified(path, 1, algorithm);
+
+            ASSERT_EQ(result.size(), 2u);
+            EXPECT_EQ(result.front(), path.front());
+            EXPECT_EQ(result.back(), path.back());
+        }
+
+        // A closed ring keeps its start
+        const std::vector<Pos> ring = { Pos(0, 0), Pos(0, 1), Pos(1, 1), Pos(1, 0), Pos(0, 0) };
+        const std::vector<Pos> result = simplified(ring, 10, algorithm);
+        EXPECT_EQ(result, (std::vector<Pos> { Pos(0, 0), Pos(0, 0) }));
+    }
+}
+
+TEST(LineSimplifierTest, DouglasPeuckerStaysWithinEpsilon)
+{
+    std::mt19937 random(5);
+
+    for (double epsilon : { 1e-4, 1e-3, 1e-2 }) {
+        const std::vector<Pos> path = randomWalk(random, 1000);
+        const std::vector<Pos> result = simplified(path, epsilon, Algorithm::DouglasPeucker);
+
+        // Every removed position is within epsilon of the segment between
+        // the kept positions around it
+        size_t segment = 0;
+        for (const Pos &pos : path) {
+            if (segment + 1 < result.size() && pos == result[segment + 1]) {
+                segment++;
+                continue;
+            }
+            if (pos == result[segment]) {
+                continue;
+            }
+            EXPECT_LE(segmentDistance(pos, result[segment], result[segment + 1]), epsilon);
+        }
+    }
+}
+
+TEST(LineSimplifierTest, VisvalingamRemovesSmallTriangles)
+{
+    // Triangle areas at the inner positions are 0.1, 0.55, 1, 0.55 and 0.1
+    const std::vector<Pos> path = { Pos(0, 0), Pos(0.1, 1), Pos(0, 2), Pos(1, 3), Pos(0, 4), Pos(0.1, 5), Pos(0, 6) };
+
+    EXPECT_EQ(simplified(path, std::sqrt(0.01), Algorithm::Visvalingam), path);
+    EXPECT_EQ(simplified(path, std::sqrt(0.2), Algorithm::Visvalingam),
+              (std::vector<Pos> { Pos(0, 0), Pos(0, 2), Pos(1, 3), Pos(0, 4), Pos(0, 6) }));
+
+    // Straight lines collapse to their end points
+    const std::vector<Pos> straight = { Pos(0, 0), Pos(1, 1), Pos(2, 2), Pos(3, 3) };
+    EXPECT_EQ(simplified(straight, 1e-9, Algorithm::Visvalingam), (std::vector<Pos> { Pos(0, 0), Pos(3, 3) }));
+}
+
+TEST(LineSimplifierTest, ZeroEpsilonKeepsEverything)
+{
+    std::mt19937 random(6);
+    const std::vector<Pos> path = randomWalk(random, 100);
+
+    EXPECT_EQ(simplified(path, 0, Algorithm::DouglasPeucker), path);
+    EXPECT_EQ(simplified(path, 0, Algorithm::Visvalingam), path);
+}
+
+TEST(LineSimplifierTest, RanksGiveDouglasPeuckerAtAnyEpsilon)
+{
+    std::mt19937 random(7);
+    LineSimplifier::Batch batch;
+
+    for (size_t i = 0; i < 200; i++) {
+        batch.beginPath();
+        for (const Pos &pos : randomWalk(random, i % 100)) {
+            batch.append(pos);
+        }
+    }
+
+    std::vector<double> ranks;
+    LineSimplifier::rank(batch, ranks);
+    ASSERT_EQ(ranks.size(), batch.lat.size());
+
+    for (double epsilon : { 1e-5, 1e-4, 5e-4, 1e-3, 1e-2, 1. }) {
+        for (size_t i = 0; i < batch.size(); i++) {
+            EXPECT_EQ(rankedAbove(batch, ranks, i, epsilon), simplified(batch.path(i), epsilon, Algorithm::DouglasPeucker))
+                << "path " << i << ", epsilon " << epsilon;
+        }
+    }
+
+    // The ranks of the positions that were kept are the tolerances at which
+    // they drop out
+    const std::vector<Pos> path = batch.path(50);
+    std::vector<double> pathRanks(path.size());
+    LineSimplifier::rank(std::span<const double>(batch.lat.data() + batch.offsets[50], path.size()),
+                         std::span<const double>(batch.lon.data() + batch.offsets[50], path.size()),
+                         pathRanks);
+
+    for (size_t j = 1; j + 1 < path.size(); j++) {
+        const double rank = pathRanks[j];
+        EXPECT_TRUE(contains(simplified(path, std::nextafter(rank, 0.), Algorithm::DouglasPeucker), path[j])) << j;
+        EXPECT_FALSE(contains(simplified(path, rank, Algorithm::DouglasPeucker), path[j])) << j;
+    }
+}
+
+TEST(LineSimplifierTest, EndPointsRankInfinite)
+{
+    std::mt19937 random(8);
+
+    for (size_t size : { 1, 2, 3, 20 }) {
+        const std::vector<Pos> path = randomWalk(random, size);
+        std::vector<double> lat;
+        std::vector<double> lon;
+        for (const Pos &pos : path) {
+            lat.push_back(pos.lat());
+            lon.push_back(pos.lon());
+        }
+
+        std::vector<double> ranks(size);
+        LineSimplifier::rank(lat, lon, ranks);
+        EXPECT_TRUE(std::isinf(ranks.front()));
+        EXPECT_TRUE(std::isinf(ranks.back()));
+    }
+}
@@ -0,0 +1,167 @@
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "streampool.h"
+
+namespace {
+constexpr std::chrono::seconds timeout(5);
+
+// Records which files were opened, in order
+class OpenLog
+{
+public:
+    StreamPool::Session session()
+    {
+        return [this](const std::filesystem::path &file) -> std::shared_ptr<std::istream> {
+            std::lock_guard lock(m_mutex);
+            m_files.push_back(file.string());
+            return std::make_shared<std::istringstream>(file.string());
+        };
+    }
+
+    std::vector<std::string> files()
+    {
+        std::lock_guard lock(m_mutex);
+        return m_files;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::vector<std::string> m_files;
+};
+
+// Opens a file from another thread and tells whether it succeeded within the timeout
+bool opensWithinTimeout(StreamPool &pool, const std::string &file)
+{
+    std::future<bool> opened = std::async(std::launch::async, [&pool, file]() {
+        return pool.open(file) != nullptr;
+    });
+    return opened.wait_for(timeout) == std::future_status::ready && opened.get();
+}
+}
+
+TEST(StreamPoolTest, OpensThroughSession)
+{
+    OpenLog log;
+    StreamPool pool({ log.session() });
+
+    std::shared_ptr<std::istream> stream = pool.open("a");
+    ASSERT_NE(stream, nullptr);
+
+    std::string content;
+    *stream >> content;
+    EXPECT_EQ(content, "a");
+}
+
+TEST(StreamPoolTest, EmptyPoolOpensNothing)
+{
+    StreamPool pool({});
+    EXPECT_EQ(pool.open("a"), nullptr);
+}
+
+TEST(StreamPoolTest, ReleasedStreamReturnsSession)
+{
+    OpenLog log;
+    StreamPool pool({ log.session() });
+
+    std::shared_ptr<std::istream> stream = pool.open("a");
+    ASSERT_NE(stream, nullptr);
+    stream.reset();
+
+    EXPECT_TRUE(opensWithinTimeout(pool, "b"));
+}
+
+TEST(StreamPoolTest, NullStreamReturnsSession)
+{
+    bool fail = true;
+    StreamPool pool({ [&fail](const std::filesystem::path &file) -> std::shared_ptr<std::istream> {
+        if (fail) {
+            return nullptr;
+        }
+        return std::make_shared<std::istringstream>(file.string());
+    } });
+
+    EXPECT_EQ(pool.open("a"), nullptr);
+
+    fail = false;
+    EXPECT_TRUE(opensWithinTimeout(pool, "b"));
+}
+
+TEST(StreamPoolTest, ExceptionReturnsSession)
+{
+    bool fail = true;
+    StreamPool pool({ [&fail](const std::filesystem::path &file) -> std::shared_ptr<std::istream> {
+        if (fail) {
+            throw std::runtime_error("decryption failed");
+        }
+        return std::make_shared<std::istringstream>(file.string());
+    } });
+
+    EXPECT_THROW(pool.open("a"), std::runtime_error);
+
+    fail = false;
+    EXPECT_TRUE(opensWithinTimeout(pool, "b"));
+}
+
+TEST(StreamPoolTest, UsesEverySession)
+{
+    OpenLog first;
+    OpenLog second;
+    StreamPool pool({ first.session(), second.session() });
+
+    std::shared_ptr<std::istream> a = pool.open("a");
+    std::shared_ptr<std::istream> b = pool.open("b");
+
+    EXPECT_EQ(first.files(), std::vector<std::string> { "a" });
+    EXPECT_EQ(second.files(), std::vector<std::string> { "b" });
+}
+
+TEST(StreamPoolTest, ServesWaitersInOrder)
+{
+    OpenLog log;
+    StreamPool pool({ log.session() });
+
+    std::shared_ptr<std::istream> held = pool.open("held");
+    ASSERT_NE(held, nullptr);
+
+    // Each waiter is given time to block before the next one starts, so
+    // they queue up in the order they were started
+    std::vector<std::thread> waiters;
+    for (int i = 0; i < 4; i++) {
+        waiters.emplace_back([&pool, i]() {
+            pool.open(std::to_string(i));
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    held.reset();
+
+    for (std::thread &waiter : waiters) {
+        waiter.join();
+    }
+
+    EXPECT_EQ(log.files(), (std::vector<std::string> { "held", "0", "1", "2", "3" }));
+}
+
+TEST(StreamPoolTest, StreamOutlivesPool)
+{
+    OpenLog log;
+    std::shared_ptr<std::istream> stream;
+
+    {
+        StreamPool pool({ log.session() });
+        stream = pool.open("a");
+    }
+
+    ASSERT_NE(stream, nullptr);
+    std::string content;
+    *stream >> content;
+    EXPECT_EQ(content, "a");
+    stream.reset();
+}
@@ -0,0 +1,221 @@
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+#include <capnp/message.h>
+#include <gtest/gtest.h>
+
+#include "tilecontainer.h"
+
+namespace {
+std::unique_ptr<capnp::MallocMessageBuilder> chartMessage(const std::string &name)
+{
+    auto message = std::make_unique<capnp::MallocMessageBuilder>();
+    ChartData::Builder root = message->initRoot<ChartData>();
+    root.setName(name);
+    return message;
+}
+
+std::string chartName(const std::shared_ptr<Chart> &chart)
+{
+    return chart ? std::string(chart->name()) : std::string();
+}
+}
+
+class TileContainerTest : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        std::random_device device;
+        m_directory = std::filesystem::temp_directory_path() / ("tilecontainer_test_" + std::to_string(device()));
+        std::filesystem::remove_all(m_directory);
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(m_directory);
+    }
+
+    std::string directory() const { return m_directory.string(); }
+    std::filesystem::path dataFile() const { return m_directory / "tiles.dat"; }
+    std::filesystem::path indexFile() const { return m_directory / "tiles.idx"; }
+
+    // Copy of an index saved earlier, kept next to the container files
+    std::filesystem::path savedIndexFile() const { return m_directory / "saved.idx"; }
+
+    static void write(TileContainer &container, const std::string &id, const std::string &name)
+    {
+        ASSERT_TRUE(container.write(id, chartMessage(name).get()));
+    }
+
+private:
+    std::filesystem::path m_directory;
+};
+
+TEST_F(TileContainerTest, ReadsWrittenTiles)
+{
+    TileContainer container(directory());
+    write(container, "1-0-0", "a");
+    write(container, "1-1-0", "b");
+
+    EXPECT_TRUE(container.contains("1-0-0"));
+    EXPECT_TRUE(container.contains("1-1-0"));
+    EXPECT_FALSE(container.contains("1-0-1"));
+    EXPECT_EQ(chartName(container.read("1-0-0")), "a");
+    EXPECT_EQ(chartName(container.read("1-1-0")), "b");
+    EXPECT_EQ(container.read("1-0-1"), nullptr);
+}
+
+TEST_F(TileContainerTest, ReplacedTileReadsLatestVersion)
+{
+    TileContainer container(directory());
+    write(container, "1-0-0", "a");
+    write(container, "1-0-0", "b");
+
+    EXPECT_EQ(chartName(container.read("1-0-0")), "b");
+}
+
+TEST_F(TileContainerTest, ReloadsSavedIndex)
+{
+    {
+        TileContainer container(directory());
+        write(container, "1-0-0", "a");
+        write(container, "1-1-0", "b");
+        write(container, "1-0-0", "c");
+    }
+
+    ASSERT_TRUE(std::filesystem::exists(indexFile()));
+
+    TileContainer container(directory());
+    EXPECT_EQ(chartName(container.read("1-0-0")), "c");
+    EXPECT_EQ(chartName(container.read("1-1-0")), "b");
+}
+
+TEST_F(TileContainerTest, RecoversTilesWithoutIndex)
+{
+    {
+        TileContainer container(directory());
+        write(container, "1-0-0", "a");
+        write(container, "1-1-0", "b");
+    }
+
+    std::filesystem::remove(indexFile());
+
+    TileContainer container(directory());
+    EXPECT_EQ(chartName(container.read("1-0-0")), "a");
+    EXPECT_EQ(chartName(container.read("1-1-0")), "b");
+}
+
+TEST_F(TileContainerTest, RecoversTilesAppendedAfterIndexSave)
+{
+    const std::filesystem::path savedIndex = savedIndexFile();
+
+    {
+        TileContainer container(directory());
+        write(container, "1-0-0", "a");
+        ASSERT_TRUE(container.saveIndex());
+        std::filesystem::copy_file(indexFile(), savedIndex);
+        write(container, "1-1-0", "b");
+    }
+
+    // As if the process died before the index was saved again
+    std::filesystem::copy_file(savedIndex, indexFile(), std::filesystem::copy_options::overwrite_existing);
+
+    TileContainer container(directory());
+    EXPECT_EQ(chartName(container.read("1-0-0")), "a");
+    EXPECT_EQ(chartName(container.read("1-1-0")), "b");
+}
+
+TEST_F(TileContainerTest, CutsOffTornTail)
+{
+    {
+        TileContainer container(directory());
+        write(container, "1-0-0", "a");
+        write(container, "1-1-0", "b");
+    }
+
+    const uintmax_t size = std::filesystem::file_size(dataFile());
+    std::filesystem::resize_file(dataFile(), size - 8);
+
+    {
+        TileContainer container(directory());
+        EXPECT_EQ(chartName(container.read("1-0-0")), "a");
+        EXPECT_FALSE(container.contains("1-1-0"));
+        EXPECT_LT(std::filesystem::file_size(dataFile()), size - 8);
+
+        write(container, "1-0-1", "c");
+    }
+
+    TileContainer container(directory());
+    EXPECT_EQ(chartName(container.read("1-0-0")), "a");
+    EXPECT_EQ(chartName(container.read("1-0-1")), "c");
+}
+
+TEST_F(TileContainerTest, DiscardsCorruptTileOnRead)
+{
+    {
+        TileContainer container(directory());
+        write(container, "1-0-0", "a");
+    }
+
+    // Flip the last byte of the only record, which is part of its data
+    const uintmax_t size = std::filesystem::file_size(dataFile());
+    {
+        std::fstream file(dataFile(), std::ios::binary | std::ios::in | std::ios::out);
+        file.seekg(size - 1);
+        const char byte = static_cast<char>(file.get() ^ 0xff);
+        file.seekp(size - 1);
+        file.put(byte);
+    }
+
+    TileContainer container(directory());
+    EXPECT_TRUE(container.contains("1-0-0"));
+    EXPECT_EQ(container.read("1-0-0"), nullptr);
+    EXPECT_FALSE(container.contains("1-0-0"));
+}
+
+TEST_F(TileContainerTest, CompactionKeepsLatestTiles)
+{
+    {
+        TileContainer container(directory());
+        for (int i = 0; i < 10; i++) {
+            write(container, "1-0-0", "a" + std::to_string(i));
+            write(container, "1-1-0", "b" + std::to_string(i));
+        }
+
+        const uintmax_t size = std::filesystem::file_size(dataFile());
+        ASSERT_TRUE(container.compact());
+        EXPECT_LT(std::filesystem::file_size(dataFile()), size);
+
+        EXPECT_EQ(chartName(container.read("1-0-0")), "a9");
+        EXPECT_EQ(chartName(container.read("1-1-0")), "b9");
+    }
+
+    TileContainer container(directory());
+    EXPECT_EQ(chartName(container.read("1-0-0")), "a9");
+    EXPECT_EQ(chartName(container.read("1-1-0")), "b9");
+}
+
+TEST_F(TileContainerTest, IgnoresIndexOfDataFileBeforeCompaction)
+{
+    const std::filesystem::path staleIndex = savedIndexFile();
+
+    {
+        TileContainer container(directory());
+        write(container, "1-0-0", "a");
+        write(container, "1-0-0", "b");
+        write(container, "1-1-0", "c");
+        ASSERT_TRUE(container.saveIndex());
+        std::filesystem::copy_file(indexFile(), staleIndex);
+        ASSERT_TRUE(container.compact());
+    }
+
+    // As if the process died after the compacted data file replaced the old
+    // one but before the new index was saved
+    std::filesystem::copy_file(staleIndex, indexFile(), std::filesystem::copy_options::overwrite_existing);
+
+    TileContainer container(directory());
+    EXPECT_EQ(chartName(container.read("1-0-0")), "b");
+    EXPECT_EQ(chartName(container.read("1-1-0")), "c");
+}
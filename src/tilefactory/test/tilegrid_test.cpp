@@ -0,0 +1,37 @@
+#include <cmath>
+
+#include <gtest/gtest.h>
+
+#include "tilegrid.h"
+
+namespace {
+double exactPixelsPerLon(int zoom)
+{
+    return TileGrid::maxTileSize / 360. * std::pow(2, zoom);
+}
+}
+
+TEST(TileGridTest, ZoomOfTileResolution)
+{
+    for (int zoom = 0; zoom <= TileGrid::maxZoom; zoom++) {
+        EXPECT_EQ(TileGrid::zoom(exactPixelsPerLon(zoom)), zoom);
+        EXPECT_EQ(TileGrid::zoom(TileGrid::pixelsPerLon(zoom)), zoom);
+    }
+}
+
+TEST(TileGridTest, ZoomIsLowestWithEnoughResolution)
+{
+    for (int zoom = 1; zoom < TileGrid::maxZoom; zoom++) {
+        EXPECT_EQ(TileGrid::zoom(exactPixelsPerLon(zoom) * 0.999), zoom);
+        EXPECT_EQ(TileGrid::zoom(exactPixelsPerLon(zoom) * 1.001), zoom + 1);
+        EXPECT_EQ(TileGrid::zoom(exactPixelsPerLon(zoom - 1) * 1.001), zoom);
+    }
+}
+
+TEST(TileGridTest, ZoomIsClamped)
+{
+    EXPECT_EQ(TileGrid::zoom(0), 0);
+    EXPECT_EQ(TileGrid::zoom(1e-6), 0);
+    EXPECT_EQ(TileGrid::zoom(exactPixelsPerLon(TileGrid::maxZoom) * 2), TileGrid::maxZoom);
+    EXPECT_EQ(TileGrid::zoom(1e12), TileGrid::maxZoom);
+}
@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+
+#include "tilefactory/tileid.h"
+
+namespace {
+// Northmost latitude of the web mercator tile pyramid
+constexpr double maxLatitude = 85.0511287798066;
+
+// Tiles at the corners and edges of the pyramid as well as inside it
+std::vector<TileId> sampleTiles()
+{
+    std::vector<TileId> tiles;
+    for (int zoom : { 1, 2, 5, 12, 20 }) {
+        const int last = (1 << zoom) - 1;
+        for (int x : { 0, last / 2, last }) {
+            for (int y : { 0, last / 2, last }) {
+                tiles.emplace_back(zoom, x, y);
+            }
+        }
+    }
+    return tiles;
+}
+
+// Moves pos by fraction of the tile size towards the center of rect
+Pos inset(const Pos &pos, const GeoRect &rect, double fraction)
+{
+    const double lat = pos.lat() < (rect.top() + rect.bottom()) / 2 ? 1 : -1;
+    const double lon = pos.lon() < (rect.left() + rect.right()) / 2 ? 1 : -1;
+    return Pos(pos.lat() + lat * fraction * rect.height(), pos.lon() + lon * fraction * rect.width());
+}
+}
+
+TEST(TileIdTest, BoundingBoxCornersMapBackToTile)
+{
+    for (const TileId &tile : sampleTiles()) {
+        const GeoRect rect = tile.boundingBox();
+
+        for (const Pos &corner : { rect.topLeft(), rect.topRight(), rect.bottomLeft(), rect.bottomRight() }) {
+            EXPECT_EQ(TileId::fromPos(inset(corner, rect, 1e-6), tile.zoom()), tile) << tile.toString();
+        }
+    }
+}
+
+TEST(TileIdTest, ChildrenTileParent)
+{
+    for (const TileId &tile : sampleTiles()) {
+        const GeoRect rect = tile.boundingBox();
+        const std::array<TileId, 4> children = tile.children();
+
+        GeoRect united;
+        for (const TileId &child : children) {
+            EXPECT_EQ(child.parent(), tile) << child.toString();
+            united = united.united(child.boundingBox());
+        }
+
+        EXPECT_DOUBLE_EQ(united.top(), rect.top());
+        EXPECT_DOUBLE_EQ(united.bottom(), rect.bottom());
+        EXPECT_DOUBLE_EQ(united.left(), rect.left());
+        EXPECT_DOUBLE_EQ(united.right(), rect.right());
+
+        // Children meet exactly on the lines halving the parent
+        EXPECT_EQ(children[0].boundingBox().right(), children[1].boundingBox().left());
+        EXPECT_EQ(children[0].boundingBox().bottom(), children[2].boundingBox().top());
+    }
+}
+
+TEST(TileIdTest, PosMapsToParentOfItsTile)
+{
+    for (const TileId &tile : sampleTiles()) {
+        const GeoRect rect = tile.boundingBox();
+        const Pos center((rect.top() + rect.bottom()) / 2, (rect.left() + rect.right()) / 2);
+
+        EXPECT_EQ(TileId::fromPos(center, tile.zoom()), tile);
+        EXPECT_EQ(TileId::fromPos(center, tile.zoom() - 1), tile.parent());
+    }
+}
+
+TEST(TileIdTest, AntimeridianBoundsColumns)
+{
+    for (int zoom : { 0, 1, 10, 30 }) {
+        const int last = (1 << zoom) - 1;
+
+        EXPECT_EQ(TileId::fromPos(Pos(0, -180), zoom).x(), 0);
+        EXPECT_EQ(TileId::fromPos(Pos(0, 180), zoom).x(), last);
+        EXPECT_EQ(TileId(zoom, 0, 0).boundingBox().left(), -180);
+        EXPECT_EQ(TileId(zoom, last, 0).boundingBox().right(), 180);
+    }
+}
+
+TEST(TileIdTest, NeighborWrapsAroundAntimeridian)
+{
+    const TileId west(3, 0, 4);
+    const TileId east(3, 7, 4);
+
+    EXPECT_EQ(west.neighbor(-1, 0), east);
+    EXPECT_EQ(east.neighbor(1, 0), west);
+    EXPECT_EQ(west.neighbor(-9, 0), east);
+    EXPECT_EQ(TileId(0, 0, 0).neighbor(1, 0), TileId(0, 0, 0));
+}
+
+TEST(TileIdTest, PolesClampRows)
+{
+    for (int zoom : { 0, 1, 10, 30 }) {
+        const int last = (1 << zoom) - 1;
+
+        EXPECT_EQ(TileId::fromPos(Pos(90, 0), zoom).y(), 0);
+        EXPECT_EQ(TileId::fromPos(Pos(maxLatitude, 0), zoom).y(), 0);
+        EXPECT_EQ(TileId::fromPos(Pos(-90, 0), zoom).y(), last);
+        EXPECT_EQ(TileId::fromPos(Pos(-maxLatitude, 0), zoom).y(), last);
+        EXPECT_NEAR(TileId(zoom, 0, 0).boundingBox().top(), maxLatitude, 1e-9);
+        EXPECT_NEAR(TileId(zoom, 0, last).boundingBox().bottom(), -maxLatitude, 1e-9);
+    }
+
+    EXPECT_EQ(TileId(3, 2, 0).neighbor(0, -1), TileId(3, 2, 0));
+    EXPECT_EQ(TileId(3, 2, 7).neighbor(0, 1), TileId(3, 2, 7));
+}
+
+TEST(TileIdTest, QuadKeyRoundTrip)
+{
+    for (const TileId &tile : sampleTiles()) {
+        const std::string quadKey = tile.quadKey();
+        EXPECT_EQ(quadKey.size(), static_cast<size_t>(tile.zoom()));
+        EXPECT_EQ(TileId::fromQuadKey(quadKey), tile);
+        EXPECT_EQ(quadKey.substr(0, quadKey.size() - 1), tile.parent().quadKey());
+    }
+
+    EXPECT_EQ(TileId::fromQuadKey(""), TileId(0, 0, 0));
+    EXPECT_EQ(TileId(3, 3, 5).quadKey(), "213");
+    EXPECT_FALSE(TileId::fromQuadKey("014").has_value());
+}
+
+TEST(TileIdTest, ToString)
+{
+    EXPECT_EQ(TileId(12, 2200, 1300).toString(), "12-2200-1300");
+}
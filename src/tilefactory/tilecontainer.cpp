@@ -0,0 +1,574 @@
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <capnp/serialize.h>
+
+#include "tilecontainer.h"
+
+namespace {
+constexpr uint32_t dataMagic = 0x4447544e; // "NTGD"
+constexpr uint32_t dataVersion = 1;
+constexpr uint32_t recordMagic = 0x5447544e; // "NTGT"
+constexpr uint32_t indexMagic = 0x4947544e; // "NTGI"
+constexpr uint32_t indexVersion = 2;
+constexpr int recordsBetweenIndexSaves = 256;
+constexpr uint64_t minCompactionSize = 1024 * 1024;
+
+// Starts the data file. The generation is new whenever the data file is
+// created or rewritten, and an index is only used with the data file of the
+// same generation.
+struct DataHeader
+{
+    uint32_t magic = dataMagic;
+    uint32_t version = dataVersion;
+    uint64_t generation = 0;
+};
+
+struct RecordHeader
+{
+    uint32_t magic = recordMagic;
+    uint32_t idSize = 0;
+    uint64_t dataSize = 0;
+    uint64_t checksum = 0;
+};
+
+struct IndexHeader
+{
+    uint32_t magic = indexMagic;
+    uint32_t version = indexVersion;
+    uint64_t generation = 0;
+    uint64_t indexedSize = 0; // Size of the data file covered by the index
+    uint64_t entries = 0;
+};
+
+struct IndexEntry
+{
+    uint32_t idSize = 0;
+    uint32_t reserved = 0;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+};
+
+static_assert(sizeof(DataHeader) % sizeof(capnp::word) == 0);
+static_assert(sizeof(RecordHeader) % sizeof(capnp::word) == 0);
+
+uint64_t paddedSize(uint64_t size)
+{
+    return (size + sizeof(capnp::word) - 1) / sizeof(capnp::word) * sizeof(capnp::word);
+}
+
+uint64_t fnv1a(const void *data, size_t size, uint64_t hash = 0xcbf29ce484222325)
+{
+    const auto *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+uint64_t newGeneration()
+{
+    std::random_device device;
+    return (static_cast<uint64_t>(device()) << 32) ^ device();
+}
+
+/*!
+    Writes the buffered contents of the file to the disk. Data written
+    through other handles of the file is included.
+*/
+bool syncFile(const std::string &fileName)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(fileName.c_str(),
+                              GENERIC_WRITE,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr,
+                              OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    const bool synced = FlushFileBuffers(file);
+    CloseHandle(file);
+    return synced;
+#else
+    const int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    const bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+#endif
+}
+}
+
+TileContainer::TileContainer(const std::string &directory)
+{
+    std::filesystem::path path(directory);
+    std::filesystem::create_directories(path);
+    m_dataFileName = (path / "tiles.dat").string();
+    m_indexFileName = (path / "tiles.idx").string();
+
+    // Create the file if missing without truncating an existing one
+    std::ofstream(m_dataFileName, std::ios::binary | std::ios::app);
+    m_dataFile.open(m_dataFileName, std::ios::binary | std::ios::in | std::ios::out);
+
+    if (!m_dataFile) {
+        std::cerr << "Failed to open " << m_dataFileName << std::endl;
+        return;
+    }
+
+    m_dataFile.seekg(0, std::ios::end);
+    m_dataSize = m_dataFile.tellg();
+
+    if (!loadDataHeader() && !resetDataFile()) {
+        std::cerr << "Failed to initialize " << m_dataFileName << std::endl;
+        m_dataFile.close();
+        return;
+    }
+
+    if (!loadIndex()) {
+        m_index.clear();
+        m_liveSize = 0;
+        m_indexedSize = sizeof(DataHeader);
+    }
+
+    recover();
+
+    if (compactionNeeded()) {
+        compact();
+    }
+}
+
+TileContainer::~TileContainer()
+{
+    if (m_unsavedRecords > 0) {
+        saveIndex();
+    }
+}
+
+bool TileContainer::contains(const std::string &id) const
+{
+    std::lock_guard guard(m_mutex);
+    return m_index.find(id) != m_index.end();
+}
+
+std::shared_ptr<Chart> TileContainer::read(const std::string &id)
+{
+    Entry entry;
+
+    {
+        std::lock_guard guard(m_mutex);
+        auto it = m_index.find(id);
+        if (it == m_index.end()) {
+            return {};
+        }
+
+        // Entries loaded from the saved index are checked on first use, so
+        // opening a container does not read all of its tiles
+        if (!it->second.verified) {
+            if (!verify(id, it->second)) {
+                std::cerr << "Discarding corrupt tile " << id << " in " << m_dataFileName << std::endl;
+                m_liveSize -= it->second.size;
+                m_index.erase(it);
+                m_unsavedRecords++;
+                return {};
+            }
+
+            it->second.verified = true;
+        }
+
+        entry = it->second;
+    }
+
+    return Chart::openMapped(m_dataFileName, entry.offset, entry.size);
+}
+
+bool TileContainer::write(const std::string &id, capnp::MessageBuilder *message)
+{
+    kj::Array<capnp::word> words = capnp::messageToFlatArray(*message);
+
+    std::lock_guard guard(m_mutex);
+    Entry entry;
+
+    if (!append(id, words.asPtr(), entry)) {
+        return false;
+    }
+
+    auto it = m_index.find(id);
+    if (it != m_index.end()) {
+        m_liveSize -= it->second.size;
+    }
+
+    m_index[id] = entry;
+    m_liveSize += entry.size;
+
+    if (++m_unsavedRecords >= recordsBetweenIndexSaves) {
+        saveIndexLocked();
+    }
+
+    return true;
+}
+
+bool TileContainer::append(const std::string &id,
+                           const kj::ArrayPtr<const capnp::word> &data,
+                           Entry &entry)
+{
+    if (!m_dataFile) {
+        return false;
+    }
+
+    RecordHeader header;
+    header.idSize = static_cast<uint32_t>(id.size());
+    header.dataSize = data.size() * sizeof(capnp::word);
+    header.checksum = fnv1a(data.begin(), header.dataSize, fnv1a(id.data(), id.size()));
+
+    const uint64_t recordOffset = m_dataSize;
+    const uint64_t dataOffset = recordOffset + sizeof(header) + paddedSize(id.size());
+    const std::vector<char> padding(paddedSize(id.size()) - id.size(), 0);
+
+    m_dataFile.seekp(recordOffset);
+    m_dataFile.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    m_dataFile.write(id.data(), id.size());
+    m_dataFile.write(padding.data(), padding.size());
+    m_dataFile.write(reinterpret_cast<const char *>(data.begin()), header.dataSize);
+    m_dataFile.flush();
+
+    if (!m_dataFile) {
+        std::cerr << "Failed to append to " << m_dataFileName << std::endl;
+        m_dataFile.clear();
+        return false;
+    }
+
+    m_dataSize = dataOffset + header.dataSize;
+
+    entry.offset = dataOffset;
+    entry.size = header.dataSize;
+    entry.verified = true;
+
+    return true;
+}
+
+bool TileContainer::loadDataHeader()
+{
+    if (m_dataSize < sizeof(DataHeader)) {
+        return false;
+    }
+
+    DataHeader header;
+    m_dataFile.seekg(0);
+    m_dataFile.read(reinterpret_cast<char *>(&header), sizeof(header));
+
+    if (!m_dataFile || header.magic != dataMagic || header.version != dataVersion) {
+        m_dataFile.clear();
+        return false;
+    }
+
+    m_generation = header.generation;
+    return true;
+}
+
+bool TileContainer::resetDataFile()
+{
+    if (m_dataSize > 0) {
+        std::cerr << "Discarding " << m_dataFileName << " of unknown format" << std::endl;
+    }
+
+    // A saved index never matches the new generation, but there is no
+    // reason to keep it around
+    std::error_code errorCode;
+    std::filesystem::remove(m_indexFileName, errorCode);
+
+    DataHeader header;
+    header.generation = newGeneration();
+
+    m_dataFile.close();
+    m_dataFile.open(m_dataFileName, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+    m_dataFile.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    m_dataFile.flush();
+
+    if (!m_dataFile) {
+        return false;
+    }
+
+    m_generation = header.generation;
+    m_dataSize = sizeof(header);
+    return true;
+}
+
+std::optional<TileContainer::Record> TileContainer::readRecord(uint64_t offset)
+{
+    if (offset + sizeof(RecordHeader) > m_dataSize) {
+        return std::nullopt;
+    }
+
+    RecordHeader header;
+    m_dataFile.seekg(offset);
+    m_dataFile.read(reinterpret_cast<char *>(&header), sizeof(header));
+
+    Record record;
+    record.dataOffset = offset + sizeof(header) + paddedSize(header.idSize);
+    record.dataSize = header.dataSize;
+
+    if (!m_dataFile || header.magic != recordMagic
+        || record.dataOffset + header.dataSize > m_dataSize
+        || header.dataSize % sizeof(capnp::word) != 0) {
+        m_dataFile.clear();
+        return std::nullopt;
+    }
+
+    record.id.resize(header.idSize);
+    m_dataFile.read(record.id.data(), record.id.size());
+    m_dataFile.seekg(record.dataOffset);
+    m_buffer.resize(header.dataSize);
+    m_dataFile.read(m_buffer.data(), m_buffer.size());
+
+    if (!m_dataFile || fnv1a(m_buffer.data(), m_buffer.size(), fnv1a(record.id.data(), record.id.size())) != header.checksum) {
+        m_dataFile.clear();
+        return std::nullopt;
+    }
+
+    return record;
+}
+
+bool TileContainer::verify(const std::string &id, const Entry &entry)
+{
+    const uint64_t headerSize = sizeof(RecordHeader) + paddedSize(id.size());
+
+    if (entry.offset < sizeof(DataHeader) + headerSize) {
+        return false;
+    }
+
+    const std::optional<Record> record = readRecord(entry.offset - headerSize);
+    return record && record->id == id && record->dataOffset == entry.offset && record->dataSize == entry.size;
+}
+
+bool TileContainer::loadIndex()
+{
+    std::ifstream file(m_indexFileName, std::ios::binary);
+
+    if (!file) {
+        return false;
+    }
+
+    IndexHeader header;
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+
+    if (!file || header.magic != indexMagic || header.version != indexVersion
+        || header.generation != m_generation
+        || header.indexedSize < sizeof(DataHeader) || header.indexedSize > m_dataSize) {
+        return false;
+    }
+
+    uint64_t checksum = fnv1a(&header, sizeof(header));
+
+    for (uint64_t i = 0; i < header.entries; i++) {
+        IndexEntry indexEntry;
+        file.read(reinterpret_cast<char *>(&indexEntry), sizeof(indexEntry));
+
+        std::string id(indexEntry.idSize, '\0');
+        file.read(id.data(), id.size());
+
+        if (!file || indexEntry.offset + indexEntry.size > header.indexedSize) {
+            return false;
+        }
+
+        checksum = fnv1a(&indexEntry, sizeof(indexEntry), checksum);
+        checksum = fnv1a(id.data(), id.size(), checksum);
+        m_index[id] = { indexEntry.offset, indexEntry.size };
+        m_liveSize += indexEntry.size;
+    }
+
+    uint64_t storedChecksum = 0;
+    file.read(reinterpret_cast<char *>(&storedChecksum), sizeof(storedChecksum));
+
+    if (!file || storedChecksum != checksum) {
+        return false;
+    }
+
+    m_indexedSize = header.indexedSize;
+    return true;
+}
+
+void TileContainer::recover()
+{
+    if (!m_dataFile) {
+        return;
+    }
+
+    uint64_t offset = m_indexedSize;
+
+    while (const std::optional<Record> record = readRecord(offset)) {
+        auto it = m_index.find(record->id);
+        if (it != m_index.end()) {
+            m_liveSize -= it->second.size;
+        }
+
+        m_index[record->id] = { record->dataOffset, record->dataSize, true };
+        m_liveSize += record->dataSize;
+
+        m_unsavedRecords++;
+        offset = record->dataOffset + record->dataSize;
+    }
+
+    m_dataFile.clear();
+
+    if (offset < m_dataSize) {
+        std::cerr << "Discarding " << m_dataSize - offset << " bytes of incomplete tiles in "
+                  << m_dataFileName << std::endl;
+        m_dataFile.close();
+        std::error_code errorCode;
+        std::filesystem::resize_file(m_dataFileName, offset, errorCode);
+        m_dataFile.open(m_dataFileName, std::ios::binary | std::ios::in | std::ios::out);
+        m_dataSize = offset;
+    }
+
+    if (m_unsavedRecords > 0) {
+        saveIndexLocked();
+    }
+}
+
+bool TileContainer::compactionNeeded() const
+{
+    return m_dataSize > minCompactionSize && m_dataSize > 2 * m_liveSize;
+}
+
+bool TileContainer::compact()
+{
+    std::lock_guard guard(m_mutex);
+
+    const std::string temporaryFileName = m_dataFileName + ".tmp";
+    std::ofstream output(temporaryFileName, std::ios::binary | std::ios::trunc);
+    std::unordered_map<std::string, Entry> index;
+    std::vector<char> buffer;
+
+    DataHeader dataHeader;
+    dataHeader.generation = newGeneration();
+    output.write(reinterpret_cast<const char *>(&dataHeader), sizeof(dataHeader));
+    uint64_t offset = sizeof(dataHeader);
+
+    for (const auto &[id, entry] : m_index) {
+        buffer.resize(entry.size);
+        m_dataFile.seekg(entry.offset);
+        m_dataFile.read(buffer.data(), buffer.size());
+
+        RecordHeader header;
+        header.idSize = static_cast<uint32_t>(id.size());
+        header.dataSize = entry.size;
+        header.checksum = fnv1a(buffer.data(), buffer.size(), fnv1a(id.data(), id.size()));
+        const std::vector<char> padding(paddedSize(id.size()) - id.size(), 0);
+
+        output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        output.write(id.data(), id.size());
+        output.write(padding.data(), padding.size());
+        output.write(buffer.data(), buffer.size());
+
+        const uint64_t dataOffset = offset + sizeof(header) + paddedSize(id.size());
+        index[id] = { dataOffset, entry.size, entry.verified };
+        offset = dataOffset + entry.size;
+    }
+
+    output.close();
+
+    // The new data file must be complete on disk before it replaces the old
+    // one. The saved index has the old generation and is ignored from then
+    // on, so a crash before the new index is saved only costs a scan.
+    if (!m_dataFile || !output || !syncFile(temporaryFileName)) {
+        std::cerr << "Failed to compact " << m_dataFileName << std::endl;
+        m_dataFile.clear();
+        std::filesystem::remove(temporaryFileName);
+        return false;
+    }
+
+    // Tiles already mapped keep the old file alive until they are released
+    m_dataFile.close();
+    std::error_code errorCode;
+    std::filesystem::rename(temporaryFileName, m_dataFileName, errorCode);
+
+    if (errorCode) {
+        std::cerr << "Failed to replace " << m_dataFileName << ": " << errorCode.message() << std::endl;
+        m_dataFile.open(m_dataFileName, std::ios::binary | std::ios::in | std::ios::out);
+        return false;
+    }
+
+    m_dataFile.open(m_dataFileName, std::ios::binary | std::ios::in | std::ios::out);
+    m_generation = dataHeader.generation;
+    m_index = std::move(index);
+    m_dataSize = offset;
+    m_indexedSize = sizeof(dataHeader);
+
+    return saveIndexLocked();
+}
+
+bool TileContainer::saveIndex()
+{
+    std::lock_guard guard(m_mutex);
+    return saveIndexLocked();
+}
+
+bool TileContainer::saveIndexLocked()
+{
+    // The index must never cover records that are not on disk yet
+    m_dataFile.flush();
+    if (!m_dataFile || !syncFile(m_dataFileName)) {
+        std::cerr << "Failed to sync " << m_dataFileName << std::endl;
+        m_dataFile.clear();
+        return false;
+    }
+
+    const std::string temporaryFileName = m_indexFileName + ".tmp";
+    std::ofstream file(temporaryFileName, std::ios::binary | std::ios::trunc);
+
+    IndexHeader header;
+    header.generation = m_generation;
+    header.indexedSize = m_dataSize;
+    header.entries = m_index.size();
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    uint64_t checksum = fnv1a(&header, sizeof(header));
+
+    for (const auto &[id, entry] : m_index) {
+        IndexEntry indexEntry;
+        indexEntry.idSize = static_cast<uint32_t>(id.size());
+        indexEntry.offset = entry.offset;
+        indexEntry.size = entry.size;
+        file.write(reinterpret_cast<const char *>(&indexEntry), sizeof(indexEntry));
+        file.write(id.data(), id.size());
+        checksum = fnv1a(&indexEntry, sizeof(indexEntry), checksum);
+        checksum = fnv1a(id.data(), id.size(), checksum);
+    }
+
+    file.write(reinterpret_cast<const char *>(&checksum), sizeof(checksum));
+    file.close();
+
+    if (!file || !syncFile(temporaryFileName)) {
+        std::cerr << "Failed to write " << m_indexFileName << std::endl;
+        return false;
+    }
+
+    std::error_code errorCode;
+    std::filesystem::rename(temporaryFileName, m_indexFileName, errorCode);
+
+    if (errorCode) {
+        std::cerr << "Failed to replace " << m_indexFileName << ": " << errorCode.message() << std::endl;
+        return false;
+    }
+
+    m_indexedSize = m_dataSize;
+    m_unsavedRecords = 0;
+    return true;
+}
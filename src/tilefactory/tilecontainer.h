@@ -0,0 +1,91 @@
+#pragma once
+
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <capnp/message.h>
+
+#include "tilefactory/chart.h"
+
+/*!
+    All cached tiles of one chart stored in a single file
+
+    Tiles are appended as records to a data file and never modified in
+    place. An index from tile id to record is kept in memory so checking for
+    a tile does not touch the file system, and reading a tile maps its slice
+    of the data file.
+
+    The index is saved next to the data file from time to time, after the
+    data file is synced to disk. Records appended after the last save are
+    recovered by scanning the data file from where the saved index ends. A
+    record torn by a crash fails its checksum and is cut off together with
+    anything after it. Records found through the saved index are checked
+    against their checksum when first read.
+
+    The data file starts with a generation that changes whenever the file is
+    created or rewritten. An index saved for another generation is ignored.
+*/
+class TileContainer
+{
+public:
+    TileContainer(const std::string &directory);
+    ~TileContainer();
+    TileContainer(const TileContainer &) = delete;
+    TileContainer &operator=(const TileContainer &) = delete;
+
+    bool contains(const std::string &id) const;
+    std::shared_ptr<Chart> read(const std::string &id);
+    bool write(const std::string &id, capnp::MessageBuilder *message);
+
+    /*!
+        Rewrites the data file without replaced records
+    */
+    bool compact();
+    bool saveIndex();
+
+private:
+    struct Entry
+    {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        bool verified = false;
+    };
+
+    struct Record
+    {
+        std::string id;
+        uint64_t dataOffset = 0;
+        uint64_t dataSize = 0;
+    };
+
+    bool append(const std::string &id, const kj::ArrayPtr<const capnp::word> &data, Entry &entry);
+    bool loadDataHeader();
+    bool resetDataFile();
+
+    /*!
+        Returns the record starting at offset if it is complete and matches
+        its checksum
+    */
+    std::optional<Record> readRecord(uint64_t offset);
+    bool verify(const std::string &id, const Entry &entry);
+    bool loadIndex();
+    void recover();
+    bool compactionNeeded() const;
+    bool saveIndexLocked();
+    std::string m_dataFileName;
+    std::string m_indexFileName;
+    std::fstream m_dataFile;
+    std::unordered_map<std::string, Entry> m_index;
+    std::vector<char> m_buffer;
+    uint64_t m_generation = 0;
+    uint64_t m_dataSize = 0;
+    uint64_t m_liveSize = 0;
+    uint64_t m_indexedSize = 0;
+    int m_unsavedRecords = 0;
+    mutable std::mutex m_mutex;
+};
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 #include <random>
@@ -16,26 +17,115 @@
 #include "tilefactory/tilefactory.h"
 
 #include "coverageratio.h"
+#include "extenttree.h"
+#include "tilegrid.h"
 
 namespace {
-constexpr int maxTileSize = 1024;
 float coverageAccpetanceThreshold = 0.98f;
 
+// Number of levels a dense tile may be split below the viewport zoom
+constexpr int maxSplitDepth = 2;
+
+// Number of tiles whose vertex counts are kept for estimating the density
+// of tiles not generated yet
+constexpr size_t maxVertexCounts = 4096;
+
+// The accumulated coverage is rounded to 1e-5 degrees. Charts below are
+// trimmed against the coverage shrunk by twice that, so that rounding never
+// opens a gap between neighbouring charts.
+constexpr double trimOverlap = 2e-5;
+
+/*!
+    Returns the key of a trimmed tile. A chart is trimmed against the charts
+    above it, which only change together with the composition plan.
+*/
+std::string trimmedTileKey(const std::string &tileId,
+                           const std::vector<TileFactory::Source> &sources,
+                           size_t chart)
+{
+    std::string key = tileId + "@";
+
+    for (size_t i = 0; i < chart; i++) {
+        key += (i > 0 ? "," : "") + sources[i].name;
+    }
+
+    return key;
+}
+
 mercatortile::LngLatBbox convertToMercatorTileBox(const GeoRect &rect)
 {
     return { rect.left(), rect.bottom(), rect.right(), rect.top() };
 }
 
-GeoRect convertToGeoRect(const mercatortile::LngLatBbox &lngLatBox)
+template <typename T>
+size_t polygonVertexCount(const typename capnp::List<T>::Reader &items)
 {
-    return { lngLatBox.north, lngLatBox.south, lngLatBox.west, lngLatBox.east };
+    size_t count = 0;
+
+    for (const typename T::Reader &item : items) {
+        for (const ChartData::Polygon::Reader &polygon : item.getPolygons()) {
+            count += polygon.getMain().getCoordinates().size() / 2;
+
+            for (const ChartData::Path::Reader &hole : polygon.getHoles()) {
+                count += hole.getCoordinates().size() / 2;
+            }
+        }
+    }
+
+    return count;
+}
+
+template <typename T>
+size_t lineVertexCount(const typename capnp::List<T>::Reader &items)
+{
+    size_t count = 0;
+
+    for (const typename T::Reader &item : items) {
+        for (const ChartData::Line::Reader &line : item.getLines()) {
+            count += line.getPositions().getCoordinates().size() / 2;
+        }
+    }
+
+    return count;
+}
+
+/*!
+    Returns the number of vertices and points that the chart adds to a tile.
+    Only list sizes are read, nothing is decoded.
+*/
+size_t vertexCount(const Chart &chart)
+{
+    return polygonVertexCount<ChartData::CoverageArea>(chart.coverage())
+        + polygonVertexCount<ChartData::LandArea>(chart.landAreas())
+        + polygonVertexCount<ChartData::BuiltUpArea>(chart.builtUpAreas())
+        + polygonVertexCount<ChartData::DepthArea>(chart.depthAreas())
+        + polygonVertexCount<ChartData::Pontoon>(chart.pontoons())
+        + polygonVertexCount<ChartData::ShorelineConstruction>(chart.shorelineConstructions())
+        + polygonVertexCount<ChartData::Road>(chart.roads())
+        + lineVertexCount<ChartData::CoastLine>(chart.coastLines())
+        + lineVertexCount<ChartData::DepthContour>(chart.depthContours())
+        + lineVertexCount<ChartData::Pontoon>(chart.pontoons())
+        + lineVertexCount<ChartData::ShorelineConstruction>(chart.shorelineConstructions())
+        + lineVertexCount<ChartData::Road>(chart.roads())
+        + chart.soundings().size()
+        + chart.beacons().size()
+        + chart.underwaterRocks().size()
+        + chart.lateralBuoys().size();
+}
 }
+
+TileFactory::TileFactory()
+    : m_sources(std::make_shared<const Sources>(Sources { {}, std::make_shared<const ExtentTree>() }))
+{
 }
 
+TileFactory::~TileFactory() = default;
+
 void TileFactory::clear()
 {
     const std::lock_guard<std::mutex> lock(m_sourcesMutex);
-    m_sources.clear();
+    m_sources.store(std::make_shared<const Sources>(Sources { {}, std::make_shared<const ExtentTree>() }));
+    invalidateCompositionPlans();
 }
 
 void TileFactory::setChartEnabled(const std::string &name, bool enabled)
@@ -45,16 +135,30 @@ void TileFactory::setChartEnabled(const std::string &name, bool enabled)
     {
         const std::lock_guard<std::mutex> lock(m_sourcesMutex);
 
-        for (auto &source : m_sources) {
+        auto sources = std::make_shared<Sources>(*m_sources.load());
+
+        for (auto &source : sources->sources) {
             if (source.name == name) {
                 if (source.enabled == enabled) {
                     return;
                 }
                 source.enabled = enabled;
                 changedSources.push_back(source);
-                if (m_chartsChangedCb) {
-                    m_chartsChangedCb({ source.tileSource->extent() });
-                }
+            }
+        }
+
+        if (changedSources.empty()) {
+            return;
+        }
+
+        // Plans are invalidated after publishing so that a plan composed from
+        // the previous snapshot is never stored
+        m_sources.store(std::move(sources));
+        invalidateCompositionPlans();
+
+        if (m_chartsChangedCb) {
+            for (const Source &source : changedSources) {
+                m_chartsChangedCb({ source.tileSource->extent() });
             }
         }
     }
@@ -64,6 +168,7 @@ void TileFactory::setChartEnabled(const std::string &name, bool enabled)
     }
 
     std::vector<std::string> tilesAffected;
+    const std::lock_guard<std::mutex> lock(m_previousTilesMutex);
 
     for (const Source &source : changedSources) {
         for (const Tile &tile : m_previousTiles) {
@@ -83,8 +188,10 @@ std::vector<int> TileFactory::setAllChartsEnabled(bool enabled)
 
     const std::lock_guard<std::mutex> lock(m_sourcesMutex);
 
+    auto sources = std::make_shared<Sources>(*m_sources.load());
+
     int i = 0;
-    for (auto &source : m_sources) {
+    for (auto &source : sources->sources) {
         if (source.enabled != enabled) {
             source.enabled = enabled;
             rects.push_back(source.tileSource->extent());
@@ -93,6 +200,11 @@ std::vector<int> TileFactory::setAllChartsEnabled(bool enabled)
         }
     }
 
+    if (!rects.empty()) {
+        m_sources.store(std::move(sources));
+        invalidateCompositionPlans();
+    }
+
     if (m_chartsChangedCb) {
         m_chartsChangedCb(rects);
     }
@@ -118,11 +230,12 @@ bool TileFactory::chartEnabledForTile(const std::string &chart,
 std::vector<TileFactory::Source> TileFactory::sourceCandidates(const GeoRect &rect,
                                                                double pixelsPerLon)
 {
-    const std::lock_guard<std::mutex> lock(m_sourcesMutex);
+    const std::shared_ptr<const Sources> sources = m_sources.load();
     std::vector<TileFactory::Source> validSources;
 
-    for (auto it = m_sources.cbegin(); it < m_sources.cend(); it++) {
-        const TileFactory::Source &source = *it;
+    // The indexes are sorted, so the candidates keep the order of priority
+    for (uint32_t i : sources->extents->query(rect)) {
+        const TileFactory::Source &source = sources->sources[i];
         assert(source.tileSource);
 
         if (!source.enabled) {
@@ -133,13 +246,9 @@ std::vector<TileFactory::Source> TileFactory::sourceCandidates(const GeoRect &re
 
         const std::shared_ptr<ITileSource> &tileSource = source.tileSource;
 
-        if (!tileSource->extent().intersects(rect)) {
-            continue;
-        }
-
         // Avoid showing too detailed maps when zoomed out, but always show last
         // chart with the lowest detail
-        if (scaleActual / 4 > tileSource->scale() && std::next(it, 1) != m_sources.end()) {
+        if (scaleActual / 4 > tileSource->scale() && i + 1 != sources->sources.size()) {
             continue;
         }
 
@@ -171,34 +280,208 @@ std::vector<TileFactory::ChartInfo> TileFactory::chartInfo(const GeoRect &rect,
 std::vector<std::shared_ptr<Chart>> TileFactory::tileData(const GeoRect &rect,
                                                           double pixelsPerLongitude)
 {
-    std::vector<std::shared_ptr<Chart>> chartDatas;
-    auto sources = sourceCandidates(rect, pixelsPerLongitude);
+    return tileData(std::vector<GeoRect> { rect }, pixelsPerLongitude).front();
+}
 
-    std::string tileId = FileHelper::tileId(rect, pixelsPerLongitude);
-    CoverageRatio coverageRatio(rect);
+std::vector<std::vector<std::shared_ptr<Chart>>> TileFactory::tileData(const std::vector<GeoRect> &rects,
+                                                                       double pixelsPerLongitude)
+{
+    struct PendingTile
+    {
+        std::vector<Source> sources;
+        std::string tileId;
+        CoverageRatio coverageRatio;
+        std::vector<std::shared_ptr<Chart>> chartDatas;
+        size_t nextSource = 0;
+        bool planned = false;
+        uint64_t planGeneration = 0;
+
+        // Sources of chartDatas
+        std::vector<Source> contributingSources;
+    };
+
+    std::vector<PendingTile> pendingTiles;
+    pendingTiles.reserve(rects.size());
+
+    for (const GeoRect &rect : rects) {
+        const std::string tileId = FileHelper::tileId(rect, pixelsPerLongitude);
+
+        // The plan generation is read before the sources, so that a plan
+        // composed from sources replaced in between is discarded
+        uint64_t planGeneration = 0;
+        std::optional<std::vector<std::string>> plan = compositionPlan(tileId, planGeneration);
+
+        PendingTile tile { sourceCandidates(rect, pixelsPerLongitude),
+                           tileId,
+                           CoverageRatio(rect) };
+        tile.planGeneration = planGeneration;
+
+        if (plan) {
+            // Only the charts that contributed when the tile was composed are
+            // opened. The candidates keep their order of priority.
+            std::erase_if(tile.sources, [&plan](const Source &source) {
+                return std::find(plan->begin(), plan->end(), source.name) == plan->end();
+            });
+            tile.planned = true;
+        }
 
-    for (const auto &source : sources) {
-        const std::shared_ptr<ITileSource> &tileSource = source.tileSource;
-        std::shared_ptr<Chart> tileData = tileSource->create(rect, pixelsPerLongitude);
+        pendingTiles.push_back(std::move(tile));
+    }
+
+    // Charts are added to each tile in order of priority until the tile is
+    // covered. Each round takes the next chart of every unfinished tile and
+    // groups the requests by source so that each source is asked only once
+    // per round.
+    while (true) {
+        std::unordered_map<ITileSource *, std::vector<size_t>> requests;
+        std::unordered_map<ITileSource *, std::shared_ptr<ITileSource>> requestedSources;
+
+        for (size_t i = 0; i < pendingTiles.size(); i++) {
+            PendingTile &tile = pendingTiles[i];
+
+            while (tile.nextSource < tile.sources.size()
+                   && !chartEnabledForTile(tile.sources[tile.nextSource].name, tile.tileId)) {
+                tile.nextSource++;
+            }
+
+            if (tile.nextSource == tile.sources.size()) {
+                continue;
+            }
+
+            const std::shared_ptr<ITileSource> &tileSource = tile.sources[tile.nextSource].tileSource;
+            requests[tileSource.get()].push_back(i);
+            requestedSources[tileSource.get()] = tileSource;
+        }
+
+        if (requests.empty()) {
+            break;
+        }
+
+        for (const auto &[tileSource, tileIndexes] : requests) {
+            std::vector<GeoRect> boundingBoxes;
+            for (size_t i : tileIndexes) {
+                boundingBoxes.push_back(rects[i]);
+            }
+
+            std::vector<std::shared_ptr<Chart>> created = requestedSources[tileSource]->createMany(boundingBoxes,
+                                                                                                  pixelsPerLongitude);
+            assert(created.size() == tileIndexes.size());
+
+            for (size_t j = 0; j < tileIndexes.size(); j++) {
+                PendingTile &tile = pendingTiles[tileIndexes[j]];
+                const Source source = tile.sources[tile.nextSource];
+                tile.nextSource++;
+
+                const std::shared_ptr<Chart> &tileData = created[j];
+
+                if (!tileData) {
+                    std::cerr << "No tile data created" << std::endl;
+                    continue;
+                }
+
+                if (tile.planned) {
+                    tile.chartDatas.push_back(tileData);
+                    tile.contributingSources.push_back(source);
+                    continue;
+                }
+
+                // Charts entirely hidden under the charts already added do
+                // not add to the coverage and are left out of the tile.
+                const float previousRatio = tile.coverageRatio.ratio();
+                tile.coverageRatio.accumulate(tileData->coverage());
+
+                if (tile.coverageRatio.ratio() > previousRatio) {
+                    tile.chartDatas.push_back(tileData);
+                    tile.contributingSources.push_back(source);
+                }
+
+                if (tile.coverageRatio.ratio() >= coverageAccpetanceThreshold) {
+                    tile.nextSource = tile.sources.size();
+                }
+            }
+        }
+    }
+
+    std::vector<std::vector<std::shared_ptr<Chart>>> result;
+    result.reserve(pendingTiles.size());
+
+    for (size_t i = 0; i < pendingTiles.size(); i++) {
+        PendingTile &tile = pendingTiles[i];
+
+        if (!tile.planned) {
+            std::vector<std::string> contributingCharts;
+            for (const Source &source : tile.contributingSources) {
+                contributingCharts.push_back(source.name);
+            }
+            setCompositionPlan(tile.tileId, std::move(contributingCharts), tile.planGeneration);
+        }
+
+        const std::vector<std::shared_ptr<Chart>> charts = trimOverdraw(rects[i],
+                                                                        tile.tileId,
+                                                                        tile.contributingSources,
+                                                                        tile.chartDatas);
+
+        size_t vertices = 0;
+        for (const std::shared_ptr<Chart> &chart : charts) {
+            vertices += vertexCount(*chart);
+        }
+        setVertexCount(tile.tileId, vertices, tile.planGeneration);
+
+        result.emplace_back(charts.rbegin(), charts.rend());
+    }
+
+    return result;
+}
+
+std::vector<std::shared_ptr<Chart>> TileFactory::trimOverdraw(const GeoRect &rect,
+                                                              const std::string &tileId,
+                                                              const std::vector<Source> &sources,
+                                                              const std::vector<std::shared_ptr<Chart>> &charts)
+{
+    assert(sources.size() == charts.size());
 
-        if (!tileData) {
-            std::cerr << "No tile data created" << std::endl;
+    std::vector<std::shared_ptr<Chart>> trimmed;
+    trimmed.reserve(charts.size());
+    CoverageRatio coverage(rect);
+    size_t accumulated = 0;
+
+    for (size_t i = 0; i < charts.size(); i++) {
+        if (i == 0) {
+            trimmed.push_back(charts[i]);
             continue;
         }
 
-        if (!chartEnabledForTile(source.name, tileId)) {
+        const std::shared_ptr<ITileSource> &tileSource = sources[i].tileSource;
+        const std::string key = trimmedTileKey(tileId, sources, i);
+
+        if (std::shared_ptr<Chart> cached = tileSource->derivedTile(key)) {
+            trimmed.push_back(cached);
             continue;
         }
 
-        chartDatas.push_back(tileData);
-        coverageRatio.accumulate(tileData->coverage());
+        for (; accumulated < i; accumulated++) {
+            coverage.accumulate(charts[accumulated]->coverage());
+        }
 
-        if (coverageRatio.ratio() >= coverageAccpetanceThreshold) {
-            break;
+        const Clipper2Lib::PathsD hidden = coverage.coverage().empty()
+            ? Clipper2Lib::PathsD()
+            : Clipper2Lib::InflatePaths(coverage.coverage(),
+                                        -trimOverlap,
+                                        Clipper2Lib::JoinType::Miter,
+                                        Clipper2Lib::EndType::Polygon,
+                                        2.0,
+                                        Chart::trimPrecision);
+
+        if (hidden.empty()) {
+            trimmed.push_back(charts[i]);
+            continue;
         }
+
+        std::unique_ptr<capnp::MallocMessageBuilder> message = charts[i]->buildTrimmed(hidden);
+        trimmed.push_back(tileSource->storeDerivedTile(key, message.get()));
     }
 
-    return std::vector<std::shared_ptr<Chart>>(chartDatas.rbegin(), chartDatas.rend());
+    return trimmed;
 }
 
 std::vector<TileFactory::Tile> TileFactory::tiles(const Pos &center,
@@ -214,11 +497,18 @@ std::vector<TileFactory::Tile> TileFactory::tiles(const Pos &center,
     double north = Mercator::mercatorHeightInverse(center.lat(), -height / 2, pixelsPerLongitude);
 
     const GeoRect viewport(north, south, west, east);
-    double logArg = 360 * pixelsPerLongitude / static_cast<double>(maxTileSize);
-    double zoom = ceil(log2(logArg));
-    zoom = std::clamp<double>(zoom, 0, 23);
-    int maxPixelsPerLon = maxTileSize / 360. * pow(2, zoom);
-    std::vector<GeoRect> tileLocations = tilesInViewport(viewport, zoom);
+    int zoom = TileGrid::zoom(pixelsPerLongitude);
+    std::vector<TileId> tileLocations = tilesInViewport(viewport, zoom);
+
+    if (const size_t budget = m_tileVertexBudget; budget > 0) {
+        std::vector<TileId> adaptiveLocations;
+        for (const TileId &tileId : tileLocations) {
+            appendAdaptiveTile(adaptiveLocations, tileId, 0, budget);
+        }
+        tileLocations = std::move(adaptiveLocations);
+    }
+
+    const std::lock_guard<std::mutex> lock(m_previousTilesMutex);
 
     if (m_previousTileLocations == tileLocations) {
         return m_previousTiles;
@@ -226,18 +516,15 @@ std::vector<TileFactory::Tile> TileFactory::tiles(const Pos &center,
     m_previousTileLocations = tileLocations;
 
     std::vector<TileFactory::Tile> tiles;
-
-    const std::lock_guard<std::mutex> lock(m_sourcesMutex);
-
-    for (const auto &tileRect : tileLocations) {
-        for (const auto &source : m_sources) {
-            if (tileRect.intersects(source.tileSource->extent())) {
-                Tile tile { FileHelper::tileId(tileRect, maxPixelsPerLon),
-                            tileRect,
-                            maxPixelsPerLon };
-                tiles.push_back(tile);
-                break;
-            }
+    const std::shared_ptr<const Sources> sources = m_sources.load();
+
+    for (const TileId &tileId : tileLocations) {
+        const GeoRect tileRect = tileId.boundingBox();
+        if (sources->extents->intersects(tileRect)) {
+            Tile tile { tileId.toString(),
+                        tileRect,
+                        TileGrid::pixelsPerLon(tileId.zoom()) };
+            tiles.push_back(tile);
         }
     }
 
@@ -245,25 +532,97 @@ std::vector<TileFactory::Tile> TileFactory::tiles(const Pos &center,
     return tiles;
 }
 
-std::vector<GeoRect> TileFactory::tilesInViewport(const GeoRect &rect, int zoom)
+std::vector<TileId> TileFactory::tilesInViewport(const GeoRect &rect, int zoom)
 {
     assert(zoom >= 0);
 
     const auto mercatorTiles = mercatortile::tiles(convertToMercatorTileBox(rect), zoom);
-    std::vector<GeoRect> geoRects(mercatorTiles.size());
+    std::vector<TileId> tileIds(mercatorTiles.size());
 
-    std::transform(mercatorTiles.cbegin(), mercatorTiles.cend(), geoRects.begin(),
+    std::transform(mercatorTiles.cbegin(), mercatorTiles.cend(), tileIds.begin(),
                    [](const mercatortile::Tile &tile) {
-                       return convertToGeoRect(mercatortile::bounds(tile));
+                       return TileId(tile.z, tile.x, tile.y);
                    });
 
-    return geoRects;
+    return tileIds;
+}
+
+void TileFactory::setTileVertexBudget(size_t budget)
+{
+    m_tileVertexBudget = budget;
+
+    const std::lock_guard<std::mutex> lock(m_previousTilesMutex);
+    m_previousTileLocations.clear();
+}
+
+void TileFactory::appendAdaptiveTile(std::vector<TileId> &tileIds,
+                                     const TileId &tileId,
+                                     int depth,
+                                     size_t budget) const
+{
+    if (depth < maxSplitDepth && tileId.zoom() < TileGrid::maxZoom && vertexEstimate(tileId) > budget) {
+        for (const TileId &child : tileId.children()) {
+            appendAdaptiveTile(tileIds, child, depth + 1, budget);
+        }
+        return;
+    }
+
+    tileIds.push_back(tileId);
+}
+
+size_t TileFactory::vertexEstimate(const TileId &tileId) const
+{
+    const std::lock_guard<std::mutex> lock(m_vertexCountsMutex);
+
+    // A tile not generated yet gets its share of the closest generated
+    // ancestor
+    TileId ancestor = tileId;
+    size_t share = 1;
+
+    for (int level = 0; level <= maxSplitDepth; level++) {
+        auto it = m_vertexCounts.find(ancestor.toString());
+        if (it != m_vertexCounts.end()) {
+            return it->second.count / share;
+        }
+
+        if (ancestor.zoom() == 0) {
+            break;
+        }
+
+        ancestor = ancestor.parent();
+        share *= 4;
+    }
+
+    return 0;
+}
+
+void TileFactory::setVertexCount(const std::string &tileId, size_t count, uint64_t generation)
+{
+    const std::scoped_lock lock(m_compositionPlansMutex, m_vertexCountsMutex);
+
+    // The tile was composed from sources or settings changed since
+    if (generation != m_compositionPlansGeneration) {
+        return;
+    }
+
+    auto it = m_vertexCounts.find(tileId);
+    if (it != m_vertexCounts.end()) {
+        m_vertexCountOrder.erase(it->second.order);
+        m_vertexCounts.erase(it);
+    }
+
+    m_vertexCountOrder.push_back(tileId);
+    m_vertexCounts[tileId] = { count, std::prev(m_vertexCountOrder.end()) };
+
+    if (m_vertexCounts.size() > maxVertexCounts) {
+        m_vertexCounts.erase(m_vertexCountOrder.front());
+        m_vertexCountOrder.pop_front();
+    }
 }
 
 bool TileFactory::hasSource(const std::string &name)
 {
-    const std::lock_guard<std::mutex> lock(m_sourcesMutex);
-    for (const auto &source : m_sources) {
+    for (const auto &source : m_sources.load()->sources) {
         if (source.name == name) {
             return true;
         }
@@ -277,7 +636,7 @@ void TileFactory::setSources(const std::vector<TileFactory::Source> &sources)
     std::vector<TileFactory::Source> qualifiedSources;
     std::vector<GeoRect> rois;
 
-    for (const auto &source : m_sources) {
+    for (const auto &source : m_sources.load()->sources) {
         rois.push_back(source.tileSource->extent());
     }
 
@@ -290,15 +649,26 @@ void TileFactory::setSources(const std::vector<TileFactory::Source> &sources)
         rois.push_back(source.tileSource->extent());
     }
 
-    m_previousTileLocations.clear();
-    m_sources = qualifiedSources;
-
-    std::sort(m_sources.begin(),
-              m_sources.end(),
+    std::sort(qualifiedSources.begin(),
+              qualifiedSources.end(),
               [](const TileFactory::Source &a, const TileFactory::Source &b) -> bool {
                   return a.tileSource->scale() < b.tileSource->scale();
               });
 
+    std::vector<GeoRect> extents(qualifiedSources.size());
+    std::transform(qualifiedSources.begin(), qualifiedSources.end(), extents.begin(), [](const Source &source) {
+        return source.tileSource->extent();
+    });
+
+    m_sources.store(std::make_shared<const Sources>(Sources { std::move(qualifiedSources),
+                                                              std::make_shared<const ExtentTree>(extents) }));
+    invalidateCompositionPlans();
+
+    {
+        const std::lock_guard<std::mutex> lock(m_previousTilesMutex);
+        m_previousTileLocations.clear();
+    }
+
     if (m_updateCallback) {
         m_updateCallback();
     }
@@ -308,6 +678,42 @@ void TileFactory::setSources(const std::vector<TileFactory::Source> &sources)
     }
 }
 
+std::optional<std::vector<std::string>> TileFactory::compositionPlan(const std::string &tileId,
+                                                                     uint64_t &generation)
+{
+    const std::lock_guard<std::mutex> lock(m_compositionPlansMutex);
+    generation = m_compositionPlansGeneration;
+
+    auto it = m_compositionPlans.find(tileId);
+    if (it == m_compositionPlans.end()) {
+        return {};
+    }
+    return it->second;
+}
+
+void TileFactory::setCompositionPlan(const std::string &tileId,
+                                     std::vector<std::string> charts,
+                                     uint64_t generation)
+{
+    const std::lock_guard<std::mutex> lock(m_compositionPlansMutex);
+
+    // The sources changed while the tile was composed
+    if (generation != m_compositionPlansGeneration) {
+        return;
+    }
+    m_compositionPlans[tileId] = std::move(charts);
+}
+
+void TileFactory::invalidateCompositionPlans()
+{
+    // Vertex counts follow the composition of each tile
+    const std::scoped_lock lock(m_compositionPlansMutex, m_vertexCountsMutex);
+    m_compositionPlans.clear();
+    m_compositionPlansGeneration++;
+    m_vertexCounts.clear();
+    m_vertexCountOrder.clear();
+}
+
 void TileFactory::setTileSettings(const std::string &tileId, TileSettings tileSettings)
 {
     std::unordered_map<std::string, TileSettings>::const_iterator it = m_tileSettings.find(tileId);
@@ -317,6 +723,20 @@ void TileFactory::setTileSettings(const std::string &tileId, TileSettings tileSe
 
     m_tileSettings[tileId] = tileSettings;
 
+    {
+        // Disabling a chart may uncover charts that the plan left out. A
+        // tile composed meanwhile must not store its plan either.
+        const std::scoped_lock lock(m_compositionPlansMutex, m_vertexCountsMutex);
+        m_compositionPlans.erase(tileId);
+        m_compositionPlansGeneration++;
+
+        auto it = m_vertexCounts.find(tileId);
+        if (it != m_vertexCounts.end()) {
+            m_vertexCountOrder.erase(it->second.order);
+            m_vertexCounts.erase(it);
+        }
+    }
+
     if (!m_tileDataChangedCallback) {
         return;
     }
@@ -326,37 +746,7 @@ void TileFactory::setTileSettings(const std::string &tileId, TileSettings tileSe
 
 std::optional<GeoRect> TileFactory::totalExtent()
 {
-    if (m_sources.empty()) {
-        return {};
-    }
-
-    const std::lock_guard<std::mutex> lock(m_sourcesMutex);
-
-    std::vector<double> lefts(m_sources.size());
-    std::vector<double> rights(m_sources.size());
-    std::vector<double> tops(m_sources.size());
-    std::vector<double> bottoms(m_sources.size());
-
-    std::transform(m_sources.begin(), m_sources.end(), lefts.begin(), [](const Source &source) {
-        return source.tileSource->extent().left();
-    });
-
-    std::transform(m_sources.begin(), m_sources.end(), rights.begin(), [](const Source &source) {
-        return source.tileSource->extent().right();
-    });
-
-    std::transform(m_sources.begin(), m_sources.end(), tops.begin(), [](const Source &source) {
-        return source.tileSource->extent().top();
-    });
-
-    std::transform(m_sources.begin(), m_sources.end(), bottoms.begin(), [](const Source &source) {
-        return source.tileSource->extent().bottom();
-    });
-
-    GeoRect extent(*std::max_element(tops.begin(), tops.end()),
-                   *std::min_element(bottoms.begin(), bottoms.end()),
-                   *std::min_element(lefts.begin(), lefts.end()),
-                   *std::max_element(rights.begin(), rights.end()));
+    GeoRect extent = m_sources.load()->extents->bounds();
     if (extent.isNull()) {
         return {};
     }
@@ -0,0 +1,16 @@
+#include <algorithm>
+#include <cmath>
+
+#include "tilegrid.h"
+
+int TileGrid::zoom(double pixelsPerLon)
+{
+    double logArg = 360 * pixelsPerLon / static_cast<double>(maxTileSize);
+    double zoom = ceil(log2(logArg));
+    return static_cast<int>(std::clamp<double>(zoom, 0, maxZoom));
+}
+
+int TileGrid::pixelsPerLon(int zoom)
+{
+    return maxTileSize / 360. * pow(2, zoom);
+}
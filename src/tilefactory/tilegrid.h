@@ -0,0 +1,19 @@
+#pragma once
+
+/*!
+    Relation between mercator zoom levels and the tile resolution in pixels
+    per longitude
+*/
+class TileGrid
+{
+public:
+    static constexpr int maxTileSize = 1024;
+    static constexpr int maxZoom = 23;
+
+    /*!
+        Returns the lowest zoom level whose tiles have at least the given
+        resolution
+    */
+    static int zoom(double pixelsPerLon);
+    static int pixelsPerLon(int zoom);
+};
@@ -0,0 +1,117 @@
+#define _USE_MATH_DEFINES
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "tilefactory/tileid.h"
+
+namespace {
+double tileLongitude(int x, int zoom)
+{
+    return x / static_cast<double>(1 << zoom) * 360. - 180.;
+}
+
+double tileLatitude(int y, int zoom)
+{
+    const double n = M_PI * (1 - 2. * y / (1 << zoom));
+    return atan(sinh(n)) * 180. / M_PI;
+}
+}
+
+TileId::TileId(int zoom, int x, int y)
+    : m_zoom(zoom)
+    , m_x(x)
+    , m_y(y)
+{
+    assert(zoom >= 0 && zoom < 31);
+    assert(x >= 0 && x < (1 << zoom));
+    assert(y >= 0 && y < (1 << zoom));
+}
+
+TileId TileId::fromPos(const Pos &pos, int zoom)
+{
+    const int tiles = 1 << zoom;
+    const double latitude = std::clamp(pos.lat(), tileLatitude(1, 0), tileLatitude(0, 0));
+    const double phi = latitude * M_PI / 180.;
+
+    const double x = (pos.lon() + 180.) / 360. * tiles;
+    const double y = (1 - log(tan(phi) + 1 / cos(phi)) / M_PI) / 2 * tiles;
+
+    return TileId(zoom,
+                  std::clamp(static_cast<int>(floor(x)), 0, tiles - 1),
+                  std::clamp(static_cast<int>(floor(y)), 0, tiles - 1));
+}
+
+std::optional<TileId> TileId::fromQuadKey(std::string_view quadKey)
+{
+    int x = 0;
+    int y = 0;
+
+    for (char digit : quadKey) {
+        if (digit < '0' || digit > '3') {
+            return {};
+        }
+
+        x = (x << 1) | ((digit - '0') & 1);
+        y = (y << 1) | ((digit - '0') >> 1);
+    }
+
+    return TileId(static_cast<int>(quadKey.size()), x, y);
+}
+
+GeoRect TileId::boundingBox() const
+{
+    return GeoRect(tileLatitude(m_y, m_zoom),
+                   tileLatitude(m_y + 1, m_zoom),
+                   tileLongitude(m_x, m_zoom),
+                   tileLongitude(m_x + 1, m_zoom));
+}
+
+TileId TileId::parent() const
+{
+    assert(m_zoom > 0);
+    return TileId(m_zoom - 1, m_x >> 1, m_y >> 1);
+}
+
+std::array<TileId, 4> TileId::children() const
+{
+    const int x = m_x << 1;
+    const int y = m_y << 1;
+    return { TileId(m_zoom + 1, x, y),
+             TileId(m_zoom + 1, x + 1, y),
+             TileId(m_zoom + 1, x, y + 1),
+             TileId(m_zoom + 1, x + 1, y + 1) };
+}
+
+TileId TileId::neighbor(int dx, int dy) const
+{
+    const int tiles = 1 << m_zoom;
+    const int x = ((m_x + dx) % tiles + tiles) % tiles;
+    const int y = std::clamp(m_y + dy, 0, tiles - 1);
+    return TileId(m_zoom, x, y);
+}
+
+std::string TileId::quadKey() const
+{
+    std::string quadKey;
+    quadKey.reserve(m_zoom);
+
+    for (int i = m_zoom; i > 0; i--) {
+        const int mask = 1 << (i - 1);
+        char digit = '0';
+        if (m_x & mask) {
+            digit += 1;
+        }
+        if (m_y & mask) {
+            digit += 2;
+        }
+        quadKey.push_back(digit);
+    }
+
+    return quadKey;
+}
+
+std::string TileId::toString() const
+{
+    return std::to_string(m_zoom) + "-" + std::to_string(m_x) + "-" + std::to_string(m_y);
+}
@@ -0,0 +1,132 @@
+#include <algorithm>
+
+#include "workerpool.h"
+
+namespace {
+thread_local bool isPoolThread = false;
+}
+
+WorkerPool &WorkerPool::instance()
+{
+    // The calling thread takes part in its jobs, so one thread fewer than
+    // there are cores keeps a single caller from oversubscribing
+    static WorkerPool pool(std::max<size_t>(std::thread::hardware_concurrency(), 2) - 1);
+    return pool;
+}
+
+WorkerPool::WorkerPool(size_t threadCount)
+{
+    for (size_t i = 0; i < threadCount; i++) {
+        m_threads.emplace_back([this]() {
+            isPoolThread = true;
+            work();
+        });
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wakeUp.notify_all();
+
+    for (std::thread &thread : m_threads) {
+        thread.join();
+    }
+}
+
+WorkerPool::Task::Task(const std::function<void(size_t index)> &function, size_t count)
+    : function(function)
+    , count(count)
+{
+}
+
+void WorkerPool::Task::run()
+{
+    for (size_t index = next++; index < count; index = next++) {
+        try {
+            function(index);
+        } catch (...) {
+            std::lock_guard lock(mutex);
+            if (!exception) {
+                exception = std::current_exception();
+            }
+        }
+
+        std::lock_guard lock(mutex);
+        if (++done == count) {
+            finished.notify_all();
+        }
+    }
+}
+
+void WorkerPool::work()
+{
+    while (true) {
+        std::shared_ptr<Task> task;
+
+        {
+            std::unique_lock lock(m_mutex);
+            m_wakeUp.wait(lock, [this]() {
+                return m_stopping || !m_tasks.empty();
+            });
+
+            if (m_tasks.empty()) {
+                return;
+            }
+
+            task = m_tasks.front();
+        }
+
+        task->run();
+        remove(task);
+    }
+}
+
+void WorkerPool::remove(const std::shared_ptr<Task> &task)
+{
+    std::lock_guard lock(m_mutex);
+    auto it = std::find(m_tasks.begin(), m_tasks.end(), task);
+    if (it != m_tasks.end()) {
+        m_tasks.erase(it);
+    }
+}
+
+void WorkerPool::forEach(size_t count, const std::function<void(size_t index)> &function)
+{
+    if (isPoolThread || m_threads.empty() || count < 2) {
+        for (size_t index = 0; index < count; index++) {
+            function(index);
+        }
+        return;
+    }
+
+    std::shared_ptr<Task> task = std::make_shared<Task>(function, count);
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_tasks.push_back(task);
+    }
+
+    if (count - 1 < m_threads.size()) {
+        for (size_t i = 0; i < count - 1; i++) {
+            m_wakeUp.notify_one();
+        }
+    } else {
+        m_wakeUp.notify_all();
+    }
+
+    task->run();
+    remove(task);
+
+    std::unique_lock lock(task->mutex);
+    task->finished.wait(lock, [&task]() {
+        return task->done == task->count;
+    });
+
+    if (task->exception) {
+        std::rethrow_exception(task->exception);
+    }
+}
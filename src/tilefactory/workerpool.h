@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+    Runs data parallel jobs on one set of threads shared by the whole process
+
+    Tiles are generated from several threads at once. Starting threads for
+    every tile would multiply the number of threads by the number of callers,
+    so all callers hand their jobs to this pool instead. The calling thread
+    takes part in its own jobs, and jobs started from a pool thread run
+    inline on that thread.
+*/
+class WorkerPool
+{
+public:
+    static WorkerPool &instance();
+
+    ~WorkerPool();
+
+    /*!
+        Calls function for every index in [0, count) and returns when all
+        calls are done. The first exception thrown by a call is rethrown.
+    */
+    void forEach(size_t count, const std::function<void(size_t index)> &function);
+
+private:
+    struct Task
+    {
+        const std::function<void(size_t index)> &function;
+        const size_t count;
+        std::atomic<size_t> next = 0;
+
+        std::mutex mutex;
+        std::condition_variable finished;
+        size_t done = 0;
+        std::exception_ptr exception;
+
+        Task(const std::function<void(size_t index)> &function, size_t count);
+
+        /// Runs jobs until none are left to claim
+        void run();
+    };
+
+    explicit WorkerPool(size_t threadCount);
+    void work();
+    void remove(const std::shared_ptr<Task> &task);
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::deque<std::shared_ptr<Task>> m_tasks;
+    bool m_stopping = false;
+    std::vector<std::thread> m_threads;
+};